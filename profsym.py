@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Symbolize a kernel profile dump (PROF DUMP) against build/kernel.bin.
+
+Prints a flat profile (self and total samples per function) and can write
+folded stacks for flamegraph.pl or speedscope. The dump may be a raw COM1
+capture; everything outside the "KPRF" ... "KEND" frame is ignored.
+"""
+import argparse
+import bisect
+import shutil
+import struct
+import subprocess
+import sys
+from collections import Counter
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent
+MAGIC = b"KPRF"
+TRAILER = b"KEND"
+VERSION = 1
+
+
+class Symbols:
+    def __init__(self, kernel: Path) -> None:
+        nm = shutil.which("nm")
+        if nm is None:
+            raise SystemExit("[!] Required tool 'nm' not found in PATH.")
+        out = subprocess.run([nm, "-n", "--defined-only", str(kernel)],
+                             check=True, capture_output=True, text=True).stdout
+        self.addrs = []
+        self.names = []
+        for line in out.splitlines():
+            parts = line.split()
+            if len(parts) == 3 and parts[1] in "tTwW":
+                self.addrs.append(int(parts[0], 16))
+                self.names.append(parts[2])
+
+    def lookup(self, pc: int) -> str:
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        return self.names[i] if i >= 0 else f"0x{pc:08x}"
+
+
+def parse(data: bytes):
+    start = data.find(MAGIC)
+    if start < 0:
+        raise SystemExit("[!] No KPRF profile frame found in input.")
+    offset = start + len(MAGIC)
+
+    def u32() -> int:
+        nonlocal offset
+        if offset + 4 > len(data):
+            raise SystemExit("[!] Profile dump is truncated.")
+        value = struct.unpack_from("<I", data, offset)[0]
+        offset += 4
+        return value
+
+    version = u32()
+    if version != VERSION:
+        raise SystemExit(f"[!] Unsupported profile version {version}.")
+    hz = u32()
+    stacks = []
+    dropped = 0
+    for _ in range(u32()):
+        cpu = u32()
+        count = u32()
+        dropped += u32()
+        for _ in range(count):
+            samples = u32()
+            depth = u32()
+            stacks.append((cpu, samples, [u32() for _ in range(depth)]))
+    if data[offset:offset + len(TRAILER)] != TRAILER:
+        raise SystemExit("[!] Profile frame has no KEND trailer.")
+    return hz, stacks, dropped
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", type=Path, help="serial capture containing the profile")
+    parser.add_argument("--kernel", type=Path, default=ROOT / "build" / "kernel.bin")
+    parser.add_argument("--folded", type=Path, help="write folded stacks here")
+    parser.add_argument("--per-cpu", action="store_true", help="prefix folded stacks with the CPU")
+    parser.add_argument("--top", type=int, default=30, help="rows in the flat profile")
+    args = parser.parse_args()
+
+    hz, stacks, dropped = parse(args.dump.read_bytes())
+    syms = Symbols(args.kernel)
+
+    total = sum(samples for _, samples, _ in stacks)
+    self_counts = Counter()
+    total_counts = Counter()
+    folded = Counter()
+    for cpu, samples, pcs in stacks:
+        # pcs[0] is the interrupted instruction; the rest are return
+        # addresses, which can point past the end of a noreturn caller.
+        frames = [syms.lookup(pc if i == 0 else pc - 1) for i, pc in enumerate(pcs)]
+        self_counts[frames[0]] += samples
+        for name in set(frames):
+            total_counts[name] += samples
+        path = ";".join(reversed(frames))
+        if args.per_cpu:
+            path = f"CPU{cpu};{path}"
+        folded[path] += samples
+
+    print(f"{total} samples at {hz} Hz, {dropped} dropped (table full)")
+    print(f"{'self':>8} {'self%':>6} {'total':>8}  function")
+    for name, count in self_counts.most_common(args.top):
+        pct = 100.0 * count / total if total else 0.0
+        print(f"{count:8d} {pct:6.2f} {total_counts[name]:8d}  {name}")
+
+    if args.folded:
+        with args.folded.open("w") as out:
+            for path, count in folded.most_common():
+                out.write(f"{path} {count}\n")
+        print(f"[✓] Folded stacks written to {args.folded}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,175 @@
+#include "acpi.h"
+#include "multiboot2.h"
+#include "console.h"
+#include "common.h"
+
+#define MADT_TYPE_LAPIC 0
+#define MADT_TYPE_IOAPIC 1
+#define MADT_TYPE_ISO 2
+#define MADT_TYPE_LAPIC_OVERRIDE 5
+#define MADT_LAPIC_ENABLED 0x1
+#define MADT_LAPIC_ONLINE_CAPABLE 0x2
+
+typedef struct __attribute__((packed)) {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} acpi_rsdp_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[];
+} acpi_madt_t;
+
+static const acpi_sdt_header_t *root;
+static int root_is_xsdt;
+static acpi_madt_info_t madt_info;
+static int have_madt;
+
+static int checksum_ok(const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        sum = (uint8_t)(sum + p[i]);
+    }
+    return sum == 0;
+}
+
+static const acpi_rsdp_t *scan_rsdp(uint32_t start, uint32_t len) {
+    for (uint32_t addr = start; addr + 20 <= start + len; addr += 16) {
+        const acpi_rsdp_t *rsdp = (const acpi_rsdp_t *)(uintptr_t)addr;
+        if (!kmemcmp(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/* GRUB hands over a copy of the RSDP; older loaders do not, so fall back to
+ * the legacy BIOS search areas (EBDA, then E0000-FFFFF). */
+static const acpi_rsdp_t *find_rsdp(void *mb2) {
+    mb2_tag_acpi_t *tag = (mb2_tag_acpi_t *)mb2_find_tag(mb2, MB2_TAG_ACPI_NEW);
+    if (!tag) {
+        tag = (mb2_tag_acpi_t *)mb2_find_tag(mb2, MB2_TAG_ACPI_OLD);
+    }
+    if (tag) {
+        return (const acpi_rsdp_t *)tag->rsdp;
+    }
+    /* Launder the BIOS data area address so GCC does not treat the constant
+     * low pointer as a null dereference. */
+    uintptr_t bda_ebda = 0x40E;
+    __asm__("" : "+r"(bda_ebda));
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t *)bda_ebda) << 4;
+    const acpi_rsdp_t *rsdp = ebda ? scan_rsdp(ebda, 1024) : NULL;
+    if (!rsdp) {
+        rsdp = scan_rsdp(0xE0000, 0x20000);
+    }
+    return rsdp;
+}
+
+static void parse_madt(const acpi_madt_t *madt) {
+    kmemset(&madt_info, 0, sizeof(madt_info));
+    madt_info.lapic_addr = madt->lapic_addr;
+    for (int i = 0; i < ACPI_ISA_IRQS; ++i) {
+        madt_info.isa_gsi[i] = (uint32_t)i;
+    }
+
+    const uint8_t *p = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        switch (p[0]) {
+            case MADT_TYPE_LAPIC: {
+                uint32_t flags = *(const uint32_t *)(p + 4);
+                if ((flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE)) &&
+                    madt_info.cpu_count < ACPI_MAX_CPUS) {
+                    madt_info.cpu_apic_ids[madt_info.cpu_count++] = p[3];
+                }
+                break;
+            }
+            case MADT_TYPE_IOAPIC:
+                if (!madt_info.ioapic_addr) {
+                    madt_info.ioapic_addr = *(const uint32_t *)(p + 4);
+                    madt_info.ioapic_gsi_base = *(const uint32_t *)(p + 8);
+                }
+                break;
+            case MADT_TYPE_ISO:
+                if (p[3] < ACPI_ISA_IRQS) {
+                    madt_info.isa_gsi[p[3]] = *(const uint32_t *)(p + 4);
+                    madt_info.isa_flags[p[3]] = *(const uint16_t *)(p + 8);
+                }
+                break;
+            case MADT_TYPE_LAPIC_OVERRIDE: {
+                uint64_t addr = *(const uint64_t *)(p + 4);
+                if (addr <= 0xFFFFFFFFull) {
+                    madt_info.lapic_addr = (uint32_t)addr;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        p += p[1];
+    }
+    have_madt = 1;
+}
+
+int acpi_init(void *mb2) {
+    root = NULL;
+    have_madt = 0;
+    const acpi_rsdp_t *rsdp = find_rsdp(mb2);
+    if (!rsdp) {
+        log_event(LOG_WARN, "ACPI: no RSDP found");
+        return -1;
+    }
+    if (rsdp->revision >= 2 && rsdp->xsdt_addr && rsdp->xsdt_addr <= 0xFFFFFFFFull) {
+        root = (const acpi_sdt_header_t *)(uintptr_t)rsdp->xsdt_addr;
+        root_is_xsdt = 1;
+    } else {
+        root = (const acpi_sdt_header_t *)(uintptr_t)rsdp->rsdt_addr;
+        root_is_xsdt = 0;
+    }
+    if (!checksum_ok(root, root->length)) {
+        log_event(LOG_WARN, "ACPI: root table checksum bad");
+        root = NULL;
+        return -1;
+    }
+
+    const acpi_madt_t *madt = (const acpi_madt_t *)acpi_find_table("APIC");
+    if (madt) {
+        parse_madt(madt);
+    }
+    log_event(LOG_SUCCESS, "ACPI tables located");
+    return 0;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    if (!root) {
+        return NULL;
+    }
+    uint32_t entry_size = root_is_xsdt ? 8 : 4;
+    uint32_t count = (root->length - sizeof(*root)) / entry_size;
+    const uint8_t *entries = (const uint8_t *)(root + 1);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t addr = *(const uint32_t *)(entries + i * entry_size);
+        if (root_is_xsdt && *(const uint32_t *)(entries + i * entry_size + 4)) {
+            continue;
+        }
+        const acpi_sdt_header_t *table = (const acpi_sdt_header_t *)(uintptr_t)addr;
+        if (!kmemcmp(table->signature, signature, 4) && checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+const acpi_madt_info_t *acpi_madt(void) {
+    return have_madt ? &madt_info : NULL;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS 16
+#define ACPI_ISA_IRQS 16
+
+/* ISA interrupt source override flags (MPS INTI encoding). */
+#define ACPI_ISO_POLARITY_LOW 0x3
+#define ACPI_ISO_TRIGGER_LEVEL 0xC
+
+typedef struct __attribute__((packed)) {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+typedef struct {
+    uint32_t lapic_addr;
+    uint32_t ioapic_addr;
+    uint32_t ioapic_gsi_base;
+    int cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];
+    uint32_t isa_gsi[ACPI_ISA_IRQS];
+    uint16_t isa_flags[ACPI_ISA_IRQS];
+} acpi_madt_info_t;
+
+int acpi_init(void *mb2);
+const acpi_sdt_header_t *acpi_find_table(const char *signature);
+const acpi_madt_info_t *acpi_madt(void);
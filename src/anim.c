@@ -1,9 +1,12 @@
 #include "anim.h"
+#include "clock.h"
 
-static float last_time;
+#define ANIM_MAX_STEP_NS (100u * NSEC_PER_MSEC)
+
+static uint64_t last_ns;
 
 void anim_init(void) {
-    last_time = 0.0f;
+    last_ns = ktime_ns();
 }
 
 float anim_eval(ease_t ease, float x) {
@@ -41,11 +44,15 @@ float anim_step(tween_t *tw, float dt) {
     return value;
 }
 
+/* Seconds since the previous call, clamped so a long stall does not make
+ * tweens jump straight to their end value. */
 float anim_time_delta(void) {
-    last_time += 0.016f;
-    if (last_time > 1.0f) {
-        last_time -= 1.0f;
+    uint64_t now = ktime_ns();
+    uint64_t delta = now - last_ns;
+    last_ns = now;
+    if (delta > ANIM_MAX_STEP_NS) {
+        delta = ANIM_MAX_STEP_NS;
     }
-    return 0.016f;
+    return (float)(uint32_t)delta * 1e-9f;
 }
 
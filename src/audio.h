@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 typedef enum {
     SND_OK = 1,
     SND_WARN = 2,
@@ -9,8 +11,13 @@ typedef enum {
     SND_CLOSE = 6
 } snd_t;
 
+typedef struct {
+    uint32_t played;
+    uint32_t coalesced;
+} audio_stats_t;
+
 void audio_init(void);
 void audio_play(snd_t sound);
 void audio_set_volume(int pct);
 void audio_set_mute(int mute);
-
+void audio_get_stats(audio_stats_t *out);
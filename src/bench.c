@@ -0,0 +1,665 @@
+#include "bench.h"
+#include "blend.h"
+#include "compositor.h"
+#include "fb.h"
+#include "memtype.h"
+#include "console.h"
+#include "cpu.h"
+#include "clock.h"
+#include "timer.h"
+#include "slab.h"
+#include "pmm.h"
+#include "paging.h"
+#include "crypto.h"
+#include "fpu.h"
+#include "sched.h"
+#include "smp.h"
+#include "parallel.h"
+#include "blockchain.h"
+#include "fiber.h"
+#include "common.h"
+
+#define BENCH_PIXELS (256 * 256)
+#define BENCH_REPS 16
+#define BENCH_VRAM_BYTES (2u * 1024 * 1024)
+#define BENCH_TIMERS 4096
+#define BENCH_TIMER_SPREAD_NS (64u * NSEC_PER_MSEC)
+#define BENCH_KMALLOC_PAIRS 4096
+#define BENCH_KMALLOC_BATCH 1024
+#define BENCH_TLB_BLOCKS 4
+#define BENCH_TLB_PAGES (BENCH_TLB_BLOCKS * 1024)
+#define BENCH_TLB_PASSES 16
+#define BENCH_RENDER_FRAMES 8
+#define BENCH_SMP_CHUNK 4096u
+#define BENCH_FIBERS 1024
+#define BENCH_FIBER_YIELDS 65536
+#define BENCH_TASK_ROUNDS 4096
+#define BENCH_MEM_MAX (1u << 20)
+#define BENCH_MEM_ORDER 8
+#define BENCH_MEM_VOLUME (4u << 20)
+
+typedef struct {
+    const char *name;
+    const char *help;
+    void (*run)(void);
+} bench_desc_t;
+
+static uint32_t bench_dst[BENCH_PIXELS];
+static uint32_t bench_src[BENCH_PIXELS];
+static ktimer_t bench_timers[BENCH_TIMERS];
+static void *bench_ptrs[BENCH_KMALLOC_BATCH];
+static uint32_t timers_fired;
+static uint64_t timers_max_late;
+
+static uint32_t elapsed32(uint64_t start) {
+    uint64_t delta = rdtsc() - start;
+    return delta > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)delta;
+}
+
+/* Appends value/100 with two decimals; callers pre-scale by 100. */
+static void append_fixed2(char *buf, size_t len, uint32_t value_x100) {
+    char num[16];
+    kitoa((int)(value_x100 / 100), num, sizeof(num));
+    kstrcat(buf, num, len);
+    kstrcat(buf, ".", len);
+    uint32_t frac = value_x100 % 100;
+    num[0] = (char)('0' + frac / 10);
+    num[1] = (char)('0' + frac % 10);
+    num[2] = '\0';
+    kstrcat(buf, num, len);
+}
+
+static uint32_t ratio_x100(uint32_t num, uint32_t den) {
+    if (!den) {
+        return 0;
+    }
+    if (num <= 0xFFFFFFFFu / 100) {
+        return num * 100 / den;
+    }
+    return num / (den / 100 ? den / 100 : 1);
+}
+
+static void report_rate(const char *label, const char *kernel, uint32_t cycles, uint32_t units,
+                        const char *unit, uint32_t baseline) {
+    char msg[96];
+    kstrncpy(msg, label, sizeof(msg) - 1);
+    kstrcat(msg, " ", sizeof(msg));
+    kstrcat(msg, kernel, sizeof(msg));
+    kstrcat(msg, ": ", sizeof(msg));
+    append_fixed2(msg, sizeof(msg), ratio_x100(cycles, units));
+    kstrcat(msg, " cyc/", sizeof(msg));
+    kstrcat(msg, unit, sizeof(msg));
+    if (baseline && cycles) {
+        kstrcat(msg, " (", sizeof(msg));
+        append_fixed2(msg, sizeof(msg), ratio_x100(baseline, cycles));
+        kstrcat(msg, "x)", sizeof(msg));
+    }
+    log_text(LOG_SUCCESS, msg);
+}
+
+static void bench_blend(void) {
+    for (uint32_t i = 0; i < BENCH_PIXELS; ++i) {
+        bench_src[i] = (i * 2654435761u) ^ (i << 24);
+    }
+    uint32_t base_fill = 0;
+    uint32_t base_blit = 0;
+    for (int level = CPU_SIMD_NONE; level <= (int)cpu_simd_level(); ++level) {
+        const blend_ops_t *ops = blend_ops_for((cpu_simd_t)level);
+        kmemset(bench_dst, 0x40, sizeof(bench_dst));
+
+        kernel_fpu_begin();
+        uint64_t start = rdtsc();
+        for (int rep = 0; rep < BENCH_REPS; ++rep) {
+            ops->fill(bench_dst, 0x00336699, 0x80, BENCH_PIXELS);
+        }
+        uint32_t fill = elapsed32(start);
+
+        start = rdtsc();
+        for (int rep = 0; rep < BENCH_REPS; ++rep) {
+            ops->blit(bench_dst, bench_src, BENCH_PIXELS);
+        }
+        uint32_t blit = elapsed32(start);
+        kernel_fpu_end();
+
+        if (level == CPU_SIMD_NONE) {
+            base_fill = fill;
+            base_blit = blit;
+        }
+        report_rate("BLEND fill", ops->name, fill, BENCH_PIXELS * BENCH_REPS, "px", base_fill);
+        report_rate("BLEND blit", ops->name, blit, BENCH_PIXELS * BENCH_REPS, "px", base_blit);
+    }
+}
+
+static void report_bandwidth(const char *label, uint32_t bytes, uint32_t cycles) {
+    char msg[96];
+    kstrncpy(msg, label, sizeof(msg) - 1);
+    kstrcat(msg, ": ", sizeof(msg));
+    append_fixed2(msg, sizeof(msg), ratio_x100(bytes, cycles));
+    kstrcat(msg, " B/cyc", sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+}
+
+static uint32_t vram_write_pass(volatile uint32_t *dst, uint32_t words) {
+    uint64_t start = rdtsc();
+    for (int rep = 0; rep < 4; ++rep) {
+        for (uint32_t i = 0; i < words; ++i) {
+            dst[i] = 0x00204060u + (uint32_t)rep;
+        }
+    }
+    return elapsed32(start);
+}
+
+/* Scribbles over VRAM, so the desktop is fully recomposed afterwards. */
+static void bench_vram(void) {
+    uint32_t *vram = fb_vram();
+    if (!vram) {
+        log_event(LOG_WARN, "VRAM bench: no linear framebuffer");
+        return;
+    }
+    uint32_t bytes = fb_vram_size() < BENCH_VRAM_BYTES ? fb_vram_size() : BENCH_VRAM_BYTES;
+    uint32_t words = bytes / 4;
+    uint32_t addr = (uint32_t)(uintptr_t)vram;
+
+    int page_wc = paging_enabled() && paging_memtype(addr) == MEMTYPE_WC;
+    if (memtype_wc_available() || page_wc) {
+        char label[48];
+        memtype_use_firmware();
+        if (page_wc) {
+            paging_set_cache(addr, fb_vram_size(), PAGE_CACHE_WB);
+        }
+        kstrncpy(label, "VRAM before (", sizeof(label) - 1);
+        kstrcat(label, memtype_name(memtype_effective(addr)), sizeof(label));
+        kstrcat(label, ")", sizeof(label));
+        report_bandwidth(label, bytes * 4, vram_write_pass(vram, words));
+        if (page_wc) {
+            paging_set_cache(addr, fb_vram_size(), PAGE_CACHE_WC);
+        }
+        memtype_use_wc();
+    } else {
+        log_event(LOG_WARN, "VRAM bench: WC mapping unavailable, no baseline");
+    }
+    char label[48];
+    kstrncpy(label, "VRAM now (", sizeof(label) - 1);
+    kstrcat(label, memtype_name(memtype_effective(addr)), sizeof(label));
+    kstrcat(label, ")", sizeof(label));
+    report_bandwidth(label, bytes * 4, vram_write_pass(vram, words));
+    comp_invalidate_all();
+}
+
+static void bench_timer_fired(void *arg) {
+    ktimer_t *timer = (ktimer_t *)arg;
+    uint64_t late = ktime_ns() - timer->deadline;
+    if (late > timers_max_late) {
+        timers_max_late = late;
+    }
+    ++timers_fired;
+}
+
+/* Arms a wheel's worth of timers at spread-out deadlines (1 ms to ~70 min,
+ * so every wheel level is populated) to time insert and cancel, then lets
+ * a dense batch expire for real. That batch only spans
+ * BENCH_TIMER_SPREAD_NS, so the expire figure covers the lowest levels. */
+static void bench_timers_run(void) {
+    if (!clock_source_khz()) {
+        log_event(LOG_WARN, "TIMERS bench: no clocksource");
+        return;
+    }
+    uint64_t now = ktime_ns();
+    uint32_t seed = 0x9E3779B9u;
+    for (int i = 0; i < BENCH_TIMERS; ++i) {
+        timer_setup(&bench_timers[i], bench_timer_fired, &bench_timers[i]);
+    }
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_TIMERS; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        timer_arm(&bench_timers[i], now + NSEC_PER_MSEC + ((uint64_t)(seed >> 8) << 18));
+    }
+    uint32_t arm = elapsed32(start);
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_TIMERS; ++i) {
+        timer_cancel(&bench_timers[i]);
+    }
+    uint32_t cancel = elapsed32(start);
+    report_rate("TIMERS arm", "wheel", arm, BENCH_TIMERS, "op", 0);
+    report_rate("TIMERS cancel", "wheel", cancel, BENCH_TIMERS, "op", 0);
+
+    timers_fired = 0;
+    timers_max_late = 0;
+    now = ktime_ns();
+    for (int i = 0; i < BENCH_TIMERS; ++i) {
+        timer_arm(&bench_timers[i], now + NSEC_PER_MSEC + (uint64_t)i * (BENCH_TIMER_SPREAD_NS / BENCH_TIMERS));
+    }
+    /* Run expiry here rather than in the timer thread so it can be timed. */
+    uint64_t give_up = now + NSEC_PER_SEC;
+    uint32_t run_cycles = 0;
+    sched_preempt_disable();
+    while (timers_fired < BENCH_TIMERS && ktime_ns() < give_up) {
+        start = rdtsc();
+        timer_run_expired();
+        run_cycles += elapsed32(start);
+    }
+    sched_preempt_enable();
+    for (int i = 0; i < BENCH_TIMERS; ++i) {
+        timer_cancel(&bench_timers[i]);
+    }
+    report_rate("TIMERS expire", "wheel", run_cycles, timers_fired ? timers_fired : 1, "timer", 0);
+
+    char msg[80];
+    char num[16];
+    kstrncpy(msg, "TIMERS fired ", sizeof(msg) - 1);
+    kitoa((int)timers_fired, num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, ", max late ", sizeof(msg));
+    kitoa((int)((uint32_t)timers_max_late / NSEC_PER_USEC), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " us", sizeof(msg));
+    log_text(timers_fired == BENCH_TIMERS ? LOG_SUCCESS : LOG_WARN, msg);
+}
+
+/* The hot pair stays inside the per-CPU magazines; the batch drains them
+ * and pushes the slab layer (or the page allocator above 2 KB). */
+static void bench_kmalloc(void) {
+    static const uint32_t sizes[] = {16, 64, 256, 1024, 4096};
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); ++s) {
+        char kernel[16];
+        kitoa((int)sizes[s], kernel, sizeof(kernel));
+        kstrcat(kernel, "B", sizeof(kernel));
+
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_KMALLOC_PAIRS; ++i) {
+            kfree(kmalloc(sizes[s]));
+        }
+        report_rate("KMALLOC pair", kernel, elapsed32(start), BENCH_KMALLOC_PAIRS, "op", 0);
+
+        uint32_t got = 0;
+        start = rdtsc();
+        for (int i = 0; i < BENCH_KMALLOC_BATCH; ++i) {
+            bench_ptrs[i] = kmalloc(sizes[s]);
+            got += bench_ptrs[i] != NULL;
+        }
+        uint32_t alloc = elapsed32(start);
+        start = rdtsc();
+        for (int i = 0; i < BENCH_KMALLOC_BATCH; ++i) {
+            kfree(bench_ptrs[i]);
+        }
+        uint32_t release = elapsed32(start);
+        if (got != BENCH_KMALLOC_BATCH) {
+            log_event(LOG_WARN, "KMALLOC bench: allocation failed");
+        }
+        report_rate("KMALLOC batch alloc", kernel, alloc, BENCH_KMALLOC_BATCH, "op", 0);
+        report_rate("KMALLOC batch free", kernel, release, BENCH_KMALLOC_BATCH, "op", 0);
+    }
+    comp_invalidate(PANEL_SYSMON);
+}
+
+/* One byte per page in a scattered order, so every access needs a fresh
+ * translation once the working set outgrows the TLB's small-page reach. */
+static uint32_t tlb_walk(const uint32_t *blocks) {
+    uint32_t sum = 0;
+    uint64_t start = rdtsc();
+    for (int pass = 0; pass < BENCH_TLB_PASSES; ++pass) {
+        for (uint32_t i = 0; i < BENCH_TLB_PAGES; ++i) {
+            uint32_t page = (i * 2654435761u) & (BENCH_TLB_PAGES - 1);
+            sum += *(volatile uint8_t *)(uintptr_t)(blocks[page >> 10] + ((page & 1023) << 12) + (pass << 6));
+        }
+    }
+    (void)sum;
+    return elapsed32(start);
+}
+
+static uint32_t hash_pass(const uint32_t *blocks) {
+    uint8_t digest[32];
+    uint64_t start = rdtsc();
+    for (int b = 0; b < BENCH_TLB_BLOCKS; ++b) {
+        sha256((const uint8_t *)(uintptr_t)blocks[b], PMM_PAGE_SIZE << PMM_MAX_ORDER, digest);
+    }
+    return elapsed32(start);
+}
+
+static uint32_t render_pass(void) {
+    uint32_t total = 0;
+    for (int i = 0; i < BENCH_RENDER_FRAMES; ++i) {
+        comp_invalidate_all();
+        uint64_t start = rdtsc();
+        comp_compose();
+        total += elapsed32(start);
+    }
+    return total;
+}
+
+/* Same work with the RAM identity map expressed as 4 MB pages and then as
+ * 4 KB pages; the small-page rows carry the slowdown against large. */
+static void bench_paging(void) {
+    if (!paging_large_pages()) {
+        log_event(LOG_WARN, "PAGING bench: large pages not in use");
+        return;
+    }
+    uint32_t blocks[BENCH_TLB_BLOCKS];
+    int got = 0;
+    for (; got < BENCH_TLB_BLOCKS; ++got) {
+        if ((blocks[got] = pmm_alloc_pages(PMM_MAX_ORDER)) == 0) {
+            break;
+        }
+        kmemset((void *)(uintptr_t)blocks[got], 0x5A, PMM_PAGE_SIZE << PMM_MAX_ORDER);
+    }
+    if (got < BENCH_TLB_BLOCKS) {
+        log_event(LOG_WARN, "PAGING bench: not enough free memory");
+    } else {
+        uint32_t hash_bytes = BENCH_TLB_BLOCKS * (PMM_PAGE_SIZE << PMM_MAX_ORDER);
+        uint32_t walk[2], hash[2], render[2];
+        for (int small = 0; small < 2; ++small) {
+            if (small && paging_use_large_pages(0) != 0) {
+                log_event(LOG_WARN, "PAGING bench: could not split large pages");
+                break;
+            }
+            walk[small] = tlb_walk(blocks);
+            hash[small] = hash_pass(blocks);
+            render[small] = render_pass();
+            const char *kernel = small ? "4K" : "4M";
+            report_rate("PAGING walk", kernel, walk[small], BENCH_TLB_PAGES * BENCH_TLB_PASSES, "page",
+                        small ? walk[0] : 0);
+            report_rate("PAGING sha256", kernel, hash[small], hash_bytes, "B", small ? hash[0] : 0);
+            report_rate("PAGING render", kernel, render[small], BENCH_RENDER_FRAMES, "frame",
+                        small ? render[0] : 0);
+        }
+        paging_use_large_pages(1);
+    }
+    while (got--) {
+        pmm_free_pages(blocks[got], PMM_MAX_ORDER);
+    }
+}
+
+typedef struct {
+    const uint8_t *data;
+    uint8_t (*digests)[32];
+} smp_hash_job_t;
+
+static void smp_hash_range(void *arg, uint32_t begin, uint32_t end) {
+    smp_hash_job_t *job = (smp_hash_job_t *)arg;
+    for (uint32_t i = begin; i < end; ++i) {
+        sha256(job->data + i * BENCH_SMP_CHUNK, BENCH_SMP_CHUNK, job->digests[i]);
+    }
+}
+
+/* SHA-256 over independent 4 KB chunks of a 4 MB block, spread with
+ * parallel_for over 1, 2, 4 and 8 CPUs; TSC cycles are wall time here. */
+static void bench_smp(void) {
+    uint32_t block = pmm_alloc_pages(PMM_MAX_ORDER);
+    uint32_t bytes = PMM_PAGE_SIZE << PMM_MAX_ORDER;
+    uint32_t count = bytes / BENCH_SMP_CHUNK;
+    uint8_t (*digests)[32] = kmalloc(count * 32);
+    if (!block || !digests) {
+        log_event(LOG_WARN, "SMP bench: not enough free memory");
+    } else {
+        kmemset((void *)(uintptr_t)block, 0xA5, bytes);
+        smp_hash_job_t job = {(const uint8_t *)(uintptr_t)block, digests};
+        uint32_t saved = parallel_cpus();
+        uint32_t base = 0;
+        for (uint32_t cpus = 1; cpus <= CPU_MAX && cpus <= smp_cpu_count(); cpus *= 2) {
+            parallel_set_cpus(cpus);
+            uint64_t start = rdtsc();
+            parallel_for(count, 1, smp_hash_range, &job);
+            uint32_t cycles = elapsed32(start);
+            if (cpus == 1) {
+                base = cycles;
+            }
+            char kernel[16];
+            kitoa((int)cpus, kernel, sizeof(kernel));
+            kstrcat(kernel, " CPU", sizeof(kernel));
+            report_rate("SMP sha256", kernel, cycles, bytes, "B", cpus > 1 ? base : 0);
+        }
+        parallel_set_cpus(saved);
+    }
+    kfree(digests);
+    if (block) {
+        pmm_free_pages(block, PMM_MAX_ORDER);
+    }
+}
+
+/* A full scratch system chain with redundancy on every block, verified
+ * with the block range split across 1, 2, 4 and 8 CPUs. */
+static void bench_verify(void) {
+    file_blockchain_t *chain = kmalloc(sizeof(*chain));
+    if (!chain) {
+        log_event(LOG_WARN, "VERIFY bench: not enough free memory");
+        return;
+    }
+    kmemset(chain, 0, sizeof(*chain));
+    kstrncpy(chain->file_path, "/system/bench", sizeof(chain->file_path) - 1);
+    chain->file_type = FILE_TYPE_SYSTEM;
+    uint8_t data[BLOCK_SHARD_SIZE * BLOCK_SHARDS_PER_BLOCK];
+    for (uint32_t i = 0; i < BLOCKCHAIN_MAX_BLOCKS; ++i) {
+        kmemset(data, (int)(i & 0xFF), sizeof(data));
+        blockchain_add_block(chain, data, sizeof(data), 1);
+    }
+
+    uint32_t saved = parallel_cpus();
+    uint32_t base = 0;
+    for (uint32_t cpus = 1; cpus <= CPU_MAX && cpus <= smp_cpu_count(); cpus *= 2) {
+        parallel_set_cpus(cpus);
+        uint64_t start = rdtsc();
+        int result = blockchain_verify_all(chain);
+        uint32_t cycles = elapsed32(start);
+        if (cpus == 1) {
+            base = cycles;
+        }
+        char kernel[16];
+        kitoa((int)cpus, kernel, sizeof(kernel));
+        kstrcat(kernel, " CPU", sizeof(kernel));
+        if (result != 0) {
+            kstrcat(kernel, " FAIL", sizeof(kernel));
+        }
+        report_rate("VERIFY chain", kernel, cycles, BLOCKCHAIN_MAX_BLOCKS, "block", cpus > 1 ? base : 0);
+    }
+    parallel_set_cpus(saved);
+    kfree(chain);
+}
+
+static uint32_t fibers_left;
+static sched_event_t fibers_done;
+static sched_event_t ping_event;
+static sched_event_t pong_event;
+
+static void fiber_finished(void) {
+    if (__atomic_sub_fetch(&fibers_left, 1, __ATOMIC_ACQ_REL) == 0) {
+        sched_event_signal(&fibers_done);
+    }
+}
+
+static void fiber_empty(void *arg) {
+    (void)arg;
+    fiber_finished();
+}
+
+static void fiber_pingpong(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < BENCH_FIBER_YIELDS; ++i) {
+        fiber_yield();
+    }
+    fiber_finished();
+}
+
+static void task_pong(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < BENCH_TASK_ROUNDS; ++i) {
+        sched_event_wait(&ping_event);
+        sched_event_signal(&pong_event);
+    }
+}
+
+/* Fiber spawn-to-exit cost, fiber-to-fiber yield latency, and for scale a
+ * kernel task round trip through sched_event on the same CPU. */
+static void bench_fiber(void) {
+    sched_event_init(&fibers_done);
+    fibers_left = BENCH_FIBERS;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_FIBERS; ++i) {
+        if (!fiber_spawn(fiber_empty, NULL)) {
+            log_event(LOG_WARN, "FIBER bench: spawn failed");
+            fiber_finished();
+        }
+    }
+    sched_event_wait(&fibers_done);
+    report_rate("FIBER spawn+exit", "pool", elapsed32(start), BENCH_FIBERS, "fiber", 0);
+
+    fibers_left = 2;
+    start = rdtsc();
+    if (!fiber_spawn(fiber_pingpong, NULL)) {
+        fiber_finished();
+    }
+    if (!fiber_spawn(fiber_pingpong, NULL)) {
+        fiber_finished();
+    }
+    sched_event_wait(&fibers_done);
+    uint32_t fiber_cycles = elapsed32(start);
+    report_rate("FIBER switch", "yield", fiber_cycles, 2 * BENCH_FIBER_YIELDS, "switch", 0);
+
+    sched_event_init(&ping_event);
+    sched_event_init(&pong_event);
+    if (!task_spawn("bench-pong", task_pong, NULL, task_current()->prio)) {
+        log_event(LOG_WARN, "FIBER bench: no task for comparison");
+        return;
+    }
+    start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_TASK_ROUNDS; ++i) {
+        sched_event_signal(&ping_event);
+        sched_event_wait(&pong_event);
+    }
+    report_rate("FIBER switch", "task event", elapsed32(start), 2 * BENCH_TASK_ROUNDS, "switch", 0);
+}
+
+/* Byte-at-a-time references; the empty asm keeps GCC from turning them
+ * back into library calls. */
+static void byte_copy(uint8_t *d, const uint8_t *s, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        d[i] = s[i];
+        __asm__ volatile("" : : : "memory");
+    }
+}
+
+static void byte_set(uint8_t *d, uint8_t v, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        d[i] = v;
+        __asm__ volatile("" : : : "memory");
+    }
+}
+
+static int byte_cmp(const uint8_t *a, const uint8_t *b, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            return (int)a[i] - (int)b[i];
+        }
+        __asm__ volatile("" : : : "memory");
+    }
+    return 0;
+}
+
+static void mem_report(const char *label, uint32_t size, uint32_t cycles, uint32_t bytes, uint32_t base) {
+    char kernel[16];
+    kitoa((int)size, kernel, sizeof(kernel));
+    kstrcat(kernel, "B", sizeof(kernel));
+    report_rate(label, kernel, cycles, bytes, "B", base);
+}
+
+/* kmemcpy/kmemset/kmemcmp against byte loops from 8 B to 1 MB, moving
+ * about 4 MB per measurement; equal buffers make kmemcmp scan the whole
+ * length. */
+static void bench_mem(void) {
+    uint32_t a = pmm_alloc_pages(BENCH_MEM_ORDER);
+    uint32_t b = pmm_alloc_pages(BENCH_MEM_ORDER);
+    if (!a || !b) {
+        log_event(LOG_WARN, "MEM bench: not enough free memory");
+    } else {
+        uint8_t *src = (uint8_t *)(uintptr_t)a;
+        uint8_t *dst = (uint8_t *)(uintptr_t)b;
+        kmemset(src, 0x5A, BENCH_MEM_MAX);
+        kmemset(dst, 0x5A, BENCH_MEM_MAX);
+        log_event(LOG_SUCCESS, "%s", kmem_strategy());
+        static const uint32_t sizes[] = {8, 32, 64, 256, 4096, 65536, BENCH_MEM_MAX};
+        for (size_t i = 0; i < ARRAY_SIZE(sizes); ++i) {
+            uint32_t size = sizes[i];
+            uint32_t reps = BENCH_MEM_VOLUME / size;
+            uint32_t bytes = reps * size;
+            volatile int sink = 0;
+
+            uint64_t start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) byte_copy(dst, src, size);
+            uint32_t base = elapsed32(start);
+            start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) kmemcpy(dst, src, size);
+            mem_report("MEM copy", size, elapsed32(start), bytes, base);
+
+            start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) byte_set(dst, 0x5A, size);
+            base = elapsed32(start);
+            start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) kmemset(dst, 0x5A, size);
+            mem_report("MEM set", size, elapsed32(start), bytes, base);
+
+            start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) sink += byte_cmp(dst, src, size);
+            base = elapsed32(start);
+            start = rdtsc();
+            for (uint32_t r = 0; r < reps; ++r) sink += kmemcmp(dst, src, size);
+            mem_report("MEM cmp", size, elapsed32(start), bytes, base);
+            (void)sink;
+        }
+
+        uint8_t hash_a[KHASH_SIZE];
+        uint8_t hash_b[KHASH_SIZE];
+        kmemset(hash_a, 0x11, sizeof(hash_a));
+        uint32_t reps = BENCH_MEM_VOLUME / KHASH_SIZE;
+        uint64_t start = rdtsc();
+        uint32_t equal = 0;
+        for (uint32_t r = 0; r < reps; ++r) {
+            khash_copy(hash_b, hash_a);
+            __asm__ volatile("" : : : "memory");
+            equal += khash_equal(hash_a, hash_b);
+        }
+        report_rate("MEM hash", "copy+equal", elapsed32(start), reps, "op", 0);
+        if (equal != reps) {
+            log_event(LOG_ERROR, "MEM bench: hash compare mismatch");
+        }
+    }
+    if (a) {
+        pmm_free_pages(a, BENCH_MEM_ORDER);
+    }
+    if (b) {
+        pmm_free_pages(b, BENCH_MEM_ORDER);
+    }
+}
+
+static const bench_desc_t benches[] = {
+    {"BLEND", "alpha fill/blit per SIMD level", bench_blend},
+    {"VRAM", "framebuffer write bandwidth, firmware vs WC", bench_vram},
+    {"TIMERS", "timer wheel arm/cancel/expiry with 4096 timers", bench_timers_run},
+    {"KMALLOC", "heap alloc/free latency, hot pair and 1024 batch", bench_kmalloc},
+    {"PAGING", "TLB walk, sha256 and render with 4 MB vs 4 KB pages", bench_paging},
+    {"SMP", "sha256 throughput on 1/2/4/8 CPUs via work stealing", bench_smp},
+    {"VERIFY", "parallel chain and shard hash verify on 1/2/4/8 CPUs", bench_verify},
+    {"FIBER", "fiber spawn and switch latency vs kernel tasks", bench_fiber},
+    {"MEM", "kmemcpy/kmemset/kmemcmp vs byte loops, 8 B to 1 MB", bench_mem},
+};
+
+int bench_run(const char *name) {
+    for (size_t i = 0; i < ARRAY_SIZE(benches); ++i) {
+        if (!kstrcmp(name, benches[i].name)) {
+            benches[i].run();
+            return 0;
+        }
+    }
+    log_event(LOG_WARN, "Unknown benchmark");
+    return -1;
+}
+
+void bench_list(void) {
+    for (size_t i = 0; i < ARRAY_SIZE(benches); ++i) {
+        char msg[96];
+        kstrncpy(msg, benches[i].name, sizeof(msg) - 1);
+        kstrcat(msg, " - ", sizeof(msg));
+        kstrcat(msg, benches[i].help, sizeof(msg));
+        log_text(LOG_SUCCESS, msg);
+    }
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+int bench_run(const char *name);
+void bench_list(void);
@@ -0,0 +1,106 @@
+#include "bga.h"
+#include "io.h"
+
+#define VBE_DISPI_IOPORT_INDEX 0x01CE
+#define VBE_DISPI_IOPORT_DATA 0x01CF
+
+#define VBE_DISPI_INDEX_ID 0x0
+#define VBE_DISPI_INDEX_XRES 0x1
+#define VBE_DISPI_INDEX_YRES 0x2
+#define VBE_DISPI_INDEX_BPP 0x3
+#define VBE_DISPI_INDEX_ENABLE 0x4
+#define VBE_DISPI_INDEX_VIRT_WIDTH 0x6
+#define VBE_DISPI_INDEX_VIRT_HEIGHT 0x7
+#define VBE_DISPI_INDEX_X_OFFSET 0x8
+#define VBE_DISPI_INDEX_Y_OFFSET 0x9
+#define VBE_DISPI_INDEX_VIDEO_MEMORY_64K 0xA
+
+#define VBE_DISPI_ID0 0xB0C0
+#define VBE_DISPI_ID5 0xB0C5
+#define VBE_DISPI_ENABLED 0x01
+#define VBE_DISPI_LFB_ENABLED 0x40
+#define VBE_DISPI_NOCLEARMEM 0x80
+
+#define VGA_INPUT_STATUS_1 0x03DA
+#define VGA_STATUS_VRETRACE 0x08
+#define VBLANK_SPIN_LIMIT 1000000
+
+static int bga_present;
+
+static uint16_t dispi_read(uint16_t index) {
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    return inw(VBE_DISPI_IOPORT_DATA);
+}
+
+static void dispi_write(uint16_t index, uint16_t value) {
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    outw(VBE_DISPI_IOPORT_DATA, value);
+}
+
+int bga_detect(void) {
+    uint16_t id = dispi_read(VBE_DISPI_INDEX_ID);
+    bga_present = id >= VBE_DISPI_ID0 && id <= VBE_DISPI_ID5;
+    return bga_present;
+}
+
+int bga_is_active_mode(uint32_t width, uint32_t height, uint32_t bpp) {
+    if (!bga_present) {
+        return 0;
+    }
+    uint16_t enable = dispi_read(VBE_DISPI_INDEX_ENABLE);
+    return (enable & (VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED)) == (VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED) &&
+           dispi_read(VBE_DISPI_INDEX_XRES) == width &&
+           dispi_read(VBE_DISPI_INDEX_YRES) == height &&
+           dispi_read(VBE_DISPI_INDEX_BPP) == bpp;
+}
+
+int bga_set_mode(uint32_t width, uint32_t height, uint32_t bpp) {
+    if (!bga_present || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) {
+        return -1;
+    }
+    if ((uint64_t)width * height * (bpp / 8) > bga_vram_bytes()) {
+        return -1;
+    }
+    dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+    dispi_write(VBE_DISPI_INDEX_XRES, (uint16_t)width);
+    dispi_write(VBE_DISPI_INDEX_YRES, (uint16_t)height);
+    dispi_write(VBE_DISPI_INDEX_BPP, (uint16_t)bpp);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED | VBE_DISPI_NOCLEARMEM);
+    return bga_is_active_mode(width, height, bpp) ? 0 : -1;
+}
+
+/* The adapter clamps the virtual height to what fits in VRAM, so the value
+ * read back is the one callers must trust. */
+uint32_t bga_set_virtual(uint32_t virt_width, uint32_t virt_height) {
+    if (!bga_present) {
+        return 0;
+    }
+    dispi_write(VBE_DISPI_INDEX_VIRT_WIDTH, (uint16_t)virt_width);
+    dispi_write(VBE_DISPI_INDEX_VIRT_HEIGHT, (uint16_t)virt_height);
+    bga_set_offset(0, 0);
+    return dispi_read(VBE_DISPI_INDEX_VIRT_HEIGHT);
+}
+
+uint32_t bga_vram_bytes(void) {
+    if (!bga_present) {
+        return 0;
+    }
+    return (uint32_t)dispi_read(VBE_DISPI_INDEX_VIDEO_MEMORY_64K) * 64 * 1024;
+}
+
+void bga_set_offset(uint32_t x, uint32_t y) {
+    dispi_write(VBE_DISPI_INDEX_X_OFFSET, (uint16_t)x);
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, (uint16_t)y);
+}
+
+/* Emulated adapters have no vblank interrupt; the legacy VGA retrace bit is
+ * the best pacing signal there is. The spin is bounded so a device that
+ * never toggles it cannot stall presentation. */
+void bga_wait_vblank(void) {
+    int spins = VBLANK_SPIN_LIMIT;
+    while ((inb(VGA_INPUT_STATUS_1) & VGA_STATUS_VRETRACE) && --spins) {
+    }
+    spins = VBLANK_SPIN_LIMIT;
+    while (!(inb(VGA_INPUT_STATUS_1) & VGA_STATUS_VRETRACE) && --spins) {
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Bochs/QEMU "dispi" display interface (QEMU -vga std). */
+int bga_detect(void);
+int bga_is_active_mode(uint32_t width, uint32_t height, uint32_t bpp);
+int bga_set_mode(uint32_t width, uint32_t height, uint32_t bpp);
+uint32_t bga_set_virtual(uint32_t virt_width, uint32_t virt_height);
+uint32_t bga_vram_bytes(void);
+void bga_set_offset(uint32_t x, uint32_t y);
+void bga_wait_vblank(void);
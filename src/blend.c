@@ -0,0 +1,176 @@
+#include "blend.h"
+
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef v16u8 v16u8_u __attribute__((aligned(1), may_alias));
+typedef uint8_t v32u8 __attribute__((vector_size(32)));
+typedef uint16_t v16u16 __attribute__((vector_size(32)));
+typedef v32u8 v32u8_u __attribute__((aligned(1), may_alias));
+
+#define SSE2_FN __attribute__((target("sse2")))
+#define SSE2_INLINE static inline __attribute__((always_inline, target("sse2")))
+#define AVX2_FN __attribute__((target("avx2")))
+#define AVX2_INLINE static inline __attribute__((always_inline, target("avx2")))
+
+static inline uint32_t div255(uint32_t v) {
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+uint32_t blend_color(uint32_t src, uint32_t dst, uint32_t alpha) {
+    uint32_t inv = 255 - alpha;
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t s = (src >> shift) & 0xFF;
+        uint32_t d = (dst >> shift) & 0xFF;
+        out |= div255(s * alpha + d * inv) << shift;
+    }
+    return out;
+}
+
+static void scalar_fill(uint32_t *dst, uint32_t color, uint32_t alpha, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = blend_color(color, dst[i], alpha);
+    }
+}
+
+static void scalar_blit(uint32_t *dst, const uint32_t *src, int count) {
+    for (int i = 0; i < count; ++i) {
+        uint32_t alpha = src[i] >> 24;
+        if (alpha == 0xFF) {
+            dst[i] = src[i];
+        } else if (alpha) {
+            dst[i] = blend_color(src[i], dst[i], alpha);
+        }
+    }
+}
+
+/* SSE2: four pixels per iteration, one 16-bit lane per channel. */
+
+SSE2_INLINE v8u16 sse2_widen_lo(v16u8 v) {
+    return (v8u16)__builtin_shuffle(v, (v16u8){0},
+        (v16u8){0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23});
+}
+
+SSE2_INLINE v8u16 sse2_widen_hi(v16u8 v) {
+    return (v8u16)__builtin_shuffle(v, (v16u8){0},
+        (v16u8){8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31});
+}
+
+SSE2_INLINE v16u8 sse2_narrow(v8u16 lo, v8u16 hi) {
+    return __builtin_shuffle((v16u8)lo, (v16u8)hi,
+        (v16u8){0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30});
+}
+
+SSE2_INLINE v8u16 sse2_div255(v8u16 v) {
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+SSE2_INLINE v8u16 sse2_alpha(v8u16 px) {
+    return __builtin_shuffle(px, (v8u16){3, 3, 3, 3, 7, 7, 7, 7});
+}
+
+static SSE2_FN void sse2_fill(uint32_t *dst, uint32_t color, uint32_t alpha, int count) {
+    v16u8 src = (v16u8)((uint32_t __attribute__((vector_size(16)))){color, color, color, color});
+    v8u16 sa = sse2_widen_lo(src) * (uint16_t)alpha;
+    v8u16 inv = (v8u16){0} + (uint16_t)(255 - alpha);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v16u8 d = *(const v16u8_u *)(dst + i);
+        v8u16 lo = sse2_div255(sse2_widen_lo(d) * inv + sa);
+        v8u16 hi = sse2_div255(sse2_widen_hi(d) * inv + sa);
+        *(v16u8_u *)(dst + i) = sse2_narrow(lo, hi);
+    }
+    scalar_fill(dst + i, color, alpha, count - i);
+}
+
+static SSE2_FN void sse2_blit(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v16u8 s = *(const v16u8_u *)(src + i);
+        v16u8 d = *(const v16u8_u *)(dst + i);
+        v8u16 slo = sse2_widen_lo(s);
+        v8u16 shi = sse2_widen_hi(s);
+        v8u16 alo = sse2_alpha(slo);
+        v8u16 ahi = sse2_alpha(shi);
+        v8u16 lo = sse2_div255(slo * alo + sse2_widen_lo(d) * (255 - alo));
+        v8u16 hi = sse2_div255(shi * ahi + sse2_widen_hi(d) * (255 - ahi));
+        *(v16u8_u *)(dst + i) = sse2_narrow(lo, hi);
+    }
+    scalar_blit(dst + i, src + i, count - i);
+}
+
+/* AVX2: eight pixels per iteration. Unpack and pack stay inside each
+ * 128-bit lane, so the pixel order survives the round trip. */
+
+AVX2_INLINE v16u16 avx2_widen_lo(v32u8 v) {
+    return (v16u16)__builtin_shuffle(v, (v32u8){0},
+        (v32u8){0, 32, 1, 33, 2, 34, 3, 35, 4, 36, 5, 37, 6, 38, 7, 39,
+                16, 48, 17, 49, 18, 50, 19, 51, 20, 52, 21, 53, 22, 54, 23, 55});
+}
+
+AVX2_INLINE v16u16 avx2_widen_hi(v32u8 v) {
+    return (v16u16)__builtin_shuffle(v, (v32u8){0},
+        (v32u8){8, 40, 9, 41, 10, 42, 11, 43, 12, 44, 13, 45, 14, 46, 15, 47,
+                24, 56, 25, 57, 26, 58, 27, 59, 28, 60, 29, 61, 30, 62, 31, 63});
+}
+
+AVX2_INLINE v32u8 avx2_narrow(v16u16 lo, v16u16 hi) {
+    return __builtin_shuffle((v32u8)lo, (v32u8)hi,
+        (v32u8){0, 2, 4, 6, 8, 10, 12, 14, 32, 34, 36, 38, 40, 42, 44, 46,
+                16, 18, 20, 22, 24, 26, 28, 30, 48, 50, 52, 54, 56, 58, 60, 62});
+}
+
+AVX2_INLINE v16u16 avx2_div255(v16u16 v) {
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+AVX2_INLINE v16u16 avx2_alpha(v16u16 px) {
+    return __builtin_shuffle(px, (v16u16){3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15});
+}
+
+static AVX2_FN void avx2_fill(uint32_t *dst, uint32_t color, uint32_t alpha, int count) {
+    v32u8 src = (v32u8)((uint32_t __attribute__((vector_size(32)))){
+        color, color, color, color, color, color, color, color});
+    v16u16 sa = avx2_widen_lo(src) * (uint16_t)alpha;
+    v16u16 inv = (v16u16){0} + (uint16_t)(255 - alpha);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        v32u8 d = *(const v32u8_u *)(dst + i);
+        v16u16 lo = avx2_div255(avx2_widen_lo(d) * inv + sa);
+        v16u16 hi = avx2_div255(avx2_widen_hi(d) * inv + sa);
+        *(v32u8_u *)(dst + i) = avx2_narrow(lo, hi);
+    }
+    sse2_fill(dst + i, color, alpha, count - i);
+}
+
+static AVX2_FN void avx2_blit(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        v32u8 s = *(const v32u8_u *)(src + i);
+        v32u8 d = *(const v32u8_u *)(dst + i);
+        v16u16 slo = avx2_widen_lo(s);
+        v16u16 shi = avx2_widen_hi(s);
+        v16u16 alo = avx2_alpha(slo);
+        v16u16 ahi = avx2_alpha(shi);
+        v16u16 lo = avx2_div255(slo * alo + avx2_widen_lo(d) * (255 - alo));
+        v16u16 hi = avx2_div255(shi * ahi + avx2_widen_hi(d) * (255 - ahi));
+        *(v32u8_u *)(dst + i) = avx2_narrow(lo, hi);
+    }
+    sse2_blit(dst + i, src + i, count - i);
+}
+
+static const blend_ops_t ops_table[] = {
+    [CPU_SIMD_NONE] = {"scalar", scalar_fill, scalar_blit},
+    [CPU_SIMD_SSE2] = {"SSE2", sse2_fill, sse2_blit},
+    [CPU_SIMD_AVX2] = {"AVX2", avx2_fill, avx2_blit},
+};
+
+const blend_ops_t *blend_ops_for(cpu_simd_t level) {
+    if ((int)level < 0 || (int)level >= (int)(sizeof(ops_table) / sizeof(ops_table[0]))) {
+        level = CPU_SIMD_NONE;
+    }
+    return &ops_table[level];
+}
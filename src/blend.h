@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include "cpu.h"
+
+/* Span kernels for alpha compositing. Colours are XRGB/ARGB words and all
+ * kernels round with the division-free (x * a + 127) / 255 identity, so
+ * every SIMD level produces bit-identical pixels to the scalar path.
+ * Callers bracket the SIMD kernels with kernel_fpu_begin/end. */
+typedef struct {
+    const char *name;
+    void (*fill)(uint32_t *dst, uint32_t color, uint32_t alpha, int count);
+    void (*blit)(uint32_t *dst, const uint32_t *src, int count);
+} blend_ops_t;
+
+uint32_t blend_color(uint32_t src, uint32_t dst, uint32_t alpha);
+const blend_ops_t *blend_ops_for(cpu_simd_t level);
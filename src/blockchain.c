@@ -2,6 +2,12 @@
 #include "crypto.h"
 #include "common.h"
 #include "console.h"
+#include "clock.h"
+#include "slab.h"
+#include "sched.h"
+#include "parallel.h"
+#include "trace.h"
+#include "metrics.h"
 #include <stddef.h>
 
 static blockchain_manager_t bcm;
@@ -28,14 +34,65 @@ static void compute_block_hash(file_block_t* block, uint8_t out[32]) {
     sha256(temp, offset, out);
 }
 
-static void compute_chain_hash(file_blockchain_t* chain, uint8_t out[32]) {
-    if (chain->block_count == 0) {
-        kmemset(out, 0, 32);
-        return;
+static void split_into_shards(const uint8_t* data, uint32_t size, block_shard_t* shards);
+
+/* Writers hold the chain's ticket lock with preemption off, so a holder is
+ * never descheduled while another CPU spins on it. */
+static void chain_lock(file_blockchain_t* chain) {
+    sched_preempt_disable();
+    ticket_lock(&chain->lock);
+}
+
+static void chain_unlock(file_blockchain_t* chain) {
+    ticket_unlock(&chain->lock);
+    sched_preempt_enable();
+}
+
+/* head_seq is odd while block_count and chain_hash are being changed. */
+static void head_write_begin(file_blockchain_t* chain) {
+    __atomic_store_n(&chain->head_seq, chain->head_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void head_write_end(file_blockchain_t* chain) {
+    __atomic_store_n(&chain->head_seq, chain->head_seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Returns the published block count and copies the matching chain hash,
+ * retrying if an append raced with the read. */
+static uint32_t head_snapshot(file_blockchain_t* chain, uint8_t hash[32]) {
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&chain->head_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            cpu_relax();
+            continue;
+        }
+        uint32_t count = __atomic_load_n(&chain->block_count, __ATOMIC_ACQUIRE);
+        kmemcpy(hash, chain->chain_hash, 32);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&chain->head_seq, __ATOMIC_RELAXED) == seq) {
+            return count;
+        }
     }
-    
-    file_block_t* last_block = &chain->blocks[chain->block_count - 1];
-    kmemcpy(out, last_block->block_hash, 32);
+}
+
+static uint32_t path_bucket(const char* path) {
+    uint32_t hash = 2166136261u;
+    while (*path) {
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+    }
+    return hash % BLOCKCHAIN_PATH_BUCKETS;
+}
+
+static file_blockchain_t* lookup_user_chain(const char* path, uint32_t bucket) {
+    file_blockchain_t* chain = __atomic_load_n(&bcm.buckets[bucket], __ATOMIC_ACQUIRE);
+    while (chain) {
+        if (kstrcmp(chain->file_path, path) == 0) {
+            return chain;
+        }
+        chain = __atomic_load_n(&chain->hash_next, __ATOMIC_ACQUIRE);
+    }
+    return NULL;
 }
 
 int blockchain_init(void) {
@@ -76,24 +133,45 @@ file_blockchain_t* blockchain_get_file(const char* path, file_type_t type) {
         return &bcm.system_chain;
     }
     
-    for (uint32_t i = 0; i < bcm.user_file_count; ++i) {
-        if (kstrcmp(bcm.user_files[i].file_path, path) == 0) {
-            return &bcm.user_files[i];
-        }
+    /* Lookups never lock. A miss takes index_lock and looks again, so two
+     * CPUs creating the same path end up with one chain. */
+    uint32_t bucket = path_bucket(path);
+    file_blockchain_t* found = lookup_user_chain(path, bucket);
+    if (found) {
+        return found;
     }
     
-    if (bcm.user_file_count >= BLOCKCHAIN_MAX_FILES) {
-        log_event(LOG_ERROR, "Blockchain: Max user files reached");
+    sched_preempt_disable();
+    ticket_lock(&bcm.index_lock);
+    found = lookup_user_chain(path, bucket);
+    if (found || bcm.user_file_count >= BLOCKCHAIN_MAX_FILES) {
+        ticket_unlock(&bcm.index_lock);
+        sched_preempt_enable();
+        if (!found) {
+            log_event(LOG_ERROR, "Blockchain: Max user files reached");
+        }
+        return found;
+    }
+    
+    /* User chains are large and usually few, so they come from the heap
+     * on first use rather than sitting in BSS for every possible file. */
+    file_blockchain_t* new_chain = kzalloc(sizeof(*new_chain));
+    if (new_chain) {
+        kstrncpy(new_chain->file_path, path, sizeof(new_chain->file_path) - 1);
+        new_chain->file_type = FILE_TYPE_USER;
+        new_chain->hash_next = bcm.buckets[bucket];
+        bcm.user_files[bcm.user_file_count] = new_chain;
+        __atomic_store_n(&bcm.user_file_count, bcm.user_file_count + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&bcm.buckets[bucket], new_chain, __ATOMIC_RELEASE);
+    }
+    ticket_unlock(&bcm.index_lock);
+    sched_preempt_enable();
+    if (!new_chain) {
+        log_event(LOG_ERROR, "Blockchain: Out of memory for file chain");
         return NULL;
     }
     
-    file_blockchain_t* new_chain = &bcm.user_files[bcm.user_file_count++];
-    kmemset(new_chain, 0, sizeof(*new_chain));
-    kstrncpy(new_chain->file_path, path, sizeof(new_chain->file_path) - 1);
-    new_chain->file_type = FILE_TYPE_USER;
-    new_chain->block_count = 0;
-    
-    log_event(LOG_SUCCESS, "Created new blockchain for file");
+    log_noisy(LOG_SUCCESS, "Created new blockchain for file");
     return new_chain;
 }
 
@@ -102,86 +180,242 @@ int blockchain_add_block(file_blockchain_t* chain, const uint8_t* file_data,
     if (!chain) {
         return -1;
     }
+    TRACE_BEGIN(TRACE_BLOCK_ADD, file_size);
+    
+    /* Everything that only depends on the caller's data is hashed before
+     * taking the lock, so appends to one chain serialize on the short
+     * link-and-publish step alone. */
+    uint8_t file_hash[32];
+    if (file_data && file_size > 0) {
+        sha256(file_data, file_size, file_hash);
+    } else {
+        kmemset(file_hash, 0, 32);
+    }
+    
+    uint8_t metadata[64];
+    kmemset(metadata, 0, sizeof(metadata));
+    kmemcpy(metadata, chain->file_path, kstrlen(chain->file_path));
+    kmemcpy(metadata + 32, &file_size, 4);
+    uint8_t metadata_hash[32];
+    sha256(metadata, 36, metadata_hash);
     
-    if (chain->block_count >= BLOCKCHAIN_MAX_BLOCKS) {
+    // System blocks carry their redundancy from the moment they are visible
+    int redundant = chain->file_type == FILE_TYPE_SYSTEM && file_data;
+    block_shard_t shards[BLOCK_SHARDS_PER_BLOCK];
+    if (redundant) {
+        split_into_shards(file_data, file_size, shards);
+    }
+    
+    chain_lock(chain);
+    uint32_t index = chain->block_count;
+    if (index >= BLOCKCHAIN_MAX_BLOCKS) {
+        chain_unlock(chain);
         log_event(LOG_ERROR, "Blockchain: Max blocks reached for file");
+        TRACE_END(TRACE_BLOCK_ADD, file_size);
         return -1;
     }
     
-    file_block_t* block = &chain->blocks[chain->block_count++];
+    /* The block is built in the unpublished slot past block_count, so
+     * lock-free readers never see it half written. */
+    file_block_t* block = &chain->blocks[index];
     kmemset(block, 0, sizeof(*block));
     
-    block->block_index = chain->block_count - 1;
+    block->block_index = index;
     block->file_size = file_size;
     block->operation = operation;
-    block->timestamp = 0;
-    
-    if (file_data && file_size > 0) {
-        sha256(file_data, file_size, block->file_hash);
-    } else {
-        kmemset(block->file_hash, 0, 32);
-    }
+    block->timestamp = clock_unix_time();
+    kmemcpy(block->file_hash, file_hash, 32);
+    kmemcpy(block->metadata_hash, metadata_hash, 32);
     
-    if (block->block_index == 0) {
+    if (index == 0) {
         kmemset(block->prev_hash, 0, 32);
     } else {
-        file_block_t* prev_block = &chain->blocks[block->block_index - 1];
+        file_block_t* prev_block = &chain->blocks[index - 1];
         kmemcpy(block->prev_hash, prev_block->block_hash, 32);
     }
     
-    uint8_t metadata[64];
-    kmemset(metadata, 0, sizeof(metadata));
-    kmemcpy(metadata, chain->file_path, kstrlen(chain->file_path));
-    kmemcpy(metadata + 32, &file_size, 4);
-    sha256(metadata, 36, block->metadata_hash);
-    
     compute_block_hash(block, block->block_hash);
-    compute_chain_hash(chain, chain->chain_hash);
     
+    if (redundant) {
+        kmemcpy(block->shards, shards, sizeof(shards));
+        block->has_redundancy = 1;
+    }
+    
+    head_write_begin(chain);
+    kmemcpy(chain->chain_hash, block->block_hash, 32);
+    __atomic_store_n(&chain->block_count, index + 1, __ATOMIC_RELEASE);
+    head_write_end(chain);
+    chain_unlock(chain);
+    if (redundant) {
+        log_noisy(LOG_SUCCESS, "Redundancy data added to system block");
+    }
+    TRACE_END(TRACE_BLOCK_ADD, file_size);
     return 0;
 }
 
-int blockchain_verify(file_blockchain_t* chain) {
+/* Block and shard hashes only depend on their own block, so they are
+ * recomputed in parallel chunks; each chunk records the lowest failing
+ * index it saw. The prev_hash linkage and chain hash are compared in a
+ * cheap sequential pass afterwards, so errors still report in block order. */
+#define VERIFY_GRAIN 16
+
+typedef struct {
+    file_blockchain_t* chain;
+    int check_shards;
+    uint32_t total;
+    uint32_t bad_hash;
+    uint32_t bad_shard;
+    uint32_t checked;
+    blockchain_progress_fn progress;
+    void* ctx;
+} verify_job_t;
+
+static void record_min(uint32_t* slot, uint32_t value) {
+    uint32_t seen = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    while (value < seen &&
+           !__atomic_compare_exchange_n(slot, &seen, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static int shards_intact(file_block_t* block) {
+    for (int i = 0; i < BLOCK_SHARDS_PER_BLOCK; ++i) {
+        uint8_t computed_hash[32];
+        sha256(block->shards[i].data, BLOCK_SHARD_SIZE, computed_hash);
+        if (!khash_equal(computed_hash, block->shards[i].shard_hash)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void verify_range(void* arg, uint32_t begin, uint32_t end) {
+    verify_job_t* job = (verify_job_t*)arg;
+    for (uint32_t i = begin; i < end; ++i) {
+        file_block_t* block = &job->chain->blocks[i];
+        uint8_t computed_hash[32];
+        compute_block_hash(block, computed_hash);
+        if (!khash_equal(computed_hash, block->block_hash)) {
+            record_min(&job->bad_hash, i);
+        }
+        if (job->check_shards && block->has_redundancy && !shards_intact(block)) {
+            record_min(&job->bad_shard, i);
+        }
+    }
+    metric_count(METRIC_BLOCKS_VERIFIED, end - begin);
+    uint32_t checked = __atomic_add_fetch(&job->checked, end - begin, __ATOMIC_RELAXED);
+    if (job->progress) {
+        job->progress(job->ctx, checked, job->total);
+    }
+}
+
+int blockchain_verify_progress(file_blockchain_t* chain, int check_shards,
+                               blockchain_progress_fn progress, void* ctx) {
     if (!chain) return -1;
     
-    if (chain->block_count == 0) {
+    uint8_t head_hash[32];
+    uint32_t count = head_snapshot(chain, head_hash);
+    if (count == 0) {
         return 0;
     }
     
-    for (uint32_t i = 0; i < chain->block_count; ++i) {
-        file_block_t* block = &chain->blocks[i];
-        uint8_t computed_hash[32];
-        compute_block_hash(block, computed_hash);
-        
-        if (kmemcmp(computed_hash, block->block_hash, 32) != 0) {
-            log_event(LOG_ERROR, "Blockchain verification failed: block hash mismatch");
+    verify_job_t job = {chain, check_shards, count, count, count, 0, progress, ctx};
+    TRACE_BEGIN(TRACE_CHAIN_VERIFY, count);
+    parallel_for(count, VERIFY_GRAIN, verify_range, &job);
+    TRACE_END(TRACE_CHAIN_VERIFY, count);
+    
+    /* Report whichever failure the serial walk would have hit first: a
+     * block's own hash is checked before its link, so a broken link only
+     * wins when it sits strictly below the first bad hash. */
+    for (uint32_t i = 1; i < count && i < job.bad_hash; ++i) {
+        if (!khash_equal(chain->blocks[i].prev_hash, chain->blocks[i - 1].block_hash)) {
+            log_event(LOG_ERROR, "Blockchain verification failed: chain broken");
             return -1;
         }
-        
-        if (i > 0) {
-            file_block_t* prev_block = &chain->blocks[i - 1];
-            if (kmemcmp(block->prev_hash, prev_block->block_hash, 32) != 0) {
-                log_event(LOG_ERROR, "Blockchain verification failed: chain broken");
-                return -1;
-            }
-        }
+    }
+    if (job.bad_hash < count) {
+        log_event(LOG_ERROR, "Blockchain verification failed: block hash mismatch");
+        return -1;
     }
     
-    uint8_t computed_chain_hash[32];
-    compute_chain_hash(chain, computed_chain_hash);
-    if (kmemcmp(computed_chain_hash, chain->chain_hash, 32) != 0) {
+    if (!khash_equal(chain->blocks[count - 1].block_hash, head_hash)) {
         log_event(LOG_ERROR, "Blockchain verification failed: chain hash mismatch");
         return -1;
     }
     
+    if (job.bad_shard < count) {
+        log_event(LOG_ERROR, "Shard hash mismatch in block");
+        return -1;
+    }
     return 0;
 }
 
+int blockchain_verify(file_blockchain_t* chain) {
+    return blockchain_verify_progress(chain, 0, NULL, NULL);
+}
+
+int blockchain_verify_all(file_blockchain_t* chain) {
+    return blockchain_verify_progress(chain, 1, NULL, NULL);
+}
+
+#define SCRUB_INTERVAL_NS (60ull * NSEC_PER_SEC)
+
+/* Index 0 is the system chain, the rest are user files. Each chain goes to
+ * whichever CPU picks it up and fans its blocks out again from there. */
+static void scrub_range(void* arg, uint32_t begin, uint32_t end) {
+    uint32_t* failed = (uint32_t*)arg;
+    for (uint32_t i = begin; i < end; ++i) {
+        file_blockchain_t* chain = i ? bcm.user_files[i - 1] : &bcm.system_chain;
+        if (blockchain_verify_all(chain) != 0) {
+            __atomic_add_fetch(failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Each chain is verified against its own head snapshot, so appends that
+ * land during the scrub are simply left for the next pass. */
+int blockchain_scrub(void) {
+    uint32_t failed = 0;
+    uint32_t chains = __atomic_load_n(&bcm.user_file_count, __ATOMIC_ACQUIRE) + 1;
+    TRACE_BEGIN(TRACE_SCRUB, chains);
+    parallel_for(chains, 1, scrub_range, &failed);
+    TRACE_END(TRACE_SCRUB, failed);
+    return (int)failed;
+}
+
+static void scrub_task(void* arg) {
+    (void)arg;
+    for (;;) {
+        sched_sleep_ns(SCRUB_INTERVAL_NS);
+        if (blockchain_scrub()) {
+            log_event(LOG_ERROR, "Scrubber: chain verification failed");
+        }
+    }
+}
+
+void blockchain_start_scrubber(void) {
+    task_spawn("scrubber", scrub_task, NULL, SCHED_PRIO_BACKGROUND);
+}
+
+uint32_t blockchain_chain_count(void) {
+    return __atomic_load_n(&bcm.user_file_count, __ATOMIC_ACQUIRE) + 1;
+}
+
+/* The system chain is static and each user chain one heap object, so the
+ * footprint is a multiple of the chain size. */
+uint32_t blockchain_memory_kb(void) {
+    return (uint32_t)(((uint64_t)blockchain_chain_count() * sizeof(file_blockchain_t)) >> 10);
+}
+
 file_block_t* blockchain_get_latest(file_blockchain_t* chain) {
-    if (!chain || chain->block_count == 0) {
+    uint32_t count = blockchain_block_count(chain);
+    if (count == 0) {
         return NULL;
     }
-    return &chain->blocks[chain->block_count - 1];
+    return &chain->blocks[count - 1];
+}
+
+uint32_t blockchain_block_count(file_blockchain_t* chain) {
+    return chain ? __atomic_load_n(&chain->block_count, __ATOMIC_ACQUIRE) : 0;
 }
 
 int blockchain_recover_file(file_blockchain_t* chain, uint8_t* out_data, uint32_t* out_size) {
@@ -189,10 +423,6 @@ int blockchain_recover_file(file_blockchain_t* chain, uint8_t* out_data, uint32_
         return -1;
     }
     
-    if (chain->block_count == 0) {
-        return -1;
-    }
-    
     file_block_t* latest = blockchain_get_latest(chain);
     if (!latest) {
         return -1;
@@ -240,7 +470,7 @@ static void split_into_shards(const uint8_t* data, uint32_t size, block_shard_t*
 }
 
 int blockchain_add_redundancy(file_blockchain_t* chain, uint32_t block_idx, const uint8_t* file_data, uint32_t file_size) {
-    if (!chain || block_idx >= chain->block_count) {
+    if (!chain || block_idx >= blockchain_block_count(chain)) {
         return -1;
     }
     
@@ -248,9 +478,11 @@ int blockchain_add_redundancy(file_blockchain_t* chain, uint32_t block_idx, cons
         return 0;
     }
     
+    chain_lock(chain);
     file_block_t* block = &chain->blocks[block_idx];
     split_into_shards(file_data, file_size, block->shards);
     block->has_redundancy = 1;
+    chain_unlock(chain);
     
     log_event(LOG_SUCCESS, "Redundancy data added to system block");
     return 0;
@@ -276,9 +508,9 @@ static void compute_inter_block_parity(file_blockchain_t* chain, uint32_t block_
     }
 }
 
-int blockchain_recover_block_from_redundancy(file_blockchain_t* chain, uint32_t block_idx,
-                                            uint32_t complete_block_idx, uint32_t partial_block_idx, uint32_t partial_shard_idx) {
-    if (!chain || block_idx >= chain->block_count || 
+static int recover_locked(file_blockchain_t* chain, uint32_t block_idx,
+                          uint32_t complete_block_idx, uint32_t partial_block_idx, uint32_t partial_shard_idx) {
+    if (block_idx >= chain->block_count || 
         complete_block_idx >= chain->block_count || partial_block_idx >= chain->block_count) {
         return -1;
     }
@@ -334,24 +566,28 @@ int blockchain_recover_block_from_redundancy(file_blockchain_t* chain, uint32_t
     return 0;
 }
 
+/* Repairs rewrite shards of published blocks in place; a verify running
+ * at the same moment may report a mismatch and should simply be rerun. */
+int blockchain_recover_block_from_redundancy(file_blockchain_t* chain, uint32_t block_idx,
+                                            uint32_t complete_block_idx, uint32_t partial_block_idx, uint32_t partial_shard_idx) {
+    if (!chain) {
+        return -1;
+    }
+    chain_lock(chain);
+    int result = recover_locked(chain, block_idx, complete_block_idx, partial_block_idx, partial_shard_idx);
+    chain_unlock(chain);
+    return result;
+}
+
 int blockchain_verify_redundancy(file_blockchain_t* chain, uint32_t block_idx) {
-    if (!chain || block_idx >= chain->block_count) {
+    if (!chain || block_idx >= blockchain_block_count(chain)) {
         return -1;
     }
     
     file_block_t* block = &chain->blocks[block_idx];
-    if (!block->has_redundancy) {
-        return 0;
-    }
-    
-    for (int i = 0; i < BLOCK_SHARDS_PER_BLOCK; ++i) {
-        uint8_t computed_hash[32];
-        sha256(block->shards[i].data, BLOCK_SHARD_SIZE, computed_hash);
-        
-        if (kmemcmp(computed_hash, block->shards[i].shard_hash, 32) != 0) {
-            log_event(LOG_ERROR, "Shard hash mismatch in block");
-            return -1;
-        }
+    if (block->has_redundancy && !shards_intact(block)) {
+        log_event(LOG_ERROR, "Shard hash mismatch in block");
+        return -1;
     }
     
     return 0;
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <stdint.h>
+#include "spinlock.h"
 
 #define BLOCKCHAIN_MAX_BLOCKS 1024
 #define BLOCKCHAIN_MAX_FILES 256
 #define FILE_PATH_MAX 256
 #define BLOCK_SHARD_SIZE 64
 #define BLOCK_SHARDS_PER_BLOCK 2
+#define BLOCKCHAIN_PATH_BUCKETS 64
 
 typedef enum {
     FILE_TYPE_SYSTEM = 0,
@@ -33,18 +35,30 @@ typedef struct {
     uint8_t has_redundancy;
 } file_block_t;
 
-typedef struct {
+// Writers serialize on lock. Blocks below block_count are published with a
+// release store and never move, so readers take an acquire snapshot of
+// block_count without locking; head_seq is a sequence count that lets them
+// read block_count and chain_hash as one consistent pair.
+typedef struct file_blockchain {
     char file_path[FILE_PATH_MAX];
     file_type_t file_type;
     uint32_t block_count;
     file_block_t blocks[BLOCKCHAIN_MAX_BLOCKS];
     uint8_t chain_hash[32];
+    ticketlock_t lock;
+    volatile uint32_t head_seq;
+    struct file_blockchain *hash_next;
 } file_blockchain_t;
 
+// Chains are only ever added, never removed: lookups walk the path hash
+// buckets without a lock while insertions serialize on index_lock and
+// publish each new chain with a release store.
 typedef struct {
     file_blockchain_t system_chain;
-    file_blockchain_t user_files[BLOCKCHAIN_MAX_FILES];
+    file_blockchain_t *user_files[BLOCKCHAIN_MAX_FILES];
     uint32_t user_file_count;
+    file_blockchain_t *buckets[BLOCKCHAIN_PATH_BUCKETS];
+    ticketlock_t index_lock;
 } blockchain_manager_t;
 
 // Initialize blockchain system
@@ -60,9 +74,26 @@ int blockchain_add_block(file_blockchain_t* chain, const uint8_t* file_data,
 // Verify a file's blockchain integrity
 int blockchain_verify(file_blockchain_t* chain);
 
+// Verify the chain and the shard hashes of every redundant block
+int blockchain_verify_all(file_blockchain_t* chain);
+
+// Verify with a callback after each batch of blocks; it may run on any CPU
+typedef void (*blockchain_progress_fn)(void* ctx, uint32_t done, uint32_t total);
+int blockchain_verify_progress(file_blockchain_t* chain, int check_shards,
+                               blockchain_progress_fn progress, void* ctx);
+
 // Get the latest block for a file
 file_block_t* blockchain_get_latest(file_blockchain_t* chain);
 
+// Number of published blocks; safe to call while another CPU appends
+uint32_t blockchain_block_count(file_blockchain_t* chain);
+uint32_t blockchain_chain_count(void);
+uint32_t blockchain_memory_kb(void);
+
+// Verify every chain in the background; returns the number that failed
+int blockchain_scrub(void);
+void blockchain_start_scrubber(void);
+
 // Check if file is a system file
 int blockchain_is_system_file(const char* path);
 
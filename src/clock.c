@@ -0,0 +1,193 @@
+#include "clock.h"
+#include "cpu.h"
+#include "hpet.h"
+#include "rtc.h"
+#include "io.h"
+#include "pit.h"
+#include "console.h"
+#include "common.h"
+
+#define PIT_CH2_DATA 0x42
+#define PIT_CMD 0x43
+#define PIT_GATE_PORT 0x61
+#define PIT_GATE_CH2 0x01
+#define PIT_SPEAKER 0x02
+#define PIT_CH2_OUT 0x20
+#define PIT_CMD_CH2_MODE0 0xB0
+
+#define CALIBRATE_MS 10
+#define CALIBRATE_ROUNDS 3
+#define CLOCK_SHIFT 24
+
+/* ns = (cycles * mult) >> shift. shift 24 keeps mult within 32 bits for
+ * any source faster than ~4 MHz while resolving sub-ppm errors. */
+typedef struct {
+    const char *name;
+    uint64_t (*read)(void);
+    uint32_t khz;
+    uint32_t mult;
+} clocksource_t;
+
+static clocksource_t source;
+static uint64_t base_cycles;
+static uint32_t boot_unix;
+static const char *calibrated_by = "none";
+
+static uint64_t read_tsc(void) {
+    return rdtsc();
+}
+
+static uint64_t read_none(void) {
+    return 0;
+}
+
+/* Gate PIT channel 2 in one-shot mode and time its terminal count with
+ * the TSC; OUT2 is readable on port 0x61 without any interrupt. */
+static uint32_t calibrate_pit(void) {
+    uint32_t latch = PIT_HZ / (1000 / CALIBRATE_MS);
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (uint8_t)((gate & ~PIT_SPEAKER) | PIT_GATE_CH2));
+    outb(PIT_CMD, PIT_CMD_CH2_MODE0);
+    outb(PIT_CH2_DATA, (uint8_t)(latch & 0xFF));
+    outb(PIT_CH2_DATA, (uint8_t)(latch >> 8));
+
+    uint64_t start = rdtsc();
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & PIT_CH2_OUT)) {
+        if (++spins > 50000000u) {
+            outb(PIT_GATE_PORT, gate);
+            return 0;
+        }
+    }
+    uint64_t delta = rdtsc() - start;
+    outb(PIT_GATE_PORT, gate);
+    return (uint32_t)kdiv64(delta * PIT_HZ, latch * 1000u, 0);
+}
+
+static uint32_t calibrate_hpet(void) {
+    uint32_t period = hpet_period_fs();
+    uint32_t ticks = (uint32_t)kdiv64((uint64_t)CALIBRATE_MS * 1000000000000ull, period, 0);
+    uint64_t h0 = hpet_read();
+    uint64_t start = rdtsc();
+    uint64_t h1;
+    uint32_t spins = 0;
+    do {
+        h1 = hpet_read();
+        if (++spins > 50000000u) {
+            return 0;
+        }
+    } while (h1 - h0 < ticks);
+    uint64_t delta = rdtsc() - start;
+    uint32_t elapsed_us = (uint32_t)kdiv64((h1 - h0) * period, 1000000000u, 0);
+    return elapsed_us ? (uint32_t)kdiv64(delta * 1000u, elapsed_us, 0) : 0;
+}
+
+/* An SMI or host preemption inside a round only ever inflates the TSC
+ * delta, so the smallest estimate is the most trustworthy. */
+static uint32_t calibrate_tsc(void) {
+    uint32_t best = 0;
+    for (int round = 0; round < CALIBRATE_ROUNDS; ++round) {
+        uint32_t khz = 0;
+        if (hpet_present() && (khz = calibrate_hpet()) != 0) {
+            calibrated_by = "HPET";
+        } else if ((khz = calibrate_pit()) != 0) {
+            calibrated_by = "PIT";
+        }
+        if (khz && (!best || khz < best)) {
+            best = khz;
+        }
+    }
+    return best;
+}
+
+static void set_source(const char *name, uint64_t (*read)(void), uint32_t khz) {
+    source.name = name;
+    source.read = read;
+    source.khz = khz;
+    source.mult = khz ? (uint32_t)kdiv64((uint64_t)1000000u << CLOCK_SHIFT, khz, 0) : 0;
+    base_cycles = read();
+}
+
+static void log_source(void) {
+    char msg[80];
+    char num[16];
+    kstrncpy(msg, "Clocksource ", sizeof(msg) - 1);
+    kstrcat(msg, source.name, sizeof(msg));
+    kstrcat(msg, " ", sizeof(msg));
+    kitoa((int)(source.khz / 1000), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, ".", sizeof(msg));
+    uint32_t frac = source.khz % 1000;
+    num[0] = (char)('0' + frac / 100);
+    num[1] = (char)('0' + frac / 10 % 10);
+    num[2] = (char)('0' + frac % 10);
+    num[3] = '\0';
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " MHz", sizeof(msg));
+    if (source.read == read_tsc) {
+        kstrcat(msg, " via ", sizeof(msg));
+        kstrcat(msg, calibrated_by, sizeof(msg));
+        if (!cpu_has(CPU_FEAT_INVTSC)) {
+            kstrcat(msg, ", not invariant", sizeof(msg));
+        }
+    }
+    log_text(LOG_SUCCESS, msg);
+}
+
+void clock_init(void) {
+    hpet_init();
+    uint32_t tsc_khz = cpu_has(CPU_FEAT_TSC) ? calibrate_tsc() : 0;
+    if (tsc_khz) {
+        set_source("TSC", read_tsc, tsc_khz);
+    } else if (hpet_present()) {
+        set_source("HPET", hpet_read, (uint32_t)kdiv64(1000000000000ull, hpet_period_fs(), 0));
+    } else {
+        set_source("none", read_none, 0);
+        log_event(LOG_WARN, "Clock: no usable clocksource");
+    }
+    if (source.khz) {
+        log_source();
+    }
+
+    rtc_time_t now;
+    boot_unix = rtc_read(&now) == 0 ? rtc_to_unix(&now) : 0;
+    if (!boot_unix) {
+        log_event(LOG_WARN, "Clock: CMOS RTC unreadable, wall clock starts at epoch");
+    }
+}
+
+const char *clock_source_name(void) {
+    return source.name;
+}
+
+uint32_t clock_source_khz(void) {
+    return source.khz;
+}
+
+uint64_t ktime_cycles(void) {
+    return source.read();
+}
+
+/* Split the 64-bit delta so each partial product fits in 64 bits. */
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+    uint64_t lo = ((uint64_t)(uint32_t)cycles * source.mult) >> CLOCK_SHIFT;
+    uint64_t hi = ((cycles >> 32) * source.mult) << (32 - CLOCK_SHIFT);
+    return hi + lo;
+}
+
+uint64_t ktime_ns(void) {
+    return clock_cycles_to_ns(source.read() - base_cycles);
+}
+
+void ktime_spin_until(uint64_t deadline_ns) {
+    if (!source.khz) {
+        return;
+    }
+    while (ktime_ns() < deadline_ns) {
+        __asm__ volatile("pause");
+    }
+}
+
+uint32_t clock_unix_time(void) {
+    return boot_unix + (uint32_t)kdiv64(ktime_ns(), NSEC_PER_SEC, 0);
+}
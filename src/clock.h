@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+#define NSEC_PER_USEC 1000u
+#define NSEC_PER_MSEC 1000000u
+#define NSEC_PER_SEC 1000000000u
+
+void clock_init(void);
+const char *clock_source_name(void);
+uint32_t clock_source_khz(void);
+uint64_t ktime_cycles(void);
+uint64_t ktime_ns(void);
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+void ktime_spin_until(uint64_t deadline_ns);
+uint32_t clock_unix_time(void);
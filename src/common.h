@@ -5,32 +5,64 @@
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
-static inline void kmemset(void *dst, int value, size_t count) {
-    uint8_t *d = (uint8_t *)dst;
-    while (count--) {
-        *d++ = (uint8_t)value;
+/* Bulk paths live in kmem.c and pick rep movsb/stosb or dword loops from
+ * the CPU features kmem_init found. Sizes known at compile time up to
+ * KMEM_INLINE_MAX are expanded inline instead, which covers the 32-byte
+ * hash copies and compares on every block. */
+#define KMEM_INLINE_MAX 64
+#define KHASH_SIZE 32
+
+typedef uint32_t __attribute__((may_alias, aligned(1))) kmem_u32_t;
+
+void kmem_init(void);
+void kmemcpy_bulk(void *dst, const void *src, size_t count);
+void kmemset_bulk(void *dst, int value, size_t count);
+int kmemcmp_bulk(const void *a, const void *b, size_t count);
+const char *kmem_strategy(void);
+
+static inline __attribute__((always_inline)) void kmemset(void *dst, int value, size_t count) {
+    if (__builtin_constant_p(count) && count <= KMEM_INLINE_MAX) {
+        __builtin_memset(dst, value, count);
+        return;
     }
+    kmemset_bulk(dst, value, count);
 }
 
-static inline void kmemcpy(void *dst, const void *src, size_t count) {
-    uint8_t *d = (uint8_t *)dst;
-    const uint8_t *s = (const uint8_t *)src;
-    while (count--) {
-        *d++ = *s++;
+static inline __attribute__((always_inline)) void kmemcpy(void *dst, const void *src, size_t count) {
+    if (__builtin_constant_p(count) && count <= KMEM_INLINE_MAX) {
+        __builtin_memcpy(dst, src, count);
+        return;
     }
+    kmemcpy_bulk(dst, src, count);
 }
 
-static inline int kmemcmp(const void *a, const void *b, size_t count) {
-    const uint8_t *pa = (const uint8_t *)a;
-    const uint8_t *pb = (const uint8_t *)b;
-    while (count--) {
-        if (*pa != *pb) {
-            return (int)((unsigned char)*pa) - (int)((unsigned char)*pb);
+/* Word compares for fixed multiples of four; the first differing word is
+ * handed to the byte compare so the sign matches the byte loop's. */
+static inline __attribute__((always_inline)) int kmemcmp(const void *a, const void *b, size_t count) {
+    if (__builtin_constant_p(count) && count <= KMEM_INLINE_MAX && count % 4 == 0) {
+        const uint8_t *pa = (const uint8_t *)a;
+        const uint8_t *pb = (const uint8_t *)b;
+        for (size_t i = 0; i < count; i += 4) {
+            if (*(const kmem_u32_t *)(pa + i) != *(const kmem_u32_t *)(pb + i)) {
+                return kmemcmp_bulk(pa + i, pb + i, 4);
+            }
         }
-        pa++;
-        pb++;
+        return 0;
     }
-    return 0;
+    return kmemcmp_bulk(a, b, count);
+}
+
+static inline __attribute__((always_inline)) void khash_copy(uint8_t *dst, const uint8_t *src) {
+    kmemcpy(dst, src, KHASH_SIZE);
+}
+
+/* Branch-free equality for digests: all eight words are folded together. */
+static inline __attribute__((always_inline)) int khash_equal(const uint8_t *a, const uint8_t *b) {
+    uint32_t diff = 0;
+    for (size_t i = 0; i < KHASH_SIZE; i += 4) {
+        diff |= *(const kmem_u32_t *)(a + i) ^ *(const kmem_u32_t *)(b + i);
+    }
+    return diff == 0;
 }
 
 static inline size_t kstrlen(const char *s) {
@@ -119,6 +151,20 @@ static inline void kitoa(int value, char *buf, size_t buf_len) {
     buf[out] = '\0';
 }
 
+/* 64-by-32 division without libgcc: two chained divl instructions, so
+ * the quotient may use all 64 bits. */
+static inline uint64_t kdiv64(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+    __asm__("divl %4" : "=a"(q_lo), "=d"(r) : "a"((uint32_t)n), "d"(r), "rm"(d));
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
 static inline char kupper(char c) {
     if (c >= 'a' && c <= 'z') {
         return c - 32;
@@ -0,0 +1,188 @@
+#include "compositor.h"
+#include "gui.h"
+#include "metrics.h"
+#include "common.h"
+
+/* Panels are retained descriptors: geometry comes from their bounds
+ * callback and pixels are only regenerated for damaged regions. Shadows
+ * spill past the right and bottom edges, hence the padding. Bounds may
+ * change between frames (sysmon grows with the task list), so each panel
+ * remembers the area it last painted and a dirty panel damages that too. */
+#define COMP_MAX_DAMAGE 8
+#define COMP_SHADOW_PAD 12
+
+typedef struct {
+    int z;
+    int dirty;
+    int painted;
+    fb_rect_t drawn;
+    void (*render)(void);
+    void (*bounds)(fb_rect_t *out);
+} comp_panel_t;
+
+static comp_panel_t panels[PANEL_COUNT];
+static panel_id_t z_order[PANEL_COUNT];
+static int panel_count;
+static fb_rect_t damage[COMP_MAX_DAMAGE];
+static int damage_count;
+static fb_rect_t prev_damage[COMP_MAX_DAMAGE];
+static int prev_count;
+static uint32_t desktop;
+
+void comp_init(uint32_t desktop_color) {
+    kmemset(panels, 0, sizeof(panels));
+    panel_count = 0;
+    damage_count = 0;
+    prev_count = 0;
+    desktop = desktop_color;
+}
+
+void comp_add_panel(panel_id_t id, int z, void (*render)(void), void (*bounds)(fb_rect_t *out)) {
+    if ((int)id < 0 || id >= PANEL_COUNT || !render || !bounds || panels[id].render) {
+        return;
+    }
+    panels[id].z = z;
+    panels[id].dirty = 1;
+    panels[id].render = render;
+    panels[id].bounds = bounds;
+
+    int pos = panel_count++;
+    while (pos > 0 && panels[z_order[pos - 1]].z > z) {
+        z_order[pos] = z_order[pos - 1];
+        pos--;
+    }
+    z_order[pos] = id;
+}
+
+void comp_invalidate(panel_id_t id) {
+    if ((int)id >= 0 && id < PANEL_COUNT) {
+        panels[id].dirty = 1;
+        gui_wake();
+    }
+}
+
+static int rect_area(const fb_rect_t *r) {
+    return r->w * r->h;
+}
+
+static fb_rect_t rect_union(const fb_rect_t *a, const fb_rect_t *b) {
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    fb_rect_t out = {x0, y0, x1 - x0, y1 - y0};
+    return out;
+}
+
+static int rect_touches(const fb_rect_t *a, const fb_rect_t *b) {
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+void comp_invalidate_rect(const fb_rect_t *rect) {
+    fb_rect_t screen = {0, 0, fb_width(), fb_height()};
+    fb_rect_t r = *rect;
+    if (!fb_rect_intersect(&r, &screen)) {
+        return;
+    }
+
+    /* Fold overlapping damage together so no pixel is composed twice. */
+    for (int i = 0; i < damage_count;) {
+        if (rect_touches(&r, &damage[i])) {
+            r = rect_union(&r, &damage[i]);
+            damage[i] = damage[--damage_count];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (damage_count < COMP_MAX_DAMAGE) {
+        damage[damage_count++] = r;
+        return;
+    }
+
+    int best = 0;
+    int best_growth = 0x7FFFFFFF;
+    for (int i = 0; i < damage_count; ++i) {
+        fb_rect_t u = rect_union(&r, &damage[i]);
+        int growth = rect_area(&u) - rect_area(&damage[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    r = rect_union(&r, &damage[best]);
+    damage[best] = damage[--damage_count];
+    comp_invalidate_rect(&r);
+}
+
+/* Also used after a mode switch, when every panel's bounds may move. */
+void comp_invalidate_all(void) {
+    fb_rect_t screen = {0, 0, fb_width(), fb_height()};
+    for (int i = 0; i < PANEL_COUNT; ++i) {
+        panels[i].dirty = 0;
+    }
+    damage_count = 0;
+    comp_invalidate_rect(&screen);
+}
+
+int comp_compose(void) {
+    for (int i = 0; i < panel_count; ++i) {
+        comp_panel_t *panel = &panels[z_order[i]];
+        if (!panel->dirty) {
+            continue;
+        }
+        fb_rect_t r;
+        panel->bounds(&r);
+        r.w += COMP_SHADOW_PAD;
+        r.h += COMP_SHADOW_PAD;
+        panel->dirty = 0;
+        if (panel->painted) {
+            comp_invalidate_rect(&panel->drawn);
+            panel->painted = 0;
+        }
+        comp_invalidate_rect(&r);
+    }
+    if (!damage_count) {
+        return 0;
+    }
+
+    /* A flipped-in page last saw the frame before the one on screen, so it
+     * also misses whatever the previous frame repainted. */
+    fb_rect_t frame[COMP_MAX_DAMAGE];
+    int frame_count = damage_count;
+    kmemcpy(frame, damage, sizeof(frame[0]) * (size_t)frame_count);
+    if (fb_buffer_age() > 1) {
+        for (int i = 0; i < prev_count; ++i) {
+            comp_invalidate_rect(&prev_damage[i]);
+        }
+    }
+    kmemcpy(prev_damage, frame, sizeof(frame[0]) * (size_t)frame_count);
+    prev_count = frame_count;
+
+    int regions = damage_count;
+    fb_begin_frame(damage, damage_count);
+    for (int d = 0; d < damage_count; ++d) {
+        fb_rect_t *region = &damage[d];
+        fb_set_clip(region);
+        fb_fillrect(region->x, region->y, region->w, region->h, desktop);
+        for (int i = 0; i < panel_count; ++i) {
+            comp_panel_t *panel = &panels[z_order[i]];
+            fb_rect_t r;
+            panel->bounds(&r);
+            r.w += COMP_SHADOW_PAD;
+            r.h += COMP_SHADOW_PAD;
+            if (fb_rect_intersect(&r, region)) {
+                panel->drawn = panel->painted ? rect_union(&panel->drawn, &r) : r;
+                panel->painted = 1;
+                uint64_t start = metric_now();
+                panel->render();
+                metric_span((metric_span_t)z_order[i], metric_now() - start);
+            }
+        }
+    }
+    fb_reset_clip();
+    fb_present(damage, damage_count);
+    damage_count = 0;
+    return regions;
+}
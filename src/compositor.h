@@ -0,0 +1,21 @@
+#pragma once
+
+#include "fb.h"
+
+typedef enum {
+    PANEL_BAR,
+    PANEL_SYSMON,
+    PANEL_CONSOLE,
+    PANEL_SHELL,
+    PANEL_INSTALLER,
+    PANEL_COUNT
+} panel_id_t;
+
+void comp_init(uint32_t desktop_color);
+void comp_add_panel(panel_id_t id, int z, void (*render)(void), void (*bounds)(fb_rect_t *out));
+/* The only entry point that other tasks may use: it marks the panel and
+ * wakes the GUI task, which does the actual damage tracking. */
+void comp_invalidate(panel_id_t id);
+void comp_invalidate_rect(const fb_rect_t *rect);
+void comp_invalidate_all(void);
+int comp_compose(void);
@@ -1,35 +1,66 @@
 #include "console.h"
 #include "fb.h"
 #include "audio.h"
+#include "compositor.h"
+#include "spinlock.h"
+#include "clock.h"
 #include "common.h"
+#include <stdarg.h>
 
-#define LOG_CAP 48
+/* Binary ring: an insert is one record store at seq % LOG_CAP, with no
+ * string work. Records from log_text point at the text slot that shares
+ * their ring index, so the copy lives exactly as long as the record. */
+#define LOG_CAP 64
+#define LOG_VISIBLE 12
+#define LOG_LINE_MAX 96
+
+/* Only log_noisy records draw from this token bucket, once the clock runs;
+ * everything else, and every error, reaches the ring and so the serial
+ * sink. A burst that exhausts it is summarised by one "suppressed" record
+ * when tokens return. */
+#define LOG_BURST 32
+#define LOG_RATE_PER_SEC 16
 
 typedef struct {
-    log_level_t level;
-    char text[96];
-} log_entry_t;
+    const char *fmt;
+    uint32_t args[LOG_MAX_ARGS];
+    uint8_t level;
+    uint8_t nargs;
+    uint16_t repeat;
+} log_record_t;
 
-static log_entry_t log_buffer[LOG_CAP];
-static int log_count;
+static log_record_t log_ring[LOG_CAP];
+static char log_texts[LOG_CAP][LOG_LINE_MAX];
+static uint32_t log_seq;
+static log_level_t log_min_level = LOG_SUCCESS;
+static uint32_t log_tokens = LOG_BURST;
+static uint64_t log_refill_ns;
+static uint32_t log_dropped;
+static uint32_t log_dropped_total;
 static int console_open_flag;
+static spinlock_t log_lock = SPINLOCK_INIT;
+static const char log_text_fmt[] = "%s";
+static log_sink_kick_t log_sink;
 
 void console_init(void) {
-    log_count = 0;
+    log_seq = 0;
     console_open_flag = 1;
     log_event(LOG_SUCCESS, "Console ready");
 }
 
 void console_open(void) {
     console_open_flag = 1;
+    comp_invalidate(PANEL_CONSOLE);
 }
 
 void console_close(void) {
     console_open_flag = 0;
+    comp_invalidate(PANEL_CONSOLE);
 }
 
 void console_toggle(void) {
     console_open_flag = !console_open_flag;
+    comp_invalidate(PANEL_CONSOLE);
 }
 
 int console_is_open(void) {
@@ -45,20 +76,115 @@ static uint32_t level_color(log_level_t lvl) {
     }
 }
 
-void log_event(log_level_t level, const char *message) {
-    if (!message) {
-        return;
+static int rate_allow(log_level_t level) {
+    if (level >= LOG_ERROR || !clock_source_khz()) {
+        return 1;
+    }
+    uint64_t now = ktime_ns();
+    uint32_t earned = (uint32_t)kdiv64((now - log_refill_ns) * LOG_RATE_PER_SEC, NSEC_PER_SEC, 0);
+    if (earned) {
+        log_tokens = log_tokens + earned > LOG_BURST ? LOG_BURST : log_tokens + earned;
+        log_refill_ns = now;
+    }
+    if (!log_tokens) {
+        ++log_dropped;
+        ++log_dropped_total;
+        return 0;
+    }
+    --log_tokens;
+    return 1;
+}
+
+static log_record_t *push_record(log_level_t level, const char *fmt) {
+    log_record_t *rec = &log_ring[log_seq++ % LOG_CAP];
+    rec->fmt = fmt;
+    rec->level = (uint8_t)level;
+    rec->nargs = 0;
+    rec->repeat = 1;
+    return rec;
+}
+
+/* A record identical to the previous one only bumps its repeat count.
+ * Copied text is compared by content, everything else by its words. */
+static int merge_repeat(log_level_t level, const char *fmt, const uint32_t *args, uint32_t nargs,
+                        const char *text) {
+    if (!log_seq) {
+        return 0;
     }
-    if (log_count >= LOG_CAP) {
-        for (int i = 1; i < LOG_CAP; ++i) {
-            log_buffer[i - 1] = log_buffer[i];
+    log_record_t *last = &log_ring[(log_seq - 1) % LOG_CAP];
+    if (last->fmt != fmt || last->level != level || last->repeat == 0xFFFF) {
+        return 0;
+    }
+    if (text) {
+        if (kstrncmp(log_texts[last - log_ring], text, LOG_LINE_MAX - 1) != 0) {
+            return 0;
+        }
+    } else {
+        if (last->nargs != nargs) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < nargs; ++i) {
+            if (last->args[i] != args[i]) {
+                return 0;
+            }
         }
-        log_count = LOG_CAP - 1;
     }
-    log_buffer[log_count].level = level;
-    kstrncpy(log_buffer[log_count].text, message, sizeof(log_buffer[log_count].text) - 1);
-    log_count++;
+    ++last->repeat;
+    return 1;
+}
 
+/* Returns 1 if a record was added or merged, 0 if it was filtered or rate
+ * limited. Merges play no cue, so a repeating message stays quiet. */
+static int log_append(log_level_t level, const char *fmt, const uint32_t *args, uint32_t nargs,
+                      const char *text, int limited, int *merged) {
+    uint32_t flags = spin_lock_irqsave(&log_lock);
+    *merged = 0;
+    if (level < log_min_level) {
+        spin_unlock_irqrestore(&log_lock, flags);
+        return 0;
+    }
+    if (merge_repeat(level, fmt, args, nargs, text)) {
+        *merged = 1;
+        spin_unlock_irqrestore(&log_lock, flags);
+        return 1;
+    }
+    if (limited && !rate_allow(level)) {
+        spin_unlock_irqrestore(&log_lock, flags);
+        return 0;
+    }
+    if (log_dropped) {
+        log_record_t *note = push_record(LOG_WARN, "%u log messages suppressed");
+        note->args[0] = log_dropped;
+        note->nargs = 1;
+        log_dropped = 0;
+    }
+    log_record_t *rec = push_record(level, fmt);
+    if (text) {
+        char *slot = log_texts[rec - log_ring];
+        kstrncpy(slot, text, LOG_LINE_MAX - 1);
+        slot[LOG_LINE_MAX - 1] = '\0';
+        rec->args[0] = (uint32_t)(uintptr_t)slot;
+        rec->nargs = 1;
+    } else {
+        for (uint32_t i = 0; i < nargs; ++i) {
+            rec->args[i] = args[i];
+        }
+        rec->nargs = (uint8_t)nargs;
+    }
+    spin_unlock_irqrestore(&log_lock, flags);
+    return 1;
+}
+
+static void log_posted(log_level_t level, int merged) {
+    if (console_open_flag) {
+        comp_invalidate(PANEL_CONSOLE);
+    }
+    if (merged) {
+        return;
+    }
+    if (log_sink) {
+        log_sink();
+    }
     switch (level) {
         case LOG_SUCCESS: audio_play(SND_OK); break;
         case LOG_WARN: audio_play(SND_WARN); break;
@@ -67,6 +193,119 @@ void log_event(log_level_t level, const char *message) {
     }
 }
 
+/* Arguments are captured as 32-bit words by walking the format, which is
+ * all the conversions the renderer understands. */
+static void log_vevent(log_level_t level, int limited, const char *fmt, va_list ap) {
+    uint32_t args[LOG_MAX_ARGS];
+    uint32_t nargs = 0;
+    for (const char *p = fmt; *p && nargs < LOG_MAX_ARGS; ++p) {
+        if (p[0] == '%' && p[1]) {
+            ++p;
+            if (*p != '%') {
+                args[nargs++] = va_arg(ap, uint32_t);
+            }
+        }
+    }
+    int merged;
+    if (log_append(level, fmt, args, nargs, NULL, limited, &merged)) {
+        log_posted(level, merged);
+    }
+}
+
+void log_event(log_level_t level, const char *fmt, ...) {
+    if (!fmt) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    log_vevent(level, 0, fmt, ap);
+    va_end(ap);
+}
+
+void log_noisy(log_level_t level, const char *fmt, ...) {
+    if (!fmt) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    log_vevent(level, 1, fmt, ap);
+    va_end(ap);
+}
+
+void log_text(log_level_t level, const char *text) {
+    if (!text) {
+        return;
+    }
+    int merged;
+    if (log_append(level, log_text_fmt, NULL, 0, text, 0, &merged)) {
+        log_posted(level, merged);
+    }
+}
+
+void log_set_level(log_level_t min_level) {
+    log_min_level = min_level;
+}
+
+uint32_t log_suppressed(void) {
+    return log_dropped_total;
+}
+
+static void append_uint(char *out, size_t len, uint32_t value, uint32_t base) {
+    char tmp[12];
+    int i = 0;
+    do {
+        uint32_t digit = value % base;
+        tmp[i++] = (char)(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value && i < (int)sizeof(tmp));
+    size_t at = kstrlen(out);
+    while (i && at + 1 < len) {
+        out[at++] = tmp[--i];
+    }
+    out[at] = '\0';
+}
+
+static void log_format(const log_record_t *rec, char *out, size_t len) {
+    out[0] = '\0';
+    uint32_t arg = 0;
+    size_t at = 0;
+    for (const char *p = rec->fmt; *p && at + 1 < len; ++p) {
+        if (p[0] != '%' || !p[1]) {
+            out[at++] = *p;
+            out[at] = '\0';
+            continue;
+        }
+        ++p;
+        uint32_t value = arg < rec->nargs ? rec->args[arg] : 0;
+        switch (*p) {
+            case 'd':
+                if ((int32_t)value < 0) {
+                    kstrcat(out, "-", len);
+                    value = (uint32_t)-(int32_t)value;
+                }
+                append_uint(out, len, value, 10);
+                ++arg;
+                break;
+            case 'u': append_uint(out, len, value, 10); ++arg; break;
+            case 'x': append_uint(out, len, value, 16); ++arg; break;
+            case 's':
+                kstrcat(out, value ? (const char *)(uintptr_t)value : "(null)", len);
+                ++arg;
+                break;
+            default:
+                out[at] = *p;
+                out[at + 1] = '\0';
+                break;
+        }
+        at = kstrlen(out);
+    }
+    if (rec->repeat > 1) {
+        kstrcat(out, " (x", len);
+        append_uint(out, len, rec->repeat, 10);
+        kstrcat(out, ")", len);
+    }
+}
+
 void console_handle_input(char c) {
     if (!console_open_flag) {
         return;
@@ -76,19 +315,65 @@ void console_handle_input(char c) {
     }
 }
 
+void console_bounds(fb_rect_t *out) {
+    out->x = fb_width() / 2;
+    out->y = 48;
+    out->w = fb_width() / 2 - 16;
+    out->h = fb_height() - 200;
+}
+
+void log_set_sink(log_sink_kick_t kick) {
+    log_sink = kick;
+}
+
+/* Formats the record at *seq and advances it; returns 0 once caught up. A
+ * reader that fell a whole ring behind gets one line saying how much it
+ * missed. */
+int log_read(uint32_t *seq, char *out, size_t len, log_level_t *level) {
+    uint32_t flags = spin_lock_irqsave(&log_lock);
+    if (*seq == log_seq) {
+        spin_unlock_irqrestore(&log_lock, flags);
+        return 0;
+    }
+    if (log_seq - *seq > LOG_CAP) {
+        log_record_t lost = { "%u log records lost", { log_seq - LOG_CAP - *seq }, LOG_WARN, 1, 1 };
+        log_format(&lost, out, len);
+        *level = LOG_WARN;
+        *seq = log_seq - LOG_CAP;
+    } else {
+        const log_record_t *rec = &log_ring[*seq % LOG_CAP];
+        log_format(rec, out, len);
+        *level = (log_level_t)rec->level;
+        ++*seq;
+    }
+    spin_unlock_irqrestore(&log_lock, flags);
+    return 1;
+}
+
 void console_render(void) {
     if (!console_open_flag) {
         return;
     }
-    int h = fb_height();
-    int w = fb_width();
-    fb_fillrect(w / 2, 48, w / 2 - 16, h - 200, 0x00121212);
-    fb_draw_text(w / 2 + 8, 56, "CONSOLE LOG", 0x00FFFFFF, 0);
-    int start = log_count > 12 ? log_count - 12 : 0;
-    int y = 72;
-    for (int i = start; i < log_count; ++i) {
-        uint32_t color = level_color(log_buffer[i].level);
-        fb_draw_text(w / 2 + 8, y, log_buffer[i].text, color, 0);
+    fb_rect_t r;
+    console_bounds(&r);
+    fb_shadow(r.x, r.y, r.w, r.h, 8, 0x60);
+    fb_fillrect_alpha(r.x, r.y, r.w, r.h, 0x00121212, 0xE0);
+    fb_draw_text(r.x + 8, r.y + 8, "CONSOLE LOG", 0x00FFFFFF, 0);
+    /* Only the visible records are formatted, under the lock so a log_text
+     * slot cannot be reused mid-copy. */
+    char lines[LOG_VISIBLE][LOG_LINE_MAX];
+    uint32_t colors[LOG_VISIBLE];
+    uint32_t flags = spin_lock_irqsave(&log_lock);
+    uint32_t shown = log_seq < LOG_VISIBLE ? log_seq : LOG_VISIBLE;
+    for (uint32_t i = 0; i < shown; ++i) {
+        const log_record_t *rec = &log_ring[(log_seq - shown + i) % LOG_CAP];
+        log_format(rec, lines[i], LOG_LINE_MAX);
+        colors[i] = level_color((log_level_t)rec->level);
+    }
+    spin_unlock_irqrestore(&log_lock, flags);
+    int y = r.y + 24;
+    for (uint32_t i = 0; i < shown; ++i) {
+        fb_draw_text(r.x + 8, y, lines[i], colors[i], 0);
         y += 16;
     }
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include "fb.h"
+
 typedef enum {
     LOG_SUCCESS = 1,
     LOG_WARN = 2,
@@ -11,7 +15,28 @@ void console_open(void);
 void console_close(void);
 void console_toggle(void);
 int console_is_open(void);
+void console_bounds(fb_rect_t *out);
 void console_render(void);
 void console_handle_input(char c);
-void log_event(log_level_t level, const char *message);
 
+#define LOG_MAX_ARGS 4
+
+/* log_event stores the format pointer and up to LOG_MAX_ARGS 32-bit
+ * arguments; text is only produced when the console draws the record, so
+ * fmt and any %s argument must have static storage. Supported conversions
+ * are %d %u %x %s and %%. Text built in a local buffer goes through
+ * log_text, which copies it. */
+void log_event(log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_text(log_level_t level, const char *text);
+/* log_event for per-call messages on hot paths: non-error records beyond
+ * a short burst are dropped and counted rather than flooding the ring. */
+void log_noisy(log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_set_level(log_level_t min_level);
+uint32_t log_suppressed(void);
+
+
+/* Secondary outputs pull formatted records by sequence number at their own
+ * pace; kick is called after each new record, outside the log lock. */
+typedef void (*log_sink_kick_t)(void);
+void log_set_sink(log_sink_kick_t kick);
+int log_read(uint32_t *seq, char *out, size_t len, log_level_t *level);
@@ -0,0 +1,195 @@
+#include "cpu.h"
+#include "gdt.h"
+#include "common.h"
+
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR0_TS (1u << 3)
+#define CR0_NE (1u << 5)
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define CR4_OSXSAVE (1u << 18)
+#define FNSAVE_SIZE 108
+#define FXSAVE_SIZE 512
+
+static uint32_t cpu_features;
+static cpu_simd_t simd_level;
+static uint32_t phys_bits;
+static uint32_t xcr0;
+static uint32_t xsave_size;
+static cpu_local_t cpu_locals[CPU_MAX];
+
+_Static_assert(__builtin_offsetof(cpu_local_t, index) == CPU_LOCAL_INDEX, "isr.s/cpu.h offsets");
+_Static_assert(__builtin_offsetof(cpu_local_t, current) == CPU_LOCAL_CURRENT, "cpu.h offsets");
+_Static_assert(__builtin_offsetof(cpu_local_t, release) == 12, "isr.s offsets");
+
+static void detect_features(void) {
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (d & (1u << 0)) cpu_features |= CPU_FEAT_FPU;
+    if (d & (1u << 4)) cpu_features |= CPU_FEAT_TSC;
+    if (d & (1u << 3)) cpu_features |= CPU_FEAT_PSE;
+    if (d & (1u << 6)) cpu_features |= CPU_FEAT_PAE;
+    if (d & (1u << 9)) cpu_features |= CPU_FEAT_APIC;
+    if (d & (1u << 12)) cpu_features |= CPU_FEAT_MTRR;
+    if (d & (1u << 13)) cpu_features |= CPU_FEAT_PGE;
+    if (d & (1u << 16)) cpu_features |= CPU_FEAT_PAT;
+    if (d & (1u << 24)) cpu_features |= CPU_FEAT_FXSR;
+    if (d & (1u << 25)) cpu_features |= CPU_FEAT_SSE;
+    if (d & (1u << 26)) cpu_features |= CPU_FEAT_SSE2;
+    if (c & (1u << 26)) cpu_features |= CPU_FEAT_XSAVE;
+    if (c & (1u << 28)) cpu_features |= CPU_FEAT_AVX;
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &a, &b, &c, &d);
+        if (b & (1u << 5)) cpu_features |= CPU_FEAT_AVX2;
+        if (b & (1u << 9)) cpu_features |= CPU_FEAT_ERMS;
+        if (d & (1u << 4)) cpu_features |= CPU_FEAT_FSRM;
+    }
+
+    phys_bits = cpu_has(CPU_FEAT_PAE) ? 36 : 32;
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    uint32_t max_ext = a;
+    if (max_ext >= 0x80000007) {
+        cpuid(0x80000007, 0, &a, &b, &c, &d);
+        if (d & (1u << 8)) cpu_features |= CPU_FEAT_INVTSC;
+    }
+    if (max_ext >= 0x80000008) {
+        cpuid(0x80000008, 0, &a, &b, &c, &d);
+        phys_bits = a & 0xFF;
+    }
+}
+
+/* x87 with native error reporting; MP makes WAIT honour CR0.TS so lazy
+ * context switching sees every FPU instruction. */
+static void enable_fpu(void) {
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+    __asm__ volatile("fninit");
+}
+
+/* SSE instructions fault with #UD until the OS advertises FXSAVE support,
+ * so turn that on before any SIMD kernel can be selected. */
+static void enable_sse(void) {
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+}
+
+static void write_xcr0(uint32_t value) {
+    __asm__ volatile("xsetbv" : : "c"(0), "a"(value), "d"(0) : "memory");
+}
+
+/* AVX state only exists once XCR0 names it. Enable the components the CPU
+ * supports, then ask CPUID how large the matching XSAVE image is. */
+static void enable_xsave(void) {
+    uint32_t a, b, c, d;
+    cpuid(0xD, 0, &a, &b, &c, &d);
+    uint32_t mask = XCR0_X87 | XCR0_SSE;
+    if (cpu_has(CPU_FEAT_AVX) && (a & XCR0_AVX)) {
+        mask |= XCR0_AVX;
+    }
+    write_cr4(read_cr4() | CR4_OSXSAVE);
+    write_xcr0(mask);
+    cpuid(0xD, 0, &a, &b, &c, &d);
+    if (b > CPU_XSAVE_MAX) {
+        mask = XCR0_X87 | XCR0_SSE;
+        write_xcr0(mask);
+        cpuid(0xD, 0, &a, &b, &c, &d);
+    }
+    xcr0 = mask;
+    xsave_size = b;
+    cpuid(0xD, 1, &a, &b, &c, &d);
+    if (a & 1u) cpu_features |= CPU_FEAT_XSAVEOPT;
+}
+
+void cpu_init(void) {
+    cpu_features = 0;
+    simd_level = CPU_SIMD_NONE;
+    xcr0 = 0;
+    xsave_size = 0;
+    detect_features();
+
+    if (!cpu_has(CPU_FEAT_FPU)) {
+        return;
+    }
+    enable_fpu();
+    xsave_size = FNSAVE_SIZE;
+    if (!cpu_has(CPU_FEAT_FXSR | CPU_FEAT_SSE | CPU_FEAT_SSE2)) {
+        return;
+    }
+    enable_sse();
+    xsave_size = FXSAVE_SIZE;
+    simd_level = CPU_SIMD_SSE2;
+    if (cpu_has(CPU_FEAT_XSAVE)) {
+        enable_xsave();
+    }
+    if (cpu_has(CPU_FEAT_AVX | CPU_FEAT_AVX2) && (xcr0 & XCR0_AVX)) {
+        simd_level = CPU_SIMD_AVX2;
+    }
+}
+
+/* Application processors get the boot CPU's FPU/SSE/AVX setup; features
+ * were detected there and are assumed identical. */
+void cpu_init_ap(void) {
+    if (!cpu_has(CPU_FEAT_FPU)) {
+        return;
+    }
+    enable_fpu();
+    if (simd_level == CPU_SIMD_NONE) {
+        return;
+    }
+    enable_sse();
+    if (xcr0) {
+        write_cr4(read_cr4() | CR4_OSXSAVE);
+        write_xcr0(xcr0);
+    }
+}
+
+/* Points this CPU's %gs at its cpu_local_t; must run right after the GDT
+ * is loaded and before anything calls cpu_current(). */
+void cpu_local_init(uint32_t index, uint32_t apic_id) {
+    cpu_local_t *local = &cpu_locals[index];
+    kmemset(local, 0, sizeof(*local));
+    local->self = local;
+    local->index = index;
+    local->apic_id = apic_id;
+    gdt_set_cpu_local(index, (uint32_t)(uintptr_t)local, sizeof(*local));
+}
+
+cpu_local_t *cpu_local_of(uint32_t index) {
+    return &cpu_locals[index];
+}
+
+/* Zero when XSAVE is not in use; the FPU layer then falls back to FXSAVE. */
+uint32_t cpu_xcr0(void) {
+    return xcr0;
+}
+
+/* Bytes needed to save one FPU context with the enabled save instruction. */
+uint32_t cpu_xsave_size(void) {
+    return xsave_size;
+}
+
+uint32_t cpu_phys_addr_bits(void) {
+    return phys_bits;
+}
+
+int cpu_has(uint32_t features) {
+    return (cpu_features & features) == features;
+}
+
+cpu_simd_t cpu_simd_level(void) {
+    return simd_level;
+}
+
+const char *cpu_simd_name(cpu_simd_t level) {
+    switch (level) {
+        case CPU_SIMD_SSE2: return "SSE2";
+        case CPU_SIMD_AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    CPU_FEAT_TSC = 1u << 0,
+    CPU_FEAT_PSE = 1u << 1,
+    CPU_FEAT_PAE = 1u << 2,
+    CPU_FEAT_APIC = 1u << 3,
+    CPU_FEAT_MTRR = 1u << 4,
+    CPU_FEAT_PAT = 1u << 5,
+    CPU_FEAT_FXSR = 1u << 6,
+    CPU_FEAT_SSE = 1u << 7,
+    CPU_FEAT_SSE2 = 1u << 8,
+    CPU_FEAT_XSAVE = 1u << 9,
+    CPU_FEAT_AVX = 1u << 10,
+    CPU_FEAT_AVX2 = 1u << 11,
+    CPU_FEAT_ERMS = 1u << 12,
+    CPU_FEAT_FSRM = 1u << 13,
+    CPU_FEAT_INVTSC = 1u << 14,
+    CPU_FEAT_PGE = 1u << 15,
+    CPU_FEAT_FPU = 1u << 16,
+    CPU_FEAT_XSAVEOPT = 1u << 17
+} cpu_feature_t;
+
+typedef enum {
+    CPU_SIMD_NONE,
+    CPU_SIMD_SSE2,
+    CPU_SIMD_AVX2
+} cpu_simd_t;
+
+/* Largest XSAVE image the kernel will reserve per context; components that
+ * would not fit are left disabled in XCR0. */
+#define CPU_XSAVE_MAX 1024
+
+#define XCR0_X87 (1u << 0)
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+
+/* Per-CPU tables are sized for CPU_MAX; index 0 is the boot CPU. */
+#define CPU_MAX 8
+
+struct task;
+
+/* Per-CPU block, reached through a %gs segment whose base points at it so
+ * a single instruction reads a field even if the caller migrates. isr.s
+ * hard-codes the offset of release. */
+typedef struct cpu_local {
+    struct cpu_local *self;
+    uint32_t index;
+    struct task *current;
+    volatile uint8_t *release;
+    uint32_t apic_id;
+} cpu_local_t;
+
+#define CPU_LOCAL_INDEX 4
+#define CPU_LOCAL_CURRENT 8
+
+void cpu_init(void);
+uint32_t cpu_phys_addr_bits(void);
+int cpu_has(uint32_t features);
+cpu_simd_t cpu_simd_level(void);
+const char *cpu_simd_name(cpu_simd_t level);
+uint32_t cpu_xcr0(void);
+uint32_t cpu_xsave_size(void);
+void cpu_init_ap(void);
+void cpu_local_init(uint32_t index, uint32_t apic_id);
+cpu_local_t *cpu_local_of(uint32_t index);
+
+/* volatile so the read is never hoisted across a point where the caller
+ * could have been moved to another CPU. */
+static inline uint32_t cpu_current(void) {
+    uint32_t index;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(index) : "i"(CPU_LOCAL_INDEX));
+    return index;
+}
+
+static inline struct task *cpu_current_task(void) {
+    struct task *task;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(task) : "i"(CPU_LOCAL_CURRENT));
+    return task;
+}
+
+static inline void cpu_relax(void) {
+    __asm__ volatile("pause" : : : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+static inline void wbinvd(void) {
+    __asm__ volatile("wbinvd" : : : "memory");
+}
+
+static inline uint32_t cpu_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void cpu_irq_restore(uint32_t flags) {
+    __asm__ volatile("pushl %0; popfl" : : "r"(flags) : "memory", "cc");
+}
+
+static inline void cpu_irq_enable(void) {
+    __asm__ volatile("sti" : : : "memory");
+}
+
+static inline void cpu_irq_disable(void) {
+    __asm__ volatile("cli" : : : "memory");
+}
+
+/* sti only takes effect after the next instruction, so an interrupt that
+ * arrives between the caller's last check and hlt still wakes us. */
+static inline void cpu_idle(void) {
+    __asm__ volatile("sti; hlt" : : : "memory");
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline void clts(void) {
+    __asm__ volatile("clts" : : : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t value;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t value;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t value;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(uint32_t value) {
+    __asm__ volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline void invlpg(uint32_t addr) {
+    __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
@@ -1,5 +1,7 @@
 #include "crypto.h"
 #include "common.h"
+#include "trace.h"
+#include "metrics.h"
 
 static const uint32_t k[64] = {
     0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
@@ -31,6 +33,9 @@ void sha256(const uint8_t *data, uint32_t len, uint8_t out[32]) {
     };
     uint32_t w[64];
     uint32_t processed = 0;
+    TRACE_BEGIN(TRACE_SHA256, len);
+    metric_count(METRIC_HASHES, 1);
+    metric_count(METRIC_HASH_BYTES, len);
 
     while (processed <= len) {
         kmemset(w, 0, sizeof(w));
@@ -101,6 +106,7 @@ void sha256(const uint8_t *data, uint32_t len, uint8_t out[32]) {
         out[i * 4 + 2] = (uint8_t)(h[i] >> 8);
         out[i * 4 + 3] = (uint8_t)(h[i]);
     }
+    TRACE_END(TRACE_SHA256, len);
 }
 
 uint32_t crc32c(const uint8_t *data, uint32_t len) {
@@ -1,8 +1,23 @@
 #include "fb.h"
 #include "font8x16.h"
 #include "multiboot2.h"
+#include "blend.h"
+#include "bga.h"
+#include "memtype.h"
+#include "cpu.h"
+#include "fpu.h"
 #include "common.h"
 
+/* Largest mode the RAM back buffer can shadow when page flipping is not
+ * available; bigger modes draw straight to the visible surface. */
+#define FB_BACK_MAX_PIXELS (1280 * 1024)
+
+typedef enum {
+    FB_PRESENT_DIRECT,
+    FB_PRESENT_COPY,
+    FB_PRESENT_FLIP
+} fb_present_t;
+
 typedef struct {
     uint32_t width;
     uint32_t height;
@@ -10,59 +25,103 @@ typedef struct {
     uint32_t bpp;
     uint8_t *addr;
     uint32_t clear_color;
+    fb_rect_t clip;
+    uint8_t *vram;
+    uint32_t vram_size;
+    uint8_t *front;
+    uint32_t front_pitch;
+    fb_present_t present;
+    int shown_page;
 } fb_state_t;
 
 static fb_state_t fb;
+static uint32_t back_buffer[FB_BACK_MAX_PIXELS];
 
-static uint32_t blend_color(uint32_t src, uint32_t dst, uint8_t alpha) {
-    uint32_t sr = (src >> 16) & 0xFF;
-    uint32_t sg = (src >> 8) & 0xFF;
-    uint32_t sb = src & 0xFF;
-    uint32_t dr = (dst >> 16) & 0xFF;
-    uint32_t dg = (dst >> 8) & 0xFF;
-    uint32_t db = dst & 0xFF;
-    uint32_t rr = (sr * alpha + dr * (255 - alpha)) / 255;
-    uint32_t rg = (sg * alpha + dg * (255 - alpha)) / 255;
-    uint32_t rb = (sb * alpha + db * (255 - alpha)) / 255;
-    return (rr << 16) | (rg << 8) | rb;
-}
+/* Software cursor kept on the visible surface like a hardware sprite:
+ * moving it restores the saved pixels and saves the new spot, so the
+ * scene underneath is never redrawn. */
+#define CURSOR_W 12
+#define CURSOR_H 19
+
+static const char *const cursor_shape[CURSOR_H] = {
+    "X           ",
+    "XX          ",
+    "X.X         ",
+    "X..X        ",
+    "X...X       ",
+    "X....X      ",
+    "X.....X     ",
+    "X......X    ",
+    "X.......X   ",
+    "X........X  ",
+    "X.........X ",
+    "X..........X",
+    "X......XXXXX",
+    "X...X..X    ",
+    "X..XX..X    ",
+    "X.X  X..X   ",
+    "XX   X..X   ",
+    "      X..X  ",
+    "       XX   ",
+};
+
+typedef struct {
+    int x;
+    int y;
+    int enabled;
+    int drawn;
+    fb_rect_t saved_rect;
+    uint8_t *saved_surface;
+    uint32_t saved_pitch;
+    uint32_t saved[CURSOR_W * CURSOR_H];
+} fb_cursor_t;
+
+static fb_cursor_t cursor;
+
+/* Each slot expands every possible glyph row byte into 8 ready-made pixels
+ * for one fg/bg pair, so text rendering is a plain span copy per row. */
+#define GLYPH_CACHE_SLOTS 8
+
+typedef struct {
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t last_use;
+    int valid;
+    uint32_t spans[256][8];
+} glyph_cache_t;
+
+static glyph_cache_t glyph_cache[GLYPH_CACHE_SLOTS];
+static uint32_t glyph_clock;
+static const blend_ops_t *blend;
+
+static void setup_present(void);
+static void restore_under(const fb_cursor_t *c);
+static void cursor_hide(void);
+static void cursor_show(void);
+static int cursor_hits(const fb_rect_t *rects, int count);
 
 void fb_init(void *mb2) {
     kmemset(&fb, 0, sizeof(fb));
+    kmemset(glyph_cache, 0, sizeof(glyph_cache));
+    kmemset(&cursor, 0, sizeof(cursor));
+    glyph_clock = 0;
+    blend = blend_ops_for(cpu_simd_level());
     font8x16_init();
 
     if (!mb2) {
         return;
     }
 
-    mb2_header_t *hdr = (mb2_header_t *)mb2;
-    uint8_t *tag_ptr = (uint8_t *)mb2 + 8;
-    uint8_t *end = (uint8_t *)mb2 + hdr->total_size;
-
-    while (tag_ptr < end) {
-        mb2_tag_t *tag = (mb2_tag_t *)tag_ptr;
-        
-        if (tag->type == 0 && tag->size == 8) {
-            break;
-        }
-        
-        if (tag->type == 8) {
-            mb2_tag_fb_t *fb_tag = (mb2_tag_fb_t *)tag;
-            fb.addr = (uint8_t *)(uintptr_t)fb_tag->addr;
-            fb.width = fb_tag->width;
-            fb.height = fb_tag->height;
-            fb.pitch = fb_tag->pitch;
-            fb.bpp = fb_tag->bpp;
-            break;
-        }
-        
-        if (tag->size == 0 || tag->size < 8) {
-            break;
-        }
-        
-        tag_ptr += (tag->size + 7) & ~7;
+    mb2_tag_fb_t *fb_tag = (mb2_tag_fb_t *)mb2_find_tag(mb2, MB2_TAG_FRAMEBUFFER);
+    if (fb_tag) {
+        fb.addr = (uint8_t *)(uintptr_t)fb_tag->addr;
+        fb.width = fb_tag->width;
+        fb.height = fb_tag->height;
+        fb.pitch = fb_tag->pitch;
+        fb.bpp = fb_tag->bpp;
     }
 
+    int have_lfb = fb.addr != NULL;
     if (!fb.addr) {
         fb.width = 640;
         fb.height = 480;
@@ -71,10 +130,237 @@ void fb_init(void *mb2) {
         fb.addr = (uint8_t *)fallback;
     }
 
+    fb.vram = fb.addr;
+    setup_present();
+    if (have_lfb) {
+        fb.vram_size = bga_vram_bytes();
+        if (fb.vram_size < fb.front_pitch * fb.height) {
+            fb.vram_size = fb.front_pitch * fb.height;
+        }
+        memtype_map_wc((uint32_t)(uintptr_t)fb.vram, fb.vram_size);
+    }
+    fb_reset_clip();
     fb.clear_color = 0x00102030;
     fb_clear(fb.clear_color);
 }
 
+/* Prefer flipping between two VRAM pages on the Bochs/QEMU adapter; else
+ * shadow the screen in RAM and copy damage out; else draw in place. */
+static void setup_present(void) {
+    fb.front = fb.vram;
+    fb.front_pitch = fb.pitch;
+    fb.addr = fb.vram;
+    fb.shown_page = 0;
+
+    if (fb.bpp == 32 && fb.pitch == fb.width * 4 && bga_detect() &&
+        bga_is_active_mode(fb.width, fb.height, 32) &&
+        bga_set_virtual(fb.width, fb.height * 2) >= fb.height * 2) {
+        fb.present = FB_PRESENT_FLIP;
+        fb.addr = fb.vram + fb.height * fb.pitch;
+        return;
+    }
+    if (fb.width * fb.height <= FB_BACK_MAX_PIXELS) {
+        fb.present = FB_PRESENT_COPY;
+        fb.addr = (uint8_t *)back_buffer;
+        fb.pitch = fb.width * 4;
+        return;
+    }
+    fb.present = FB_PRESENT_DIRECT;
+}
+
+int fb_set_mode(int width, int height) {
+    if (width < 320 || height < 200 || width > 1920 || height > 1200 || (width & 7)) {
+        return -1;
+    }
+    if (!bga_detect()) {
+        return -1;
+    }
+    cursor_hide();
+    cursor.drawn = 0;
+    if (bga_set_mode((uint32_t)width, (uint32_t)height, 32) != 0) {
+        bga_set_mode(fb.width, fb.height, 32);
+        setup_present();
+        cursor_show();
+        return -1;
+    }
+    fb.width = (uint32_t)width;
+    fb.height = (uint32_t)height;
+    fb.pitch = fb.width * 4;
+    fb.bpp = 32;
+    setup_present();
+    fb_reset_clip();
+    fb_clear(fb.clear_color);
+    fb_cursor_move(cursor.x, cursor.y);
+    return 0;
+}
+
+/* The next page gets its cursor before it is shown and the old page loses
+ * its cursor once hidden, so flips never show a frame without one. */
+void fb_present(const fb_rect_t *rects, int count) {
+    if (fb.present == FB_PRESENT_FLIP) {
+        int page = 1 - fb.shown_page;
+        fb_cursor_t old = cursor;
+        cursor.drawn = 0;
+        bga_wait_vblank();
+        fb.shown_page = page;
+        cursor_show();
+        bga_set_offset(0, (uint32_t)page * fb.height);
+        fb.addr = fb.vram + (uint32_t)(1 - page) * fb.height * fb.pitch;
+        restore_under(&old);
+        return;
+    }
+    if (fb.present == FB_PRESENT_DIRECT) {
+        cursor_show();
+        return;
+    }
+    int covered = cursor_hits(rects, count);
+    if (covered) {
+        cursor_hide();
+    }
+    fb_rect_t screen = {0, 0, (int)fb.width, (int)fb.height};
+    for (int i = 0; i < count; ++i) {
+        fb_rect_t r = rects[i];
+        if (!fb_rect_intersect(&r, &screen)) {
+            continue;
+        }
+        for (int y = r.y; y < r.y + r.h; ++y) {
+            kmemcpy(fb.front + (uint32_t)y * fb.front_pitch + (uint32_t)r.x * 4,
+                    fb.addr + (uint32_t)y * fb.pitch + (uint32_t)r.x * 4,
+                    (size_t)r.w * 4);
+        }
+    }
+    if (covered) {
+        cursor_show();
+    }
+}
+
+/* Drawing in DIRECT mode lands on the visible surface, so the cursor has
+ * to step aside before the compositor paints underneath it. */
+void fb_begin_frame(const fb_rect_t *rects, int count) {
+    if (fb.present == FB_PRESENT_DIRECT && cursor_hits(rects, count)) {
+        cursor_hide();
+    }
+}
+
+static uint8_t *visible_surface(uint32_t *pitch) {
+    switch (fb.present) {
+        case FB_PRESENT_FLIP:
+            *pitch = fb.pitch;
+            return fb.vram + (uint32_t)fb.shown_page * fb.height * fb.pitch;
+        case FB_PRESENT_COPY:
+            *pitch = fb.front_pitch;
+            return fb.front;
+        default:
+            *pitch = fb.pitch;
+            return fb.addr;
+    }
+}
+
+static int cursor_hits(const fb_rect_t *rects, int count) {
+    if (!cursor.drawn) {
+        return 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        fb_rect_t r = cursor.saved_rect;
+        if (fb_rect_intersect(&r, &rects[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void restore_under(const fb_cursor_t *c) {
+    if (!c->drawn) {
+        return;
+    }
+    const fb_rect_t *r = &c->saved_rect;
+    for (int y = 0; y < r->h; ++y) {
+        kmemcpy(c->saved_surface + (uint32_t)(r->y + y) * c->saved_pitch + (uint32_t)r->x * 4,
+                &c->saved[y * r->w], (size_t)r->w * 4);
+    }
+}
+
+static void cursor_hide(void) {
+    restore_under(&cursor);
+    cursor.drawn = 0;
+}
+
+static void cursor_show(void) {
+    if (!cursor.enabled || cursor.drawn) {
+        return;
+    }
+    uint32_t pitch;
+    uint8_t *surface = visible_surface(&pitch);
+    fb_rect_t r = {cursor.x, cursor.y, CURSOR_W, CURSOR_H};
+    fb_rect_t screen = {0, 0, (int)fb.width, (int)fb.height};
+    if (!fb_rect_intersect(&r, &screen)) {
+        return;
+    }
+    for (int y = 0; y < r.h; ++y) {
+        uint32_t *row = (uint32_t *)(surface + (uint32_t)(r.y + y) * pitch) + r.x;
+        kmemcpy(&cursor.saved[y * r.w], row, (size_t)r.w * 4);
+        const char *shape = cursor_shape[r.y + y - cursor.y] + (r.x - cursor.x);
+        for (int x = 0; x < r.w; ++x) {
+            if (shape[x] == 'X') {
+                row[x] = 0x00000000;
+            } else if (shape[x] == '.') {
+                row[x] = 0x00FFFFFF;
+            }
+        }
+    }
+    cursor.saved_rect = r;
+    cursor.saved_surface = surface;
+    cursor.saved_pitch = pitch;
+    cursor.drawn = 1;
+}
+
+void fb_cursor_enable(int enabled) {
+    if (!enabled) {
+        cursor_hide();
+    }
+    cursor.enabled = enabled;
+    cursor_show();
+}
+
+void fb_cursor_move(int x, int y) {
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x >= (int)fb.width) x = (int)fb.width - 1;
+    if (y >= (int)fb.height) y = (int)fb.height - 1;
+    if (cursor.drawn && x == cursor.x && y == cursor.y) {
+        return;
+    }
+    cursor_hide();
+    cursor.x = x;
+    cursor.y = y;
+    cursor_show();
+}
+
+void fb_cursor_pos(int *x, int *y) {
+    *x = cursor.x;
+    *y = cursor.y;
+}
+
+uint32_t *fb_vram(void) {
+    return fb.vram_size ? (uint32_t *)fb.vram : NULL;
+}
+
+uint32_t fb_vram_size(void) {
+    return fb.vram_size;
+}
+
+int fb_buffer_age(void) {
+    return fb.present == FB_PRESENT_FLIP ? 2 : 1;
+}
+
+const char *fb_present_name(void) {
+    switch (fb.present) {
+        case FB_PRESENT_FLIP: return "page flip";
+        case FB_PRESENT_COPY: return "back buffer";
+        default: return "direct";
+    }
+}
+
 void fb_clear(uint32_t color) {
     fb.clear_color = color;
     for (uint32_t y = 0; y < fb.height; ++y) {
@@ -85,8 +371,55 @@ void fb_clear(uint32_t color) {
     }
 }
 
+void fb_set_clip(const fb_rect_t *rect) {
+    fb_reset_clip();
+    if (!rect) {
+        return;
+    }
+    fb_rect_t r = *rect;
+    if (!fb_rect_intersect(&r, &fb.clip)) {
+        r.w = 0;
+        r.h = 0;
+    }
+    fb.clip = r;
+}
+
+void fb_reset_clip(void) {
+    fb.clip.x = 0;
+    fb.clip.y = 0;
+    fb.clip.w = (int)fb.width;
+    fb.clip.h = (int)fb.height;
+}
+
+int fb_rect_intersect(fb_rect_t *r, const fb_rect_t *with) {
+    int x0 = r->x > with->x ? r->x : with->x;
+    int y0 = r->y > with->y ? r->y : with->y;
+    int x1 = r->x + r->w < with->x + with->w ? r->x + r->w : with->x + with->w;
+    int y1 = r->y + r->h < with->y + with->h ? r->y + r->h : with->y + with->h;
+    if (x1 <= x0 || y1 <= y0) {
+        return 0;
+    }
+    r->x = x0;
+    r->y = y0;
+    r->w = x1 - x0;
+    r->h = y1 - y0;
+    return 1;
+}
+
+static int clip_rect(int *x, int *y, int *w, int *h) {
+    fb_rect_t r = {*x, *y, *w, *h};
+    if (*w <= 0 || *h <= 0 || !fb_rect_intersect(&r, &fb.clip)) {
+        return 0;
+    }
+    *x = r.x;
+    *y = r.y;
+    *w = r.w;
+    *h = r.h;
+    return 1;
+}
+
 void fb_putpx(int x, int y, uint32_t color) {
-    if (x < 0 || y < 0 || (uint32_t)x >= fb.width || (uint32_t)y >= fb.height) {
+    if (x < fb.clip.x || y < fb.clip.y || x >= fb.clip.x + fb.clip.w || y >= fb.clip.y + fb.clip.h) {
         return;
     }
     uint32_t *row = (uint32_t *)(fb.addr + y * fb.pitch);
@@ -94,52 +427,150 @@ void fb_putpx(int x, int y, uint32_t color) {
 }
 
 void fb_fillrect(int x, int y, int w, int h, uint32_t color) {
-    if (w <= 0 || h <= 0) {
+    if (!clip_rect(&x, &y, &w, &h)) {
+        return;
+    }
+    for (int yy = 0; yy < h; ++yy) {
+        uint32_t *row = (uint32_t *)(fb.addr + (uint32_t)(y + yy) * fb.pitch) + x;
+        for (int xx = 0; xx < w; ++xx) {
+            row[xx] = color;
+        }
+    }
+}
+
+void fb_fillrect_alpha(int x, int y, int w, int h, uint32_t color, uint8_t alpha) {
+    if (alpha == 0xFF) {
+        fb_fillrect(x, y, w, h, color);
+        return;
+    }
+    if (alpha == 0 || !clip_rect(&x, &y, &w, &h)) {
+        return;
+    }
+    kernel_fpu_begin();
+    for (int yy = 0; yy < h; ++yy) {
+        uint32_t *row = (uint32_t *)(fb.addr + (uint32_t)(y + yy) * fb.pitch);
+        blend->fill(row + x, color, alpha, w);
+    }
+    kernel_fpu_end();
+}
+
+void fb_blit_argb(int x, int y, const uint32_t *src, int w, int h, int src_stride) {
+    if (!src) {
+        return;
+    }
+    int sx = x;
+    int sy = y;
+    if (!clip_rect(&x, &y, &w, &h)) {
         return;
     }
+    src += (y - sy) * src_stride + (x - sx);
+    kernel_fpu_begin();
     for (int yy = 0; yy < h; ++yy) {
-        int py = y + yy;
-        if (py < 0 || (uint32_t)py >= fb.height) {
+        uint32_t *row = (uint32_t *)(fb.addr + (uint32_t)(y + yy) * fb.pitch);
+        blend->blit(row + x, src + yy * src_stride, w);
+    }
+    kernel_fpu_end();
+}
+
+void fb_shadow(int x, int y, int w, int h, int radius, uint8_t alpha) {
+    if (radius <= 0 || alpha == 0) {
+        return;
+    }
+    uint8_t step = (uint8_t)(alpha / radius ? alpha / radius : 1);
+    for (int i = 0; i < radius; ++i) {
+        int extent = radius - i;
+        fb_fillrect_alpha(x + w, y + radius / 2, extent, h - radius / 2 + extent, 0, step);
+        fb_fillrect_alpha(x + radius / 2, y + h, w - radius / 2, extent, 0, step);
+    }
+}
+
+static glyph_cache_t *glyph_cache_get(uint32_t fg, uint32_t bg) {
+    glyph_cache_t *victim = &glyph_cache[0];
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; ++i) {
+        glyph_cache_t *slot = &glyph_cache[i];
+        if (slot->valid && slot->fg == fg && slot->bg == bg) {
+            slot->last_use = ++glyph_clock;
+            return slot;
+        }
+        if (!victim->valid) {
             continue;
         }
-        uint32_t *row = (uint32_t *)(fb.addr + py * fb.pitch);
-        for (int xx = 0; xx < w; ++xx) {
-            int px = x + xx;
-            if (px < 0 || (uint32_t)px >= fb.width) {
-                continue;
-            }
-            row[px] = color;
+        if (!slot->valid || slot->last_use < victim->last_use) {
+            victim = slot;
+        }
+    }
+
+    victim->fg = fg;
+    victim->bg = bg;
+    victim->valid = 1;
+    victim->last_use = ++glyph_clock;
+    for (int bits = 0; bits < 256; ++bits) {
+        for (int col = 0; col < 8; ++col) {
+            victim->spans[bits][col] = (bits & (0x80 >> col)) ? fg : bg;
         }
     }
+    return victim;
 }
 
-void fb_draw_char(int x, int y, char ch, uint32_t fg, uint32_t bg) {
-    char glyph = kupper(ch);
-    const uint8_t *rows = font8x16[(uint8_t)glyph];
-    for (int row = 0; row < 16; ++row) {
+static void draw_glyph(int x, int y, uint8_t ch, const glyph_cache_t *gc, uint32_t fg, uint32_t bg) {
+    const fb_rect_t *clip = &fb.clip;
+    int col0 = x < clip->x ? clip->x - x : 0;
+    int col1 = clip->x + clip->w - x < 8 ? clip->x + clip->w - x : 8;
+    int row0 = y < clip->y ? clip->y - y : 0;
+    int row1 = clip->y + clip->h - y < 16 ? clip->y + clip->h - y : 16;
+    if (col0 >= col1 || row0 >= row1) {
+        return;
+    }
+
+    const uint8_t *rows = font8x16[ch];
+    uint8_t *line = fb.addr + (uint32_t)(y + row0) * fb.pitch + (uint32_t)x * 4;
+    for (int row = row0; row < row1; ++row, line += fb.pitch) {
+        uint32_t *dst = (uint32_t *)line;
         uint8_t bits = rows[row];
-        for (int col = 0; col < 8; ++col) {
-            uint32_t color = (bits & (1 << (7 - col))) ? fg : bg;
-            if (color == 0xFFFFFFFF) {
-                continue;
+        if (gc) {
+            const uint32_t *span = gc->spans[bits];
+            for (int col = col0; col < col1; ++col) {
+                dst[col] = span[col];
+            }
+            continue;
+        }
+        for (int col = col0; col < col1; ++col) {
+            uint32_t color = (bits & (0x80 >> col)) ? fg : bg;
+            if (color != FB_TRANSPARENT) {
+                dst[col] = color;
             }
-            fb_putpx(x + col, y + row, color);
         }
     }
 }
 
+static glyph_cache_t *glyph_cache_for(uint32_t fg, uint32_t bg) {
+    if (fg == FB_TRANSPARENT || bg == FB_TRANSPARENT) {
+        return NULL;
+    }
+    return glyph_cache_get(fg, bg);
+}
+
+void fb_draw_char(int x, int y, char ch, uint32_t fg, uint32_t bg) {
+    draw_glyph(x, y, (uint8_t)ch, glyph_cache_for(fg, bg), fg, bg);
+}
+
 void fb_draw_text(int x, int y, const char *text, uint32_t fg, uint32_t bg) {
-    int cursor_x = x;
+    const glyph_cache_t *gc = glyph_cache_for(fg, bg);
     int cursor_y = y;
     while (*text) {
+        int visible = cursor_y > fb.clip.y - 16 && cursor_y < fb.clip.y + fb.clip.h;
+        int cursor_x = x;
+        while (*text && *text != '\n') {
+            if (visible && cursor_x > fb.clip.x - 8 && cursor_x < fb.clip.x + fb.clip.w) {
+                draw_glyph(cursor_x, cursor_y, (uint8_t)*text, gc, fg, bg);
+            }
+            cursor_x += 8;
+            text++;
+        }
         if (*text == '\n') {
             cursor_y += 16;
-            cursor_x = x;
-        } else {
-            fb_draw_char(cursor_x, cursor_y, *text, fg, bg);
-            cursor_x += 8;
+            text++;
         }
-        text++;
     }
 }
 
@@ -2,12 +2,37 @@
 
 #include <stdint.h>
 
+#define FB_TRANSPARENT 0xFFFFFFFF
+
+typedef struct {
+    int x;
+    int y;
+    int w;
+    int h;
+} fb_rect_t;
+
 void fb_init(void *mb2);
+int fb_set_mode(int width, int height);
+void fb_begin_frame(const fb_rect_t *rects, int count);
+void fb_present(const fb_rect_t *rects, int count);
+int fb_buffer_age(void);
+uint32_t *fb_vram(void);
+uint32_t fb_vram_size(void);
+const char *fb_present_name(void);
 void fb_clear(uint32_t color);
+void fb_set_clip(const fb_rect_t *rect);
+void fb_reset_clip(void);
+int fb_rect_intersect(fb_rect_t *r, const fb_rect_t *with);
 void fb_putpx(int x, int y, uint32_t color);
 void fb_fillrect(int x, int y, int w, int h, uint32_t color);
+void fb_fillrect_alpha(int x, int y, int w, int h, uint32_t color, uint8_t alpha);
+void fb_blit_argb(int x, int y, const uint32_t *src, int w, int h, int src_stride);
+void fb_shadow(int x, int y, int w, int h, int radius, uint8_t alpha);
 void fb_draw_char(int x, int y, char ch, uint32_t fg, uint32_t bg);
 void fb_draw_text(int x, int y, const char *text, uint32_t fg, uint32_t bg);
+void fb_cursor_enable(int enabled);
+void fb_cursor_move(int x, int y);
+void fb_cursor_pos(int *x, int *y);
 int fb_width(void);
 int fb_height(void);
 
@@ -0,0 +1,254 @@
+#include "fiber.h"
+#include "sched.h"
+#include "slab.h"
+#include "console.h"
+#include "common.h"
+
+/* Cooperative fibers multiplexed on one kernel task, fiberd. A fiber that
+ * yields or blocks switches straight to the next ready fiber; only when
+ * none is ready does control go back to fiberd, which sleeps on its event
+ * until a wakeup arrives. Wakeups may come from any context, so the ready
+ * queue is the one piece of shared state and has its own lock. */
+#define FIBER_HOST_PRIO SCHED_PRIO_NORMAL
+
+void fiber_switch(uint32_t *save_sp, uint32_t next_sp);
+
+static kmem_cache_t *fiber_cache;
+static task_t *host_task;
+static uint32_t host_sp;
+static sched_event_t host_event;
+static fiber_t *current;
+static fiber_t *dead;
+static spinlock_t ready_lock = SPINLOCK_INIT;
+static fiber_t *ready_head;
+static fiber_t *ready_tail;
+static fiber_stats_t stats;
+static uint32_t next_id;
+
+static void ready_push_locked(fiber_t *fiber) {
+    fiber->state = FIBER_READY;
+    fiber->next = NULL;
+    if (ready_tail) {
+        ready_tail->next = fiber;
+    } else {
+        ready_head = fiber;
+    }
+    ready_tail = fiber;
+}
+
+static fiber_t *ready_pop_locked(void) {
+    fiber_t *fiber = ready_head;
+    if (fiber) {
+        ready_head = fiber->next;
+        if (!ready_head) {
+            ready_tail = NULL;
+        }
+        fiber->state = FIBER_RUNNING;
+    }
+    return fiber;
+}
+
+/* Moves a waiting fiber to the ready queue; a no-op for any other state,
+ * so a wakeup that races with the fiber's own resumption is harmless. */
+static void fiber_wake(fiber_t *fiber) {
+    uint32_t flags = spin_lock_irqsave(&ready_lock);
+    int woke = fiber->state == FIBER_WAITING;
+    if (woke) {
+        ready_push_locked(fiber);
+    }
+    spin_unlock_irqrestore(&ready_lock, flags);
+    if (woke) {
+        sched_event_signal(&host_event);
+    }
+}
+
+static void check_stack(fiber_t *fiber) {
+    if (fiber->magic != FIBER_MAGIC) {
+        log_event(LOG_ERROR, "Fiber stack overflow");
+        fiber->magic = FIBER_MAGIC;
+    }
+}
+
+/* Leaves self (already queued, waiting or dead) for the next ready fiber,
+ * or for fiberd when there is none. Returns once self is resumed. */
+static void reschedule(fiber_t *self) {
+    check_stack(self);
+    uint32_t flags = spin_lock_irqsave(&ready_lock);
+    fiber_t *next = ready_pop_locked();
+    spin_unlock_irqrestore(&ready_lock, flags);
+    if (next == self) {
+        return;
+    }
+    ++stats.switches;
+    current = next;
+    fiber_switch(&self->sp, next ? next->sp : host_sp);
+}
+
+static void fiber_entry(void) {
+    fiber_t *self = current;
+    self->fn(self->arg);
+    fiber_exit();
+}
+
+/* fiberd: runs ready fibers and frees the dead ones once it is off their
+ * stacks. */
+static void host_loop(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&ready_lock);
+        fiber_t *fiber = ready_pop_locked();
+        spin_unlock_irqrestore(&ready_lock, flags);
+        if (!fiber) {
+            sched_event_wait(&host_event);
+            continue;
+        }
+        ++stats.switches;
+        current = fiber;
+        fiber_switch(&host_sp, fiber->sp);
+        current = NULL;
+        if (dead) {
+            kmem_cache_free(fiber_cache, dead);
+            dead = NULL;
+            __atomic_sub_fetch(&stats.live, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void fiber_init(void) {
+    kmemset(&stats, 0, sizeof(stats));
+    sched_event_init(&host_event);
+    fiber_cache = kmem_cache_create("fiber", FIBER_STACK_SIZE);
+    host_task = fiber_cache ? task_spawn("fiberd", host_loop, NULL, FIBER_HOST_PRIO) : NULL;
+    if (!host_task) {
+        log_event(LOG_ERROR, "Fibers: could not start fiberd");
+        return;
+    }
+    host_task->flags |= TASK_FLAG_SYSTEM;
+}
+
+/* The new stack holds the four registers fiber_switch pops, its return
+ * address and a dummy caller return address, placed so fiber_entry starts
+ * with the stack alignment of an ordinary call. */
+fiber_t *fiber_spawn(fiber_fn_t fn, void *arg) {
+    if (!host_task || !fn) {
+        return NULL;
+    }
+    fiber_t *fiber = kmem_cache_alloc(fiber_cache);
+    if (!fiber) {
+        return NULL;
+    }
+    uint32_t *top = (uint32_t *)((uint8_t *)fiber + FIBER_STACK_SIZE);
+    top[-1] = 0;
+    top[-2] = (uint32_t)(uintptr_t)fiber_entry;
+    for (int i = 3; i <= 6; ++i) {
+        top[-i] = 0;
+    }
+    fiber->sp = (uint32_t)(uintptr_t)&top[-6];
+    fiber->fn = fn;
+    fiber->arg = arg;
+    fiber->magic = FIBER_MAGIC;
+    fiber->id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.live, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.spawned, 1, __ATOMIC_RELAXED);
+
+    uint32_t flags = spin_lock_irqsave(&ready_lock);
+    ready_push_locked(fiber);
+    spin_unlock_irqrestore(&ready_lock, flags);
+    sched_event_signal(&host_event);
+    return fiber;
+}
+
+/* NULL unless called from a fiber. */
+fiber_t *fiber_current(void) {
+    return host_task && task_current() == host_task ? current : NULL;
+}
+
+void fiber_yield(void) {
+    fiber_t *self = fiber_current();
+    if (!self) {
+        sched_yield();
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&ready_lock);
+    ready_push_locked(self);
+    spin_unlock_irqrestore(&ready_lock, flags);
+    reschedule(self);
+}
+
+/* The stack is freed by fiberd, so the exit always goes through it. */
+void fiber_exit(void) {
+    fiber_t *self = fiber_current();
+    if (!self) {
+        task_exit();
+    }
+    check_stack(self);
+    self->state = FIBER_DEAD;
+    dead = self;
+    ++stats.switches;
+    fiber_switch(&self->sp, host_sp);
+    __builtin_unreachable();
+}
+
+void fiber_completion_init(fiber_completion_t *c) {
+    c->lock = (spinlock_t)SPINLOCK_INIT;
+    c->done = 0;
+    c->result = 0;
+    c->waiter = NULL;
+}
+
+void fiber_complete(fiber_completion_t *c, int result) {
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+    c->result = result;
+    c->done = 1;
+    fiber_t *waiter = c->waiter;
+    c->waiter = NULL;
+    spin_unlock_irqrestore(&c->lock, flags);
+    if (waiter) {
+        fiber_wake(waiter);
+    }
+}
+
+/* The fiber is marked waiting under the completion's lock, so a completion
+ * from elsewhere either sees the waiter or is seen by the loop. Outside a
+ * fiber this falls back to polling with sched_yield. */
+int fiber_await(fiber_completion_t *c) {
+    fiber_t *self = fiber_current();
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+    while (!c->done) {
+        if (self) {
+            c->waiter = self;
+            self->state = FIBER_WAITING;
+        }
+        spin_unlock_irqrestore(&c->lock, flags);
+        if (self) {
+            reschedule(self);
+        } else {
+            sched_yield();
+        }
+        flags = spin_lock_irqsave(&c->lock);
+    }
+    int result = c->result;
+    spin_unlock_irqrestore(&c->lock, flags);
+    return result;
+}
+
+static void sleep_expired(void *arg) {
+    fiber_complete((fiber_completion_t *)arg, 0);
+}
+
+void fiber_sleep_ns(uint64_t ns) {
+    if (!fiber_current()) {
+        sched_sleep_ns(ns);
+        return;
+    }
+    fiber_completion_t done;
+    ktimer_t timer;
+    fiber_completion_init(&done);
+    timer_setup(&timer, sleep_expired, &done);
+    timer_arm_in(&timer, ns);
+    fiber_await(&done);
+}
+
+void fiber_get_stats(fiber_stats_t *out) {
+    *out = stats;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include "spinlock.h"
+#include "timer.h"
+
+/* Fiber control block and stack share one pooled object; the stack grows
+ * down towards the control block, whose last word is a canary. */
+#define FIBER_STACK_SIZE 4096
+#define FIBER_MAGIC 0xF1BE5AFEu
+
+typedef void (*fiber_fn_t)(void *arg);
+
+typedef enum {
+    FIBER_READY,
+    FIBER_RUNNING,
+    FIBER_WAITING,
+    FIBER_DEAD
+} fiber_state_t;
+
+typedef struct fiber {
+    uint32_t sp;
+    struct fiber *next;
+    fiber_fn_t fn;
+    void *arg;
+    uint32_t id;
+    volatile uint8_t state;
+    uint32_t magic;
+} fiber_t;
+
+/* One-shot completion a fiber can await; completing it is safe from
+ * interrupt handlers, timer callbacks and other CPUs. */
+typedef struct {
+    spinlock_t lock;
+    volatile uint32_t done;
+    int result;
+    fiber_t *waiter;
+} fiber_completion_t;
+
+typedef struct {
+    uint32_t live;
+    uint32_t spawned;
+    uint64_t switches;
+} fiber_stats_t;
+
+void fiber_init(void);
+fiber_t *fiber_spawn(fiber_fn_t fn, void *arg);
+fiber_t *fiber_current(void);
+void fiber_yield(void);
+void fiber_exit(void) __attribute__((noreturn));
+void fiber_sleep_ns(uint64_t ns);
+
+void fiber_completion_init(fiber_completion_t *c);
+void fiber_complete(fiber_completion_t *c, int result);
+int fiber_await(fiber_completion_t *c);
+
+void fiber_get_stats(fiber_stats_t *out);
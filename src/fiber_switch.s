@@ -0,0 +1,26 @@
+/* void fiber_switch(uint32_t *save_sp, uint32_t next_sp)
+ *
+ * Saves the cdecl callee-saved registers on the current stack, stores the
+ * stack pointer through save_sp and resumes whatever context next_sp was
+ * saved from. Caller-saved registers, flags and FPU state are left to the
+ * compiler and the owning kernel task. A new fiber's stack is seeded with
+ * the same four registers and a return address, so its first switch-in
+ * "returns" into its entry function. */
+    .section .text
+    .global fiber_switch
+fiber_switch:
+    movl 4(%esp), %eax
+    movl 8(%esp), %edx
+    pushl %ebp
+    pushl %ebx
+    pushl %esi
+    pushl %edi
+    movl %esp, (%eax)
+    movl %edx, %esp
+    popl %edi
+    popl %esi
+    popl %ebx
+    popl %ebp
+    ret
+
+    .section .note.GNU-stack, "", @progbits
@@ -48,6 +48,32 @@ static const glyph_def_t glyphs[] = {
     {'X', ROWS8(0x42,0x24,0x18,0x18,0x18,0x24,0x42,0x00)},
     {'Y', ROWS8(0x42,0x24,0x24,0x18,0x18,0x18,0x18,0x00)},
     {'Z', ROWS8(0x7E,0x06,0x0C,0x18,0x30,0x60,0x7E,0x00)},
+    {'a', ROWS8(0x00,0x00,0x3C,0x02,0x3E,0x42,0x3E,0x00)},
+    {'b', ROWS8(0x40,0x40,0x7C,0x42,0x42,0x42,0x7C,0x00)},
+    {'c', ROWS8(0x00,0x00,0x3C,0x40,0x40,0x40,0x3C,0x00)},
+    {'d', ROWS8(0x02,0x02,0x3E,0x42,0x42,0x42,0x3E,0x00)},
+    {'e', ROWS8(0x00,0x00,0x3C,0x42,0x7E,0x40,0x3C,0x00)},
+    {'f', ROWS8(0x0C,0x10,0x3C,0x10,0x10,0x10,0x10,0x00)},
+    {'g', ROWS8(0x00,0x00,0x3E,0x42,0x42,0x3E,0x02,0x3C)},
+    {'h', ROWS8(0x40,0x40,0x7C,0x42,0x42,0x42,0x42,0x00)},
+    {'i', ROWS8(0x08,0x00,0x18,0x08,0x08,0x08,0x1C,0x00)},
+    {'j', ROWS8(0x04,0x00,0x0C,0x04,0x04,0x04,0x44,0x38)},
+    {'k', ROWS8(0x40,0x40,0x44,0x48,0x70,0x48,0x44,0x00)},
+    {'l', ROWS8(0x18,0x08,0x08,0x08,0x08,0x08,0x1C,0x00)},
+    {'m', ROWS8(0x00,0x00,0x76,0x49,0x49,0x49,0x49,0x00)},
+    {'n', ROWS8(0x00,0x00,0x7C,0x42,0x42,0x42,0x42,0x00)},
+    {'o', ROWS8(0x00,0x00,0x3C,0x42,0x42,0x42,0x3C,0x00)},
+    {'p', ROWS8(0x00,0x00,0x7C,0x42,0x42,0x7C,0x40,0x40)},
+    {'q', ROWS8(0x00,0x00,0x3E,0x42,0x42,0x3E,0x02,0x02)},
+    {'r', ROWS8(0x00,0x00,0x5C,0x62,0x40,0x40,0x40,0x00)},
+    {'s', ROWS8(0x00,0x00,0x3E,0x40,0x3C,0x02,0x7C,0x00)},
+    {'t', ROWS8(0x10,0x10,0x3C,0x10,0x10,0x10,0x0C,0x00)},
+    {'u', ROWS8(0x00,0x00,0x42,0x42,0x42,0x42,0x3E,0x00)},
+    {'v', ROWS8(0x00,0x00,0x42,0x42,0x42,0x24,0x18,0x00)},
+    {'w', ROWS8(0x00,0x00,0x41,0x49,0x49,0x49,0x36,0x00)},
+    {'x', ROWS8(0x00,0x00,0x42,0x24,0x18,0x24,0x42,0x00)},
+    {'y', ROWS8(0x00,0x00,0x42,0x42,0x42,0x3E,0x02,0x3C)},
+    {'z', ROWS8(0x00,0x00,0x7E,0x04,0x18,0x20,0x7E,0x00)},
     {'-', ROWS8(0x00,0x00,0x00,0x7E,0x00,0x00,0x00,0x00)},
     {'.', ROWS8(0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x00)},
     {',', ROWS8(0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x30)},
@@ -0,0 +1,238 @@
+#include "fpu.h"
+#include "idt.h"
+#include "sched.h"
+#include "console.h"
+#include "common.h"
+
+/* Lazy FPU switching: the registers stay with whichever context last used
+ * them (the owner) and CR0.TS is set whenever a different context runs.
+ * Its first FPU/SSE/AVX instruction raises #NM, which saves the owner and
+ * loads the newcomer, so contexts that never use vector registers never
+ * pay for a save or restore. */
+#define NM_VECTOR 7
+#define CR0_TS (1u << 3)
+#define MXCSR_DEFAULT 0x1F80u
+#define XSAVE_MXCSR_OFFSET 24
+
+typedef enum {
+    FPU_SAVE_NONE,
+    FPU_SAVE_FNSAVE,
+    FPU_SAVE_FXSAVE,
+    FPU_SAVE_XSAVE,
+    FPU_SAVE_XSAVEOPT
+} fpu_save_t;
+
+typedef struct {
+    fpu_state_t *owner;
+    fpu_state_t *current;
+    uint32_t depth;
+} fpu_cpu_t;
+
+static fpu_save_t save_kind;
+static uint32_t xsave_mask;
+static fpu_cpu_t fpu_cpus[CPU_MAX];
+static fpu_state_t boot_state;
+/* XSTATE_BV of zero makes XRSTOR load every component's init state. */
+static uint8_t init_image[CPU_XSAVE_MAX] __attribute__((aligned(64)));
+static fpu_stats_t stats;
+
+static void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static void fpu_save(fpu_state_t *state) {
+    switch (save_kind) {
+        case FPU_SAVE_XSAVEOPT:
+            __asm__ volatile("xsaveopt (%0)" : : "r"(state->area), "a"(xsave_mask), "d"(0) : "memory");
+            break;
+        case FPU_SAVE_XSAVE:
+            __asm__ volatile("xsave (%0)" : : "r"(state->area), "a"(xsave_mask), "d"(0) : "memory");
+            break;
+        case FPU_SAVE_FXSAVE:
+            __asm__ volatile("fxsave (%0)" : : "r"(state->area) : "memory");
+            break;
+        case FPU_SAVE_FNSAVE:
+            __asm__ volatile("fnsave (%0)" : : "r"(state->area) : "memory");
+            break;
+        default:
+            return;
+    }
+    ++stats.saves;
+}
+
+static void fpu_restore(fpu_state_t *state) {
+    switch (save_kind) {
+        case FPU_SAVE_XSAVEOPT:
+        case FPU_SAVE_XSAVE:
+            __asm__ volatile("xrstor (%0)" : : "r"(state->area), "a"(xsave_mask), "d"(0) : "memory");
+            break;
+        case FPU_SAVE_FXSAVE:
+            __asm__ volatile("fxrstor (%0)" : : "r"(state->area) : "memory");
+            break;
+        case FPU_SAVE_FNSAVE:
+            __asm__ volatile("frstor (%0)" : : "r"(state->area) : "memory");
+            break;
+        default:
+            return;
+    }
+    ++stats.restores;
+}
+
+static void fpu_load_init(void) {
+    if (save_kind >= FPU_SAVE_XSAVE) {
+        __asm__ volatile("xrstor (%0)" : : "r"(init_image), "a"(xsave_mask), "d"(0) : "memory");
+        return;
+    }
+    __asm__ volatile("fninit");
+    if (save_kind == FPU_SAVE_FXSAVE) {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        __asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+static void fpu_activate(fpu_state_t *state) {
+    if (state->used) {
+        fpu_restore(state);
+    } else {
+        fpu_load_init();
+        state->used = 1;
+    }
+}
+
+static void nm_handler(isr_frame_t *frame) {
+    (void)frame;
+    fpu_cpu_t *cpu = &fpu_cpus[cpu_current()];
+    clts();
+    ++stats.traps;
+    if (cpu->depth || cpu->owner == cpu->current) {
+        return;
+    }
+    if (cpu->owner) {
+        fpu_save(cpu->owner);
+    }
+    fpu_activate(cpu->current);
+    cpu->owner = cpu->current;
+}
+
+void fpu_init(void) {
+    kmemset(fpu_cpus, 0, sizeof(fpu_cpus));
+    kmemset(&stats, 0, sizeof(stats));
+    xsave_mask = cpu_xcr0();
+    if (xsave_mask) {
+        save_kind = cpu_has(CPU_FEAT_XSAVEOPT) ? FPU_SAVE_XSAVEOPT : FPU_SAVE_XSAVE;
+    } else if (cpu_xsave_size() >= 512) {
+        save_kind = FPU_SAVE_FXSAVE;
+    } else if (cpu_has(CPU_FEAT_FPU)) {
+        save_kind = FPU_SAVE_FNSAVE;
+    } else {
+        save_kind = FPU_SAVE_NONE;
+        return;
+    }
+    kmemset(init_image, 0, sizeof(init_image));
+    *(uint32_t *)(init_image + XSAVE_MXCSR_OFFSET) = MXCSR_DEFAULT;
+
+    fpu_state_init(&boot_state);
+    fpu_cpus[cpu_current()].current = &boot_state;
+    idt_set_handler(NM_VECTOR, nm_handler);
+    stts();
+
+    char msg[64];
+    char num[16];
+    kstrncpy(msg, "FPU: lazy ", sizeof(msg) - 1);
+    kstrcat(msg, fpu_save_name(), sizeof(msg));
+    kstrcat(msg, ", ", sizeof(msg));
+    kitoa((int)cpu_xsave_size(), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " B per context", sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+}
+
+const char *fpu_save_name(void) {
+    switch (save_kind) {
+        case FPU_SAVE_XSAVEOPT: return "XSAVEOPT";
+        case FPU_SAVE_XSAVE: return "XSAVE";
+        case FPU_SAVE_FXSAVE: return "FXSAVE";
+        case FPU_SAVE_FNSAVE: return "FNSAVE";
+        default: return "none";
+    }
+}
+
+void fpu_state_init(fpu_state_t *state) {
+    state->used = 0;
+}
+
+fpu_state_t *fpu_current(void) {
+    return fpu_cpus[cpu_current()].current;
+}
+
+/* Called by the scheduler with interrupts off. Nothing is saved here: the
+ * outgoing context keeps ownership until someone else faults the FPU in. */
+void fpu_switch(fpu_state_t *next) {
+    if (save_kind == FPU_SAVE_NONE) {
+        return;
+    }
+    fpu_cpu_t *cpu = &fpu_cpus[cpu_current()];
+    cpu->current = next;
+    if (next == cpu->owner && !cpu->depth) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+/* Lazy ownership cannot follow a context to another CPU, so the scheduler
+ * calls this with interrupts off when switching away from a context that
+ * may migrate: if its registers are still live here they are saved now. */
+void fpu_release(fpu_state_t *state) {
+    fpu_cpu_t *cpu = &fpu_cpus[cpu_current()];
+    if (save_kind == FPU_SAVE_NONE || cpu->owner != state || cpu->depth) {
+        return;
+    }
+    clts();
+    fpu_save(state);
+    cpu->owner = NULL;
+    stts();
+}
+
+/* The interrupted context's live registers are saved first, so the section
+ * may clobber anything; TS goes back on at the end so that context faults
+ * its state back in on its next FPU instruction. */
+void kernel_fpu_begin(void) {
+    if (save_kind == FPU_SAVE_NONE) {
+        return;
+    }
+    sched_preempt_disable();
+    uint32_t flags = cpu_irq_save();
+    fpu_cpu_t *cpu = &fpu_cpus[cpu_current()];
+    if (cpu->depth++ == 0) {
+        clts();
+        if (cpu->owner) {
+            fpu_save(cpu->owner);
+            cpu->owner = NULL;
+        }
+        fpu_load_init();
+        ++stats.kernel_sections;
+    }
+    cpu_irq_restore(flags);
+}
+
+void kernel_fpu_end(void) {
+    if (save_kind == FPU_SAVE_NONE) {
+        return;
+    }
+    uint32_t flags = cpu_irq_save();
+    fpu_cpu_t *cpu = &fpu_cpus[cpu_current()];
+    if (cpu->depth && --cpu->depth == 0) {
+        stts();
+    }
+    cpu_irq_restore(flags);
+    sched_preempt_enable();
+}
+
+int kernel_fpu_active(void) {
+    return fpu_cpus[cpu_current()].depth != 0;
+}
+
+void fpu_get_stats(fpu_stats_t *out) {
+    *out = stats;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include "cpu.h"
+
+/* One saved register image. Contexts start out unused and get a clean
+ * FPU/SSE/AVX state the first time they touch a vector register. */
+typedef struct {
+    uint8_t area[CPU_XSAVE_MAX] __attribute__((aligned(64)));
+    uint32_t used;
+} fpu_state_t;
+
+typedef struct {
+    uint32_t traps;
+    uint32_t saves;
+    uint32_t restores;
+    uint32_t kernel_sections;
+} fpu_stats_t;
+
+void fpu_init(void);
+const char *fpu_save_name(void);
+void fpu_state_init(fpu_state_t *state);
+void fpu_switch(fpu_state_t *next);
+void fpu_release(fpu_state_t *state);
+fpu_state_t *fpu_current(void);
+
+/* Brackets kernel code that uses SSE/AVX. Sections nest, disable
+ * preemption, must not be entered from interrupt handlers and must not
+ * sleep. */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+int kernel_fpu_active(void);
+void fpu_get_stats(fpu_stats_t *out);
@@ -1,6 +1,8 @@
 #include "fs.h"
 #include "console.h"
 #include "blockchain.h"
+#include "trace.h"
+#include <stddef.h>
 
 int fs_init(void) {
     blockchain_init();
@@ -10,55 +12,57 @@ int fs_init(void) {
 
 int fs_create_file(const char* path, const uint8_t* data, uint32_t size) {
     if (!path) return -1;
+    TRACE_BEGIN(TRACE_FS_CREATE, size);
     
     file_type_t type = blockchain_is_system_file(path) ? FILE_TYPE_SYSTEM : FILE_TYPE_USER;
     file_blockchain_t* chain = blockchain_get_file(path, type);
     
     if (!chain) {
         log_event(LOG_ERROR, "Failed to get blockchain for file");
+        TRACE_END(TRACE_FS_CREATE, size);
         return -1;
     }
     
     if (blockchain_add_block(chain, data, size, 0) != 0) {
         log_event(LOG_ERROR, "Failed to add create block");
+        TRACE_END(TRACE_FS_CREATE, size);
         return -1;
     }
     
-    if (type == FILE_TYPE_SYSTEM && chain->block_count > 0) {
-        uint32_t block_idx = chain->block_count - 1;
-        blockchain_add_redundancy(chain, block_idx, data, size);
-    }
-    
-    log_event(LOG_SUCCESS, "File created with blockchain entry");
+    log_noisy(LOG_SUCCESS, "File created with blockchain entry");
+    TRACE_END(TRACE_FS_CREATE, size);
     return 0;
 }
 
 int fs_modify_file(const char* path, const uint8_t* data, uint32_t size) {
     if (!path) return -1;
+    TRACE_BEGIN(TRACE_FS_MODIFY, size);
     
     file_type_t type = blockchain_is_system_file(path) ? FILE_TYPE_SYSTEM : FILE_TYPE_USER;
     file_blockchain_t* chain = blockchain_get_file(path, type);
     
     if (!chain) {
         log_event(LOG_ERROR, "File not found in blockchain");
+        TRACE_END(TRACE_FS_MODIFY, size);
         return -1;
     }
     
     if (blockchain_add_block(chain, data, size, 1) != 0) {
         log_event(LOG_ERROR, "Failed to add modify block");
+        TRACE_END(TRACE_FS_MODIFY, size);
         return -1;
     }
     
-    if (type == FILE_TYPE_SYSTEM && chain->block_count > 0) {
-        uint32_t block_idx = chain->block_count - 1;
-        blockchain_add_redundancy(chain, block_idx, data, size);
-    }
-    
-    log_event(LOG_SUCCESS, "File modified, blockchain updated");
+    log_noisy(LOG_SUCCESS, "File modified, blockchain updated");
+    TRACE_END(TRACE_FS_MODIFY, size);
     return 0;
 }
 
 int fs_verify_file(const char* path) {
+    return fs_verify_file_progress(path, NULL, NULL);
+}
+
+int fs_verify_file_progress(const char* path, blockchain_progress_fn progress, void* ctx) {
     if (!path) return -1;
     
     file_type_t type = blockchain_is_system_file(path) ? FILE_TYPE_SYSTEM : FILE_TYPE_USER;
@@ -68,17 +72,7 @@ int fs_verify_file(const char* path) {
         return -1;
     }
     
-    int result = blockchain_verify(chain);
-    
-    if (result == 0 && type == FILE_TYPE_SYSTEM) {
-        for (uint32_t i = 0; i < chain->block_count; ++i) {
-            if (blockchain_verify_redundancy(chain, i) != 0) {
-                return -1;
-            }
-        }
-    }
-    
-    return result;
+    return blockchain_verify_progress(chain, type == FILE_TYPE_SYSTEM, progress, ctx);
 }
 
 int fs_recover_block(const char* path, uint32_t block_idx, uint32_t complete_idx, uint32_t partial_idx, uint32_t partial_shard) {
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+#include "blockchain.h"
+
 int fs_init(void);
 int fs_create_file(const char* path, const uint8_t* data, uint32_t size);
 int fs_modify_file(const char* path, const uint8_t* data, uint32_t size);
 int fs_verify_file(const char* path);
+int fs_verify_file_progress(const char* path, blockchain_progress_fn progress, void* ctx);
 int fs_recover_block(const char* path, uint32_t block_idx, uint32_t complete_idx, uint32_t partial_idx, uint32_t partial_shard);
 
@@ -0,0 +1,65 @@
+#include "gdt.h"
+#include "cpu.h"
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} gdt_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint32_t base;
+} gdt_ptr_t;
+
+/* Null, flat code, flat data, then one %gs data segment per CPU. */
+static gdt_entry_t gdt[3 + CPU_MAX];
+
+static void set_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    gdt[index].limit_low = (uint16_t)(limit & 0xFFFF);
+    gdt[index].base_low = (uint16_t)(base & 0xFFFF);
+    gdt[index].base_mid = (uint8_t)((base >> 16) & 0xFF);
+    gdt[index].access = access;
+    gdt[index].granularity = (uint8_t)(((limit >> 16) & 0x0F) | (flags << 4));
+    gdt[index].base_high = (uint8_t)((base >> 24) & 0xFF);
+}
+
+/* GRUB leaves its own GDT loaded, but the multiboot spec does not promise it
+ * stays valid, and the IDT gates need selectors we control. */
+void gdt_init(void) {
+    set_entry(0, 0, 0, 0, 0);
+    set_entry(1, 0, 0xFFFFF, 0x9A, 0xC);
+    set_entry(2, 0, 0xFFFFF, 0x92, 0xC);
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        set_entry(3 + (int)cpu, 0, 0, 0x92, 0x4);
+    }
+    gdt_load();
+}
+
+/* Also used by application processors, which arrive on the trampoline's
+ * temporary GDT. */
+void gdt_load(void) {
+    gdt_ptr_t ptr = {sizeof(gdt) - 1, (uint32_t)(uintptr_t)gdt};
+    __asm__ volatile(
+        "lgdt %0\n"
+        "ljmp %1, $1f\n"
+        "1:\n"
+        "mov %2, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%fs\n"
+        "mov %%ax, %%gs\n"
+        "mov %%ax, %%ss\n"
+        :
+        : "m"(ptr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+        : "eax", "memory");
+}
+
+/* Gives the calling CPU a %gs segment covering its per-CPU block. */
+void gdt_set_cpu_local(uint32_t cpu, uint32_t base, uint32_t size) {
+    set_entry(3 + (int)cpu, base, size - 1, 0x92, 0x4);
+    __asm__ volatile("mov %0, %%gs" : : "r"((uint16_t)GDT_CPU_LOCAL(cpu)) : "memory");
+}
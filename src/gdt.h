@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_CPU_LOCAL(cpu) (0x18 + (cpu) * 8)
+
+void gdt_init(void);
+void gdt_load(void);
+void gdt_set_cpu_local(uint32_t cpu, uint32_t base, uint32_t size);
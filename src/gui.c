@@ -1,4 +1,5 @@
 #include "gui.h"
+#include "cpu.h"
 #include "fb.h"
 #include "input.h"
 #include "shell.h"
@@ -7,9 +8,28 @@
 #include "installer.h"
 #include "profiles.h"
 #include "anim.h"
+#include "compositor.h"
+#include "memtype.h"
+#include "clock.h"
+#include "timer.h"
+#include "sched.h"
+#include "workqueue.h"
+#include "trace.h"
+#include "metrics.h"
 #include "common.h"
 
+#define GUI_FRAME_NS (NSEC_PER_SEC / 60)
+
 static uint32_t bar_color = 0x00282840;
+static uint32_t desktop_color = 0x00081018;
+static sched_event_t gui_event;
+
+static void bar_bounds(fb_rect_t *out) {
+    out->x = 0;
+    out->y = 0;
+    out->w = fb_width();
+    out->h = 32;
+}
 
 static void draw_bar(void) {
     fb_fillrect(0, 0, fb_width(), 32, bar_color);
@@ -49,32 +69,101 @@ static void handle_shortcuts(char c) {
 }
 
 void gui_init(void) {
+    sched_event_init(&gui_event);
+    input_set_event(&gui_event);
+    workqueue_set_notify(&gui_event);
+    comp_init(desktop_color);
+    comp_add_panel(PANEL_BAR, 0, draw_bar, bar_bounds);
+    comp_add_panel(PANEL_SYSMON, 1, sysmon_render, sysmon_bounds);
+    comp_add_panel(PANEL_CONSOLE, 2, console_render, console_bounds);
+    comp_add_panel(PANEL_SHELL, 3, shell_run, shell_bounds);
+    comp_add_panel(PANEL_INSTALLER, 4, installer_render, installer_bounds);
     shell_init();
     sysmon_open();
+    char msg[64];
+    kstrncpy(msg, "Display present: ", sizeof(msg) - 1);
+    kstrcat(msg, fb_present_name(), sizeof(msg));
+    if (fb_vram()) {
+        kstrcat(msg, ", VRAM ", sizeof(msg));
+        kstrcat(msg, memtype_name(memtype_effective((uint32_t)(uintptr_t)fb_vram())), sizeof(msg));
+    }
+    log_text(LOG_SUCCESS, msg);
+    comp_invalidate_all();
+
+    fb_cursor_move(fb_width() / 2, fb_height() / 2);
+    fb_cursor_enable(mouse_available());
 }
 
-void gui_loop(void) {
+static void drain_input(void) {
+    uint64_t start = metric_now();
     mouse_state_t ms;
+    int ch;
+    while ((ch = kbd_read_char()) >= 0) {
+        handle_shortcuts((char)ch);
+        shell_handle_char((char)ch);
+        console_handle_input((char)ch);
+        sysmon_handle_input((char)ch);
+        installer_handle_key((char)ch);
+    }
+
+    int dx = 0;
+    int dy = 0;
+    while (mouse_poll(&ms)) {
+        dx += ms.dx;
+        dy += ms.dy;
+    }
+    if (dx || dy) {
+        int x, y;
+        fb_cursor_pos(&x, &y);
+        fb_cursor_move(x + dx, y + dy);
+    }
+    metric_span(METRIC_SPAN_INPUT, metric_now() - start);
+}
+
+static void frame_due(void *arg) {
+    (void)arg;
+    gui_wake();
+}
+
+void gui_wake(void) {
+    sched_event_signal(&gui_event);
+}
+
+/* Runs as the GUI task. The first event after idle is drawn immediately;
+ * bursts arriving within a frame interval are coalesced by deferring to a
+ * frame timer, so the desktop is composed at most at GUI_FRAME_NS cadence
+ * and the task sleeps on its event in between. */
+void gui_loop(void) {
+    ktimer_t frame_timer;
+    uint64_t last_frame = 0;
+    timer_setup(&frame_timer, frame_due, NULL);
     for (;;) {
-        fb_clear(0x00081018);
-        draw_bar();
+        TRACE_BEGIN(TRACE_GUI_INPUT, 0);
+        drain_input();
+        TRACE_END(TRACE_GUI_INPUT, 0);
+        TRACE_BEGIN(TRACE_GUI_COMPLETIONS, 0);
+        int completed = workqueue_run_completions();
+        shell_poll();
+        TRACE_END(TRACE_GUI_COMPLETIONS, completed);
 
-        int ch;
-        while ((ch = kbd_read_char()) >= 0) {
-            handle_shortcuts((char)ch);
-            shell_handle_char((char)ch);
-            console_handle_input((char)ch);
-            sysmon_handle_input((char)ch);
-            installer_handle_key((char)ch);
+        uint64_t next_frame = last_frame + GUI_FRAME_NS;
+        if (last_frame && ktime_ns() < next_frame) {
+            if (!timer_armed(&frame_timer)) {
+                timer_arm(&frame_timer, next_frame);
+            }
+        } else {
+            TRACE_BEGIN(TRACE_GUI_COMPOSE, 0);
+            uint64_t start = ktime_ns();
+            int drawn = comp_compose();
+            TRACE_END(TRACE_GUI_COMPOSE, drawn);
+            if (drawn) {
+                last_frame = ktime_ns();
+                metrics_frame(last_frame - start, last_frame);
+            }
         }
 
-        while (mouse_poll(&ms)) {
+        if (!input_pending()) {
+            sched_event_wait(&gui_event);
         }
-
-        sysmon_render();
-        console_render();
-        shell_run();
-        installer_render();
     }
 }
-
@@ -2,4 +2,5 @@
 
 void gui_init(void);
 void gui_loop(void);
+void gui_wake(void);
 
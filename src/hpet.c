@@ -0,0 +1,82 @@
+#include "hpet.h"
+#include "acpi.h"
+
+#define HPET_REG_CAP 0x000
+#define HPET_REG_CONFIG 0x010
+#define HPET_REG_COUNTER 0x0F0
+#define HPET_CAP_COUNT_64 (1u << 13)
+#define HPET_CONFIG_ENABLE 0x1
+#define HPET_MAX_PERIOD_FS 100000000u
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint32_t block_id;
+    uint8_t space_id;
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+    uint8_t number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} acpi_hpet_t;
+
+static volatile uint32_t *hpet_base;
+static uint32_t period_fs;
+static int counter_64;
+static uint32_t last_low;
+static uint32_t wraps;
+
+static uint32_t hpet_reg(uint32_t reg) {
+    return hpet_base[reg / 4];
+}
+
+static void hpet_set_reg(uint32_t reg, uint32_t value) {
+    hpet_base[reg / 4] = value;
+}
+
+int hpet_init(void) {
+    hpet_base = 0;
+    const acpi_hpet_t *table = (const acpi_hpet_t *)acpi_find_table("HPET");
+    if (!table || table->space_id != 0 || !table->address || table->address > 0xFFFFFFFFull) {
+        return -1;
+    }
+    hpet_base = (volatile uint32_t *)(uintptr_t)table->address;
+    period_fs = hpet_reg(HPET_REG_CAP + 4);
+    if (!period_fs || period_fs > HPET_MAX_PERIOD_FS) {
+        hpet_base = 0;
+        return -1;
+    }
+    counter_64 = (hpet_reg(HPET_REG_CAP) & HPET_CAP_COUNT_64) != 0;
+    hpet_set_reg(HPET_REG_CONFIG, hpet_reg(HPET_REG_CONFIG) | HPET_CONFIG_ENABLE);
+    last_low = hpet_reg(HPET_REG_COUNTER);
+    wraps = 0;
+    return 0;
+}
+
+int hpet_present(void) {
+    return hpet_base != 0;
+}
+
+uint32_t hpet_period_fs(void) {
+    return period_fs;
+}
+
+/* A 32-bit counter is extended in software, which is only sound while it
+ * is read at least once per wrap (minutes at typical HPET rates). */
+uint64_t hpet_read(void) {
+    if (counter_64) {
+        uint32_t hi, lo;
+        do {
+            hi = hpet_reg(HPET_REG_COUNTER + 4);
+            lo = hpet_reg(HPET_REG_COUNTER);
+        } while (hi != hpet_reg(HPET_REG_COUNTER + 4));
+        return ((uint64_t)hi << 32) | lo;
+    }
+    uint32_t lo = hpet_reg(HPET_REG_COUNTER);
+    if (lo < last_low) {
+        ++wraps;
+    }
+    last_low = lo;
+    return ((uint64_t)wraps << 32) | lo;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+int hpet_init(void);
+int hpet_present(void);
+uint32_t hpet_period_fs(void);
+uint64_t hpet_read(void);
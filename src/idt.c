@@ -0,0 +1,114 @@
+#include "idt.h"
+#include "gdt.h"
+#include "console.h"
+#include "compositor.h"
+#include "cpu.h"
+#include "sched.h"
+#include "common.h"
+
+typedef struct __attribute__((packed)) {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} idt_gate_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint32_t base;
+} idt_ptr_t;
+
+extern const uint32_t isr_stub_table[IDT_VECTORS];
+
+static idt_gate_t idt[IDT_VECTORS];
+static isr_handler_t handlers[IDT_VECTORS];
+static uint32_t isr_depth[CPU_MAX];
+
+static const char *const exception_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound range",
+    "Invalid opcode", "Device not available", "Double fault", "Coprocessor overrun",
+    "Invalid TSS", "Segment not present", "Stack fault", "General protection",
+    "Page fault", "Reserved", "x87 FP error", "Alignment check", "Machine check",
+    "SIMD FP error", "Virtualization", "Control protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Hypervisor injection",
+    "VMM communication", "Security", "Reserved"
+};
+
+static void append_hex(char *buf, size_t len, uint32_t value) {
+    static const char digits[] = "0123456789ABCDEF";
+    char hex[11] = "0x";
+    for (int i = 0; i < 8; ++i) {
+        hex[2 + i] = digits[(value >> (28 - i * 4)) & 0xF];
+    }
+    hex[10] = '\0';
+    kstrcat(buf, hex, len);
+}
+
+/* Unhandled exceptions are fatal: report where it happened, get the message
+ * onto the screen and stop this CPU. */
+static void fatal_exception(isr_frame_t *frame) {
+    char msg[96];
+    kstrncpy(msg, "EXCEPTION ", sizeof(msg) - 1);
+    kstrcat(msg, exception_names[frame->vector & 31], sizeof(msg));
+    kstrcat(msg, " at ", sizeof(msg));
+    append_hex(msg, sizeof(msg), frame->eip);
+    kstrcat(msg, " err ", sizeof(msg));
+    append_hex(msg, sizeof(msg), frame->error);
+    if (frame->vector == 14) {
+        kstrcat(msg, " cr2 ", sizeof(msg));
+        append_hex(msg, sizeof(msg), read_cr2());
+    }
+    log_text(LOG_ERROR, msg);
+    comp_compose();
+    for (;;) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+static void set_gate(uint8_t vector, uint32_t handler) {
+    idt[vector].offset_low = (uint16_t)(handler & 0xFFFF);
+    idt[vector].selector = GDT_KERNEL_CODE;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = 0x8E;
+    idt[vector].offset_high = (uint16_t)(handler >> 16);
+}
+
+void idt_init(void) {
+    kmemset(handlers, 0, sizeof(handlers));
+    for (int i = 0; i < IDT_VECTORS; ++i) {
+        set_gate((uint8_t)i, isr_stub_table[i]);
+    }
+    idt_load();
+}
+
+/* Every CPU shares the one table and handler array. */
+void idt_load(void) {
+    idt_ptr_t ptr = {sizeof(idt) - 1, (uint32_t)(uintptr_t)idt};
+    __asm__ volatile("lidt %0" : : "m"(ptr));
+}
+
+void idt_set_handler(uint8_t vector, isr_handler_t handler) {
+    handlers[vector] = handler;
+}
+
+/* Only the outermost return may switch tasks: an exception taken inside
+ * a handler is still running on the interrupted task's behalf. */
+isr_frame_t *isr_dispatch(isr_frame_t *frame) {
+    uint32_t *depth = &isr_depth[cpu_current()];
+    ++*depth;
+    isr_handler_t handler = handlers[frame->vector & 0xFF];
+    if (handler) {
+        handler(frame);
+    } else if (frame->vector < 32) {
+        fatal_exception(frame);
+    }
+    if (--*depth == 0) {
+        frame = sched_irq_exit(frame);
+    }
+    return frame;
+}
+
+int in_interrupt(void) {
+    return isr_depth[cpu_current()] != 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#define IDT_VECTORS 256
+#define IRQ_VECTOR_BASE 0x20
+#define LAPIC_TIMER_VECTOR 0xF0
+#define IPI_RESCHED_VECTOR 0xF1
+#define IPI_CALL_VECTOR 0xF2
+#define IPI_TIMER_VECTOR 0xF3
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+/* Register image pushed by isr.s, lowest address first. */
+typedef struct {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_unused, ebx, edx, ecx, eax;
+    uint32_t vector, error;
+    uint32_t eip, cs, eflags;
+} isr_frame_t;
+
+typedef void (*isr_handler_t)(isr_frame_t *frame);
+
+void idt_init(void);
+void idt_load(void);
+void idt_set_handler(uint8_t vector, isr_handler_t handler);
+isr_frame_t *isr_dispatch(isr_frame_t *frame);
+int in_interrupt(void);
@@ -1,15 +1,39 @@
 #include "input.h"
+#include "io.h"
+#include "irq.h"
 #include <stdint.h>
 
-static inline uint8_t inb(uint16_t port) {
-    uint8_t value;
-    __asm__ volatile("inb %1, %0" : "=a"(value) : "dN"(port));
-    return value;
-}
+#define PS2_DATA 0x60
+#define PS2_STATUS 0x64
+#define PS2_CMD 0x64
+#define PS2_STATUS_OUT_FULL 0x01
+#define PS2_STATUS_IN_FULL 0x02
+#define PS2_CMD_READ_CONFIG 0x20
+#define PS2_CMD_WRITE_CONFIG 0x60
+#define PS2_STATUS_AUX 0x20
+#define PS2_CMD_ENABLE_PORT1 0xAE
+#define PS2_CMD_ENABLE_PORT2 0xA8
+#define PS2_CMD_WRITE_PORT2 0xD4
+#define PS2_CONFIG_PORT1_IRQ 0x01
+#define PS2_CONFIG_PORT2_IRQ 0x02
+#define PS2_CONFIG_PORT2_CLOCK_OFF 0x20
 
-static inline void outb(uint16_t port, uint8_t value) {
-    __asm__ volatile("outb %0, %1" : : "a"(value), "dN"(port));
-}
+#define MOUSE_ACK 0xFA
+#define MOUSE_CMD_SET_DEFAULTS 0xF6
+#define MOUSE_CMD_ENABLE_STREAM 0xF4
+#define MOUSE_CMD_SAMPLE_RATE 0xF3
+#define MOUSE_CMD_GET_ID 0xF2
+#define MOUSE_ID_WHEEL 3
+#define MOUSE_PKT_LEFT 0x01
+#define MOUSE_PKT_RIGHT 0x02
+#define MOUSE_PKT_MIDDLE 0x04
+#define MOUSE_PKT_SYNC 0x08
+#define MOUSE_PKT_X_SIGN 0x10
+#define MOUSE_PKT_Y_SIGN 0x20
+#define MOUSE_PKT_OVERFLOW 0xC0
+#define MOUSE_RING_SIZE 64
+
+#define KBD_RING_SIZE 64
 
 static const char keymap[128] = {
     0,  27, '1','2','3','4','5','6','7','8','9','0','-','=', '\b',
@@ -18,44 +42,278 @@ static const char keymap[128] = {
     'z','x','c','v','b','n','m',',','.','/', 0, '*', 0, ' ',
 };
 
+/* Single producer (IRQ1) / single consumer (GUI loop) scancode ring. Each
+ * side owns one index; acquire/release pairs publish the slot contents. */
+static uint8_t kbd_ring[KBD_RING_SIZE];
+static uint32_t kbd_head;
+static uint32_t kbd_tail;
+static uint32_t kbd_dropped;
 static int shift;
 
-void input_init(void) {
-    shift = 0;
-    outb(0x64, 0xAE);
+typedef struct {
+    int16_t dx;
+    int16_t dy;
+    int8_t wheel;
+    uint8_t buttons;
+} mouse_event_t;
+
+/* Same SPSC discipline as the keyboard ring, fed from IRQ12. */
+static mouse_event_t mouse_ring[MOUSE_RING_SIZE];
+static uint32_t mouse_head;
+static uint32_t mouse_tail;
+static uint32_t mouse_dropped;
+static int mouse_present;
+static int mouse_packet_len;
+static uint8_t mouse_packet[4];
+static int mouse_packet_pos;
+static uint8_t mouse_buttons;
+static sched_event_t *input_event;
+
+static int ps2_wait_write(void) {
+    for (int i = 0; i < 100000; ++i) {
+        if (!(inb(PS2_STATUS) & PS2_STATUS_IN_FULL)) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
-int kbd_read_char(void) {
-    if (!(inb(0x64) & 1)) {
-        return -1;
+static int ps2_wait_read(void) {
+    for (int i = 0; i < 100000; ++i) {
+        if (inb(PS2_STATUS) & PS2_STATUS_OUT_FULL) {
+            return 1;
+        }
     }
-    uint8_t sc = inb(0x60);
-    if (sc == 0x2A || sc == 0x36) {
-        shift = 1;
-        return -1;
+    return 0;
+}
+
+static void kbd_irq(isr_frame_t *frame) {
+    (void)frame;
+    if ((inb(PS2_STATUS) & (PS2_STATUS_OUT_FULL | PS2_STATUS_AUX)) != PS2_STATUS_OUT_FULL) {
+        return;
     }
-    if (sc == 0xAA || sc == 0xB6) {
-        shift = 0;
-        return -1;
+    uint8_t sc = inb(PS2_DATA);
+    uint32_t head = kbd_head;
+    uint32_t tail = __atomic_load_n(&kbd_tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= KBD_RING_SIZE) {
+        ++kbd_dropped;
+        return;
     }
-    if (sc & 0x80) {
-        return -1;
+    kbd_ring[head & (KBD_RING_SIZE - 1)] = sc;
+    __atomic_store_n(&kbd_head, head + 1, __ATOMIC_RELEASE);
+    if (input_event) {
+        sched_event_signal(input_event);
     }
-    char ch = 0;
-    if (sc < sizeof(keymap)) {
-        ch = keymap[sc];
+}
+
+static int kbd_pop(uint8_t *sc) {
+    uint32_t tail = kbd_tail;
+    if (__atomic_load_n(&kbd_head, __ATOMIC_ACQUIRE) == tail) {
+        return 0;
     }
-    if (!ch) {
-        return -1;
+    *sc = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+    __atomic_store_n(&kbd_tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int mouse_command(uint8_t cmd) {
+    ps2_wait_write();
+    outb(PS2_CMD, PS2_CMD_WRITE_PORT2);
+    ps2_wait_write();
+    outb(PS2_DATA, cmd);
+    return ps2_wait_read() && inb(PS2_DATA) == MOUSE_ACK;
+}
+
+static int mouse_command_arg(uint8_t cmd, uint8_t arg) {
+    return mouse_command(cmd) && mouse_command(arg);
+}
+
+/* The IntelliMouse knock (sample rates 200, 100, 80) switches a wheel
+ * mouse to ID 3 and 4-byte packets; plain mice keep reporting ID 0. */
+static int mouse_setup(void) {
+    if (!mouse_command(MOUSE_CMD_SET_DEFAULTS)) {
+        return 0;
+    }
+    mouse_packet_len = 3;
+    if (mouse_command_arg(MOUSE_CMD_SAMPLE_RATE, 200) &&
+        mouse_command_arg(MOUSE_CMD_SAMPLE_RATE, 100) &&
+        mouse_command_arg(MOUSE_CMD_SAMPLE_RATE, 80) &&
+        mouse_command(MOUSE_CMD_GET_ID) && ps2_wait_read() &&
+        inb(PS2_DATA) == MOUSE_ID_WHEEL) {
+        mouse_packet_len = 4;
     }
-    if (shift && ch >= 'a' && ch <= 'z') {
-        ch -= 32;
+    return mouse_command(MOUSE_CMD_ENABLE_STREAM);
+}
+
+static void mouse_push(const uint8_t *pkt) {
+    if (pkt[0] & MOUSE_PKT_OVERFLOW) {
+        return;
+    }
+    mouse_event_t ev;
+    ev.dx = (int16_t)(pkt[1] - ((pkt[0] & MOUSE_PKT_X_SIGN) ? 256 : 0));
+    ev.dy = (int16_t)(pkt[2] - ((pkt[0] & MOUSE_PKT_Y_SIGN) ? 256 : 0));
+    ev.wheel = 0;
+    if (mouse_packet_len == 4) {
+        ev.wheel = (int8_t)((pkt[3] & 0x08) ? (int)(pkt[3] & 0x0F) - 16 : (int)(pkt[3] & 0x0F));
+    }
+    ev.buttons = pkt[0] & (MOUSE_PKT_LEFT | MOUSE_PKT_RIGHT | MOUSE_PKT_MIDDLE);
+
+    uint32_t head = mouse_head;
+    if (head - __atomic_load_n(&mouse_tail, __ATOMIC_ACQUIRE) >= MOUSE_RING_SIZE) {
+        ++mouse_dropped;
+        return;
+    }
+    mouse_ring[head & (MOUSE_RING_SIZE - 1)] = ev;
+    __atomic_store_n(&mouse_head, head + 1, __ATOMIC_RELEASE);
+    if (input_event) {
+        sched_event_signal(input_event);
     }
-    return (int)ch;
 }
 
+/* A byte without the sync bit where a packet should start means we lost
+ * alignment; drop bytes until one looks like a header again. */
+static void mouse_irq(isr_frame_t *frame) {
+    (void)frame;
+    if ((inb(PS2_STATUS) & (PS2_STATUS_OUT_FULL | PS2_STATUS_AUX)) !=
+        (PS2_STATUS_OUT_FULL | PS2_STATUS_AUX)) {
+        return;
+    }
+    uint8_t byte = inb(PS2_DATA);
+    if (mouse_packet_pos == 0 && !(byte & MOUSE_PKT_SYNC)) {
+        return;
+    }
+    mouse_packet[mouse_packet_pos++] = byte;
+    if (mouse_packet_pos == mouse_packet_len) {
+        mouse_packet_pos = 0;
+        mouse_push(mouse_packet);
+    }
+}
+
+void input_init(void) {
+    shift = 0;
+    kbd_head = 0;
+    kbd_tail = 0;
+    kbd_dropped = 0;
+
+    while (inb(PS2_STATUS) & PS2_STATUS_OUT_FULL) {
+        (void)inb(PS2_DATA);
+    }
+    mouse_head = 0;
+    mouse_tail = 0;
+    mouse_dropped = 0;
+    mouse_packet_pos = 0;
+    mouse_buttons = 0;
+
+    ps2_wait_write();
+    outb(PS2_CMD, PS2_CMD_ENABLE_PORT1);
+    ps2_wait_write();
+    outb(PS2_CMD, PS2_CMD_ENABLE_PORT2);
+    ps2_wait_write();
+    outb(PS2_CMD, PS2_CMD_READ_CONFIG);
+    uint8_t config = 0;
+    int have_config = ps2_wait_read();
+    if (have_config) {
+        config = inb(PS2_DATA);
+    }
+    mouse_present = have_config && !(config & PS2_CONFIG_PORT2_CLOCK_OFF) && mouse_setup();
+    if (have_config) {
+        config |= PS2_CONFIG_PORT1_IRQ;
+        if (mouse_present) {
+            config |= PS2_CONFIG_PORT2_IRQ;
+        }
+        ps2_wait_write();
+        outb(PS2_CMD, PS2_CMD_WRITE_CONFIG);
+        ps2_wait_write();
+        outb(PS2_DATA, config);
+    }
+
+    irq_register(IRQ_KEYBOARD, kbd_irq);
+    irq_unmask(IRQ_KEYBOARD);
+    if (mouse_present) {
+        irq_register(IRQ_MOUSE, mouse_irq);
+        irq_unmask(IRQ_MOUSE);
+    }
+}
+
+int input_pending(void) {
+    return __atomic_load_n(&kbd_head, __ATOMIC_ACQUIRE) != kbd_tail ||
+           __atomic_load_n(&mouse_head, __ATOMIC_ACQUIRE) != mouse_tail;
+}
+
+int kbd_read_char(void) {
+    uint8_t sc;
+    while (kbd_pop(&sc)) {
+        if (sc == 0x2A || sc == 0x36) {
+            shift = 1;
+            continue;
+        }
+        if (sc == 0xAA || sc == 0xB6) {
+            shift = 0;
+            continue;
+        }
+        if (sc & 0x80) {
+            continue;
+        }
+        char ch = 0;
+        if (sc < sizeof(keymap)) {
+            ch = keymap[sc];
+        }
+        if (!ch) {
+            continue;
+        }
+        if (shift && ch >= 'a' && ch <= 'z') {
+            ch -= 32;
+        }
+        return (int)ch;
+    }
+    return -1;
+}
+
+/* Folds consecutive motion packets into one delta so a frame moves the
+ * cursor once. A button change is reported on its own, after the motion
+ * before it, so no click is lost or displaced. */
 int mouse_poll(mouse_state_t *state) {
-    (void)state;
-    return 0;
+    uint32_t tail = mouse_tail;
+    uint32_t head = __atomic_load_n(&mouse_head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return 0;
+    }
+    int dx = 0;
+    int dy = 0;
+    int wheel = 0;
+    uint8_t buttons = mouse_buttons;
+    uint32_t start = tail;
+    while (tail != head) {
+        const mouse_event_t *ev = &mouse_ring[tail & (MOUSE_RING_SIZE - 1)];
+        if (ev->buttons != buttons && tail != start) {
+            break;
+        }
+        dx += ev->dx;
+        dy += ev->dy;
+        wheel += ev->wheel;
+        ++tail;
+        if (ev->buttons != buttons) {
+            buttons = ev->buttons;
+            break;
+        }
+    }
+    __atomic_store_n(&mouse_tail, tail, __ATOMIC_RELEASE);
+    mouse_buttons = buttons;
+
+    state->dx = dx;
+    state->dy = -dy;
+    state->wheel = wheel;
+    state->lbtn = (buttons & MOUSE_PKT_LEFT) != 0;
+    state->rbtn = (buttons & MOUSE_PKT_RIGHT) != 0;
+    state->mbtn = (buttons & MOUSE_PKT_MIDDLE) != 0;
+    return 1;
 }
 
+int mouse_available(void) {
+    return mouse_present;
+}
+
+/* Signalled from the IRQ handlers whenever a key or mouse event is queued. */
+void input_set_event(sched_event_t *ev) {
+    input_event = ev;
+}
@@ -1,13 +1,20 @@
 #pragma once
 
+#include "sched.h"
+
 typedef struct {
     int dx;
     int dy;
+    int wheel;
     int lbtn;
     int rbtn;
+    int mbtn;
 } mouse_state_t;
 
 void input_init(void);
+int input_pending(void);
 int kbd_read_char(void);
 int mouse_poll(mouse_state_t *state);
+int mouse_available(void);
+void input_set_event(sched_event_t *ev);
 
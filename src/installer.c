@@ -4,6 +4,7 @@
 #include "storage_detect.h"
 #include "common.h"
 #include "audio.h"
+#include "compositor.h"
 
 typedef enum {
     STEP_WELCOME,
@@ -22,6 +23,7 @@ static char confirm_buffer[8];
 
 void installer_open(void) {
     installer_open_flag = 1;
+    comp_invalidate(PANEL_INSTALLER);
     step = STEP_WELCOME;
     selected_index = 0;
     kmemset(confirm_buffer, 0, sizeof(confirm_buffer));
@@ -31,6 +33,7 @@ void installer_open(void) {
 
 void installer_close(void) {
     installer_open_flag = 0;
+    comp_invalidate(PANEL_INSTALLER);
     audio_play(SND_CLOSE);
 }
 
@@ -57,6 +60,7 @@ void installer_handle_key(char c) {
     if (!installer_open_flag) {
         return;
     }
+    comp_invalidate(PANEL_INSTALLER);
     if (c == 'q') {
         installer_close();
         return;
@@ -117,30 +121,41 @@ static void render_devices(int x, int y) {
     }
 }
 
+void installer_bounds(fb_rect_t *out) {
+    out->x = 32;
+    out->y = 200;
+    out->w = fb_width() - 64;
+    out->h = 200;
+}
+
 void installer_render(void) {
     if (!installer_open_flag) {
         return;
     }
-    int w = fb_width();
-    fb_fillrect(32, 200, w - 64, 200, 0x00222222);
-    fb_draw_text(40, 208, "Installer", 0x00FFFFFF, 0);
+    fb_rect_t r;
+    installer_bounds(&r);
+    int x = r.x + 8;
+    int y = r.y + 32;
+    fb_shadow(r.x, r.y, r.w, r.h, 12, 0x80);
+    fb_fillrect(r.x, r.y, r.w, r.h, 0x00222222);
+    fb_draw_text(x, r.y + 8, "Installer", 0x00FFFFFF, 0);
     switch (step) {
         case STEP_WELCOME:
-            fb_draw_text(40, 232, "Welcome to the guided installer. Press Enter to scan storage.", 0x00FFFFFF, 0);
+            fb_draw_text(x, y, "Welcome to the guided installer. Press Enter to scan storage.", 0x00FFFFFF, 0);
             break;
         case STEP_SCAN:
-            fb_draw_text(40, 232, "Detecting storage devices...", 0x00FFFFFF, 0);
-            render_devices(40, 248);
+            fb_draw_text(x, y, "Detecting storage devices...", 0x00FFFFFF, 0);
+            render_devices(x, y + 16);
             break;
         case STEP_CONFIRM:
-            fb_draw_text(40, 232, "Type INSTALL to confirm non-destructive install:", 0x00FFFF00, 0);
-            fb_draw_text(40, 248, confirm_buffer, 0x00FFFFFF, 0);
+            fb_draw_text(x, y, "Type INSTALL to confirm non-destructive install:", 0x00FFFF00, 0);
+            fb_draw_text(x, y + 16, confirm_buffer, 0x00FFFFFF, 0);
             break;
         case STEP_PROGRESS:
-            fb_draw_text(40, 232, "Installing... (simulated)", 0x0000FF00, 0);
+            fb_draw_text(x, y, "Installing... (simulated)", 0x0000FF00, 0);
             break;
         case STEP_DONE:
-            fb_draw_text(40, 232, "Install complete. Press Enter to close.", 0x0000FF00, 0);
+            fb_draw_text(x, y, "Install complete. Press Enter to close.", 0x0000FF00, 0);
             break;
     }
 }
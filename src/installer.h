@@ -1,8 +1,11 @@
 #pragma once
 
+#include "fb.h"
+
 void installer_open(void);
 void installer_close(void);
 int installer_is_open(void);
 void installer_handle_key(char c);
+void installer_bounds(fb_rect_t *out);
 void installer_render(void);
 
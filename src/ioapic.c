@@ -0,0 +1,71 @@
+#include "ioapic.h"
+#include "acpi.h"
+
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_REG_VER 0x01
+#define IOAPIC_REG_REDTBL 0x10
+
+#define REDIR_MASKED (1u << 16)
+#define REDIR_LEVEL (1u << 15)
+#define REDIR_ACTIVE_LOW (1u << 13)
+
+static volatile uint32_t *ioapic_base;
+static uint32_t ioapic_gsi_base;
+static uint32_t ioapic_pins;
+
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic_base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    ioapic_base[IOAPIC_WINDOW / 4] = value;
+}
+
+static int pin_for(uint32_t gsi, uint32_t *pin) {
+    if (!ioapic_base || gsi < ioapic_gsi_base || gsi - ioapic_gsi_base >= ioapic_pins) {
+        return 0;
+    }
+    *pin = gsi - ioapic_gsi_base;
+    return 1;
+}
+
+int ioapic_init(uint32_t base, uint32_t gsi_base) {
+    ioapic_base = (volatile uint32_t *)(uintptr_t)base;
+    ioapic_gsi_base = gsi_base;
+    ioapic_pins = ((ioapic_read(IOAPIC_REG_VER) >> 16) & 0xFF) + 1;
+    for (uint32_t pin = 0; pin < ioapic_pins; ++pin) {
+        ioapic_write(IOAPIC_REG_REDTBL + pin * 2, REDIR_MASKED);
+        ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, 0);
+    }
+    return 0;
+}
+
+/* Routes stay masked until the driver unmasks them via irq_unmask. */
+void ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, uint8_t dest_apic_id) {
+    uint32_t pin;
+    if (!pin_for(gsi, &pin)) {
+        return;
+    }
+    uint32_t low = vector | REDIR_MASKED;
+    if ((flags & ACPI_ISO_POLARITY_LOW) == ACPI_ISO_POLARITY_LOW) {
+        low |= REDIR_ACTIVE_LOW;
+    }
+    if ((flags & ACPI_ISO_TRIGGER_LEVEL) == ACPI_ISO_TRIGGER_LEVEL) {
+        low |= REDIR_LEVEL;
+    }
+    ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, (uint32_t)dest_apic_id << 24);
+    ioapic_write(IOAPIC_REG_REDTBL + pin * 2, low);
+}
+
+void ioapic_set_masked(uint32_t gsi, int masked) {
+    uint32_t pin;
+    if (!pin_for(gsi, &pin)) {
+        return;
+    }
+    uint32_t low = ioapic_read(IOAPIC_REG_REDTBL + pin * 2);
+    low = masked ? (low | REDIR_MASKED) : (low & ~REDIR_MASKED);
+    ioapic_write(IOAPIC_REG_REDTBL + pin * 2, low);
+}
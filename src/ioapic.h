@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+int ioapic_init(uint32_t base, uint32_t gsi_base);
+void ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, uint8_t dest_apic_id);
+void ioapic_set_masked(uint32_t gsi, int masked);
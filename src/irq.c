@@ -0,0 +1,189 @@
+#include "irq.h"
+#include "io.h"
+#include "cpu.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "ioapic.h"
+#include "console.h"
+#include "common.h"
+
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+#define ICW1_INIT 0x11
+#define ICW4_8086 0x01
+
+static irq_mode_t mode;
+static isr_handler_t irq_handlers[IRQ_LINES];
+static volatile uint32_t irq_counts[IRQ_LINES];
+static uint16_t pic_mask = 0xFFFF;
+static uint32_t irq_gsi[IRQ_LINES];
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, (uint8_t)pic_mask);
+    outb(PIC2_DATA, (uint8_t)(pic_mask >> 8));
+}
+
+/* Move the 8259s off the CPU exception vectors; every line starts masked
+ * except the cascade so slave IRQs can reach the master once unmasked. */
+static void pic_remap(void) {
+    outb(PIC1_CMD, ICW1_INIT);
+    io_wait();
+    outb(PIC2_CMD, ICW1_INIT);
+    io_wait();
+    outb(PIC1_DATA, IRQ_VECTOR_BASE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_VECTOR_BASE + 8);
+    io_wait();
+    outb(PIC1_DATA, 1u << IRQ_CASCADE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_CASCADE);
+    io_wait();
+    outb(PIC1_DATA, ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, ICW4_8086);
+    io_wait();
+    pic_mask = (uint16_t)~(1u << IRQ_CASCADE);
+    pic_mask |= 0xFF00;
+    pic_write_mask();
+}
+
+static uint16_t pic_in_service(void) {
+    outb(PIC1_CMD, PIC_READ_ISR);
+    outb(PIC2_CMD, PIC_READ_ISR);
+    return (uint16_t)(inb(PIC1_CMD) | ((uint16_t)inb(PIC2_CMD) << 8));
+}
+
+/* IRQ7/IRQ15 fire spuriously when a request is withdrawn before the INTA
+ * cycle; the in-service bit tells a real interrupt from a phantom one. A
+ * spurious IRQ15 still needs an EOI on the master for the cascade. */
+static int pic_spurious(uint8_t irq) {
+    if (irq != 7 && irq != 15) {
+        return 0;
+    }
+    if (pic_in_service() & (1u << irq)) {
+        return 0;
+    }
+    if (irq == 15) {
+        outb(PIC1_CMD, PIC_EOI);
+    }
+    return 1;
+}
+
+static void irq_eoi(uint8_t irq) {
+    if (mode == IRQ_MODE_APIC) {
+        lapic_eoi();
+        return;
+    }
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI);
+    }
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+static void irq_entry(isr_frame_t *frame) {
+    uint8_t irq = (uint8_t)(frame->vector - IRQ_VECTOR_BASE);
+    if (mode == IRQ_MODE_PIC && pic_spurious(irq)) {
+        return;
+    }
+    ++irq_counts[irq];
+    if (irq_handlers[irq]) {
+        irq_handlers[irq](frame);
+    }
+    irq_eoi(irq);
+}
+
+static void apic_spurious(isr_frame_t *frame) {
+    (void)frame;
+}
+
+/* The IOAPIC path needs both the MADT and a local APIC to deliver to. */
+static int setup_apic(void) {
+    const acpi_madt_info_t *madt = acpi_madt();
+    if (!madt || !madt->ioapic_addr || lapic_init(madt->lapic_addr) != 0) {
+        return 0;
+    }
+    ioapic_init(madt->ioapic_addr, madt->ioapic_gsi_base);
+    uint8_t dest = (uint8_t)lapic_id();
+    for (int irq = 0; irq < IRQ_LINES; ++irq) {
+        if (irq == IRQ_CASCADE) {
+            continue;
+        }
+        irq_gsi[irq] = madt->isa_gsi[irq];
+        ioapic_route(irq_gsi[irq], (uint8_t)(IRQ_VECTOR_BASE + irq), madt->isa_flags[irq], dest);
+    }
+    idt_set_handler(APIC_SPURIOUS_VECTOR, apic_spurious);
+    return 1;
+}
+
+void irq_init(void) {
+    kmemset(irq_handlers, 0, sizeof(irq_handlers));
+    for (int irq = 0; irq < IRQ_LINES; ++irq) {
+        irq_gsi[irq] = (uint32_t)irq;
+        irq_counts[irq] = 0;
+        idt_set_handler((uint8_t)(IRQ_VECTOR_BASE + irq), irq_entry);
+    }
+
+    pic_remap();
+    mode = IRQ_MODE_PIC;
+    if (setup_apic()) {
+        pic_mask = 0xFFFF;
+        pic_write_mask();
+        mode = IRQ_MODE_APIC;
+    }
+
+    char msg[48];
+    kstrncpy(msg, "Interrupts routed via ", sizeof(msg) - 1);
+    kstrcat(msg, irq_mode_name(), sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+}
+
+irq_mode_t irq_mode(void) {
+    return mode;
+}
+
+const char *irq_mode_name(void) {
+    return mode == IRQ_MODE_APIC ? "IOAPIC" : "8259 PIC";
+}
+
+void irq_register(uint8_t irq, isr_handler_t handler) {
+    if (irq >= IRQ_LINES) {
+        return;
+    }
+    uint32_t flags = cpu_irq_save();
+    irq_handlers[irq] = handler;
+    cpu_irq_restore(flags);
+}
+
+static void set_masked(uint8_t irq, int masked) {
+    if (irq >= IRQ_LINES) {
+        return;
+    }
+    uint32_t flags = cpu_irq_save();
+    if (mode == IRQ_MODE_APIC) {
+        ioapic_set_masked(irq_gsi[irq], masked);
+    } else {
+        if (masked) {
+            pic_mask |= (uint16_t)(1u << irq);
+        } else {
+            pic_mask &= (uint16_t)~(1u << irq);
+        }
+        pic_write_mask();
+    }
+    cpu_irq_restore(flags);
+}
+
+void irq_mask(uint8_t irq) {
+    set_masked(irq, 1);
+}
+
+void irq_unmask(uint8_t irq) {
+    set_masked(irq, 0);
+}
+
+uint32_t irq_count(uint8_t irq) {
+    return irq < IRQ_LINES ? irq_counts[irq] : 0;
+}
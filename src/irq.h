@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "idt.h"
+
+#define IRQ_LINES 16
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_CASCADE 2
+#define IRQ_COM1 4
+#define IRQ_MOUSE 12
+
+typedef enum {
+    IRQ_MODE_PIC,
+    IRQ_MODE_APIC
+} irq_mode_t;
+
+void irq_init(void);
+irq_mode_t irq_mode(void);
+const char *irq_mode_name(void);
+void irq_register(uint8_t irq, isr_handler_t handler);
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+uint32_t irq_count(uint8_t irq);
@@ -0,0 +1,70 @@
+    .altmacro
+
+/* Every vector gets a stub that pushes a uniform (error, vector) pair so
+ * isr_dispatch sees one frame layout. The CPU pushes a real error code for
+ * 8, 10-14, 17, 21, 29 and 30 only. */
+    .macro ISR_STUB n
+isr_stub_\n:
+    .if (\n == 8) || ((\n >= 10) && (\n <= 14)) || (\n == 17) || (\n == 21) || (\n == 29) || (\n == 30)
+    .else
+    pushl $0
+    .endif
+    pushl $\n
+    jmp isr_common
+    .endm
+
+    .macro ISR_ADDR n
+    .long isr_stub_\n
+    .endm
+
+    .section .text
+    .set vec, 0
+    .rept 256
+    ISR_STUB %vec
+    .set vec, vec + 1
+    .endr
+
+/* isr_dispatch returns the frame to resume, which lets a handler switch to
+ * another saved context simply by returning its frame. %gs always holds
+ * this CPU's per-CPU segment, so it is saved for the frame layout but never
+ * restored: a task may resume on a different CPU than it was saved on. */
+isr_common:
+    pushal
+    pushl %ds
+    pushl %es
+    pushl %fs
+    pushl %gs
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    cld
+    pushl %esp
+    call isr_dispatch
+    movl %eax, %esp
+    /* Now that we are off the previous task's stack, let other CPUs run it
+     * (cpu_local_t.release at %gs:12). */
+    movl %gs:12, %ecx
+    testl %ecx, %ecx
+    jz 1f
+    movb $0, (%ecx)
+    movl $0, %gs:12
+1:
+    addl $4, %esp
+    popl %fs
+    popl %es
+    popl %ds
+    popal
+    addl $8, %esp
+    iret
+
+    .section .rodata
+    .global isr_stub_table
+    .align 4
+isr_stub_table:
+    .set vec, 0
+    .rept 256
+    ISR_ADDR %vec
+    .set vec, vec + 1
+    .endr
+
+    .section .note.GNU-stack, "", @progbits
@@ -1,19 +1,65 @@
+#include "cpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "fpu.h"
+#include "acpi.h"
+#include "irq.h"
+#include "serial.h"
+#include "trace.h"
+#include "metrics.h"
+#include "clock.h"
+#include "timer.h"
+#include "sched.h"
+#include "smp.h"
+#include "parallel.h"
+#include "workqueue.h"
+#include "fiber.h"
+#include "pmm.h"
+#include "slab.h"
+#include "paging.h"
+#include "memtype.h"
 #include "fb.h"
 #include "input.h"
 #include "gui.h"
 #include "profiles.h"
 #include "ledger.h"
 #include "fs.h"
+#include "blockchain.h"
 #include "raid.h"
 #include "compat_win.h"
 #include "console.h"
 #include "anim.h"
 #include "audio.h"
 #include "shell.h"
+#include "common.h"
 
 void kernel_main(void *mb2) {
+    cpu_init();
+    kmem_init();
+    gdt_init();
+    cpu_local_init(0, 0);
+    metrics_init();
+    idt_init();
+    memtype_init();
+    serial_init();
     fb_init(mb2);
     console_init();
+    fpu_init();
+    pmm_init(mb2);
+    paging_init();
+    slab_init();
+    acpi_init(mb2);
+    clock_init();
+    trace_init();
+    irq_init();
+    timer_init();
+    serial_start();
+    sched_init();
+    timer_start_thread();
+    smp_init();
+    parallel_init();
+    workqueue_init();
+    fiber_init();
     audio_init();
     anim_init();
     input_init();
@@ -22,6 +68,7 @@ void kernel_main(void *mb2) {
     ledger_init();
     jnl_recover();
     fs_init();
+    blockchain_start_scrubber();
     raid_init();
     win_compat_init();
 
@@ -31,6 +78,8 @@ void kernel_main(void *mb2) {
 
     shell_open();
     gui_init();
+    task_set_name("gui");
+    cpu_irq_enable();
     gui_loop();
 }
 
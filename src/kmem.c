@@ -0,0 +1,103 @@
+#include "common.h"
+#include "cpu.h"
+
+/* With ERMS, rep movsb/stosb move whole cache lines internally and beat
+ * any loop once past their startup cost; FSRM removes that cost for short
+ * strings too. Without either, rep movsl/stosl on an aligned destination
+ * is the widest move that needs no FPU state. */
+#define KMEM_ERMS_MIN 128
+#define KMEM_NO_REP ((size_t)-1)
+
+static size_t rep_byte_min = KMEM_NO_REP;
+
+void kmem_init(void) {
+    if (cpu_has(CPU_FEAT_FSRM)) {
+        rep_byte_min = 0;
+    } else if (cpu_has(CPU_FEAT_ERMS)) {
+        rep_byte_min = KMEM_ERMS_MIN;
+    } else {
+        rep_byte_min = KMEM_NO_REP;
+    }
+}
+
+const char *kmem_strategy(void) {
+    if (rep_byte_min == 0) {
+        return "FSRM rep movsb";
+    }
+    return rep_byte_min == KMEM_NO_REP ? "rep movsl" : "ERMS rep movsb";
+}
+
+static inline void rep_movsb(void *dst, const void *src, size_t count) {
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
+static inline void rep_stosb(void *dst, uint8_t value, size_t count) {
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+void kmemcpy_bulk(void *dst, const void *src, size_t count) {
+    if (count >= rep_byte_min || count < 16) {
+        rep_movsb(dst, src, count);
+        return;
+    }
+    size_t head = (0u - (uintptr_t)dst) & 3;
+    rep_movsb(dst, src, head);
+    uint8_t *d = (uint8_t *)dst + head;
+    const uint8_t *s = (const uint8_t *)src + head;
+    count -= head;
+    size_t words = count >> 2;
+    __asm__ volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    rep_movsb(d, s, count & 3);
+}
+
+void kmemset_bulk(void *dst, int value, size_t count) {
+    uint8_t byte = (uint8_t)value;
+    if (count >= rep_byte_min || count < 16) {
+        rep_stosb(dst, byte, count);
+        return;
+    }
+    size_t head = (0u - (uintptr_t)dst) & 3;
+    rep_stosb(dst, byte, head);
+    uint8_t *d = (uint8_t *)dst + head;
+    count -= head;
+    size_t words = count >> 2;
+    uint32_t pattern = byte * 0x01010101u;
+    __asm__ volatile("rep stosl" : "+D"(d), "+c"(words) : "a"(pattern) : "memory");
+    rep_stosb(d, byte, count & 3);
+}
+
+/* repe cmpsb is microcoded and slow everywhere, so compare a dword at a
+ * time and only drop to bytes inside the first word that differs. */
+int kmemcmp_bulk(const void *a, const void *b, size_t count) {
+    const uint8_t *pa = (const uint8_t *)a;
+    const uint8_t *pb = (const uint8_t *)b;
+    while (count >= 4 && *(const kmem_u32_t *)pa == *(const kmem_u32_t *)pb) {
+        pa += 4;
+        pb += 4;
+        count -= 4;
+    }
+    while (count--) {
+        if (*pa != *pb) {
+            return (int)*pa - (int)*pb;
+        }
+        pa++;
+        pb++;
+    }
+    return 0;
+}
+
+/* GCC may emit calls to these for struct copies and initialisers even in
+ * a freestanding build. */
+void *memcpy(void *dst, const void *src, size_t count) {
+    kmemcpy_bulk(dst, src, count);
+    return dst;
+}
+
+void *memset(void *dst, int value, size_t count) {
+    kmemset_bulk(dst, value, count);
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t count) {
+    return kmemcmp_bulk(a, b, count);
+}
@@ -0,0 +1,139 @@
+#include "lapic.h"
+#include "cpu.h"
+#include "idt.h"
+#include "clock.h"
+#include "common.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE (1u << 11)
+#define APIC_BASE_MASK 0xFFFFF000u
+
+#define LAPIC_REG_ID 0x20
+#define LAPIC_REG_TPR 0x80
+#define LAPIC_REG_EOI 0xB0
+#define LAPIC_REG_SVR 0xF0
+#define LAPIC_SVR_ENABLE 0x100
+#define LAPIC_REG_ICR_LOW 0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_ICR_PENDING (1u << 12)
+#define LAPIC_ICR_ASSERT (1u << 14)
+#define LAPIC_ICR_FIXED 0x000
+#define LAPIC_ICR_INIT 0x500
+#define LAPIC_ICR_STARTUP 0x600
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE 0x3E0
+#define LAPIC_LVT_MASKED (1u << 16)
+#define LAPIC_TIMER_DIV_16 0x3
+#define LAPIC_CALIBRATE_MS 10
+
+static volatile uint32_t *lapic_base;
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+int lapic_init(uint32_t madt_base) {
+    lapic_base = 0;
+    if (!cpu_has(CPU_FEAT_APIC)) {
+        return -1;
+    }
+    uint64_t msr = rdmsr(IA32_APIC_BASE_MSR);
+    uint32_t base = (uint32_t)msr & APIC_BASE_MASK;
+    if (madt_base && madt_base != base) {
+        base = madt_base;
+    }
+    wrmsr(IA32_APIC_BASE_MSR, (msr & ~(uint64_t)APIC_BASE_MASK) | base | APIC_BASE_ENABLE);
+    lapic_base = (volatile uint32_t *)(uintptr_t)base;
+    lapic_init_ap();
+    return 0;
+}
+
+/* Each CPU has its own local APIC at the same address; this enables the
+ * calling CPU's, using the base the boot CPU settled on. */
+void lapic_init_ap(void) {
+    uint64_t msr = rdmsr(IA32_APIC_BASE_MSR);
+    uint32_t base = (uint32_t)(uintptr_t)lapic_base;
+    wrmsr(IA32_APIC_BASE_MSR, (msr & ~(uint64_t)APIC_BASE_MASK) | base | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+int lapic_present(void) {
+    return lapic_base != 0;
+}
+
+uint32_t lapic_id(void) {
+    return lapic_base ? lapic_read(LAPIC_REG_ID) >> 24 : 0;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+/* The timer ticks at the bus or crystal clock divided by 16, which the
+ * SDM leaves model-specific, so measure it against ktime. Returns kHz. */
+uint32_t lapic_timer_init(uint8_t vector) {
+    if (!lapic_base || !clock_source_khz()) {
+        return 0;
+    }
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | vector);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFFu);
+    uint64_t start = ktime_ns();
+    ktime_spin_until(start + LAPIC_CALIBRATE_MS * NSEC_PER_MSEC);
+    uint32_t elapsed = 0xFFFFFFFFu - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    uint32_t elapsed_us = (uint32_t)(ktime_ns() - start) / NSEC_PER_USEC;
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    lapic_write(LAPIC_REG_LVT_TIMER, vector);
+    if (!elapsed_us) {
+        return 0;
+    }
+    return (uint32_t)kdiv64((uint64_t)elapsed * 1000u, elapsed_us, 0);
+}
+
+/* Application processors reuse the boot CPU's calibration; every local
+ * APIC timer runs off the same bus clock. */
+void lapic_timer_init_ap(uint8_t vector) {
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    lapic_write(LAPIC_REG_LVT_TIMER, vector);
+}
+
+static void send_icr(uint32_t apic_id, uint32_t low) {
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        cpu_relax();
+    }
+    lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, low);
+}
+
+/* Interrupts must be off so the ICR pair is not split by a handler that
+ * sends its own IPI. */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    uint32_t flags = cpu_irq_save();
+    send_icr(apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+    cpu_irq_restore(flags);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+/* The AP starts in real mode at page * 4096. */
+void lapic_send_startup(uint32_t apic_id, uint8_t page) {
+    send_icr(apic_id, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | page);
+}
+
+void lapic_timer_oneshot(uint32_t count) {
+    lapic_write(LAPIC_REG_TIMER_INITIAL, count ? count : 1);
+}
+
+void lapic_timer_stop(void) {
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+}
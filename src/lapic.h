@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+int lapic_init(uint32_t madt_base);
+void lapic_init_ap(void);
+int lapic_present(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+uint32_t lapic_timer_init(uint8_t vector);
+void lapic_timer_init_ap(uint8_t vector);
+void lapic_timer_oneshot(uint32_t count);
+void lapic_timer_stop(void);
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint8_t page);
@@ -0,0 +1,309 @@
+#include "memtype.h"
+#include "cpu.h"
+#include "paging.h"
+#include "smp.h"
+#include "common.h"
+
+#define MSR_MTRRCAP 0xFE
+#define MSR_PAT 0x277
+#define MSR_MTRR_DEF_TYPE 0x2FF
+#define MSR_MTRR_PHYSBASE(n) (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n) (0x201 + 2 * (n))
+
+#define MTRRCAP_VCNT_MASK 0xFF
+#define MTRRCAP_WC (1u << 10)
+#define MTRR_DEF_ENABLE (1u << 11)
+#define MTRR_MASK_VALID (1u << 11)
+#define MTRR_MAX_VAR 16
+
+#define CR0_NW (1u << 29)
+#define CR0_CD (1u << 30)
+
+/* PAT entry 1 (PWT=1, PCD=0) becomes write-combining; the rest keep their
+ * power-on meaning, so page tables without PWT behave exactly as before. */
+#define PAT_ENTRY(n, type) ((uint64_t)(type) << ((n) * 8))
+#define PAT_VALUE (PAT_ENTRY(0, MEMTYPE_WB) | PAT_ENTRY(1, MEMTYPE_WC) | \
+                   PAT_ENTRY(2, MEMTYPE_UC_MINUS) | PAT_ENTRY(3, MEMTYPE_UC) | \
+                   PAT_ENTRY(4, MEMTYPE_WB) | PAT_ENTRY(5, MEMTYPE_WT) | \
+                   PAT_ENTRY(6, MEMTYPE_UC_MINUS) | PAT_ENTRY(7, MEMTYPE_UC))
+
+typedef struct {
+    uint64_t base[MTRR_MAX_VAR];
+    uint64_t mask[MTRR_MAX_VAR];
+    uint64_t def_type;
+} mtrr_state_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    uint8_t type;
+} mtrr_range_t;
+
+static int mtrr_count;
+static int mtrr_wc;
+static uint64_t phys_mask;
+static mtrr_state_t firmware_state;
+static mtrr_state_t wc_state;
+static int wc_ready;
+static const mtrr_state_t *active_state;
+
+/* Cache-disable protocol from the SDM: memory-type registers may only be
+ * rewritten while caches are off and flushed. */
+static void cache_disable(uint32_t *saved_cr0) {
+    *saved_cr0 = read_cr0();
+    write_cr0((*saved_cr0 | CR0_CD) & ~CR0_NW);
+    wbinvd();
+}
+
+static void cache_enable(uint32_t saved_cr0) {
+    wbinvd();
+    write_cr0(saved_cr0);
+}
+
+static void mtrr_save(mtrr_state_t *st) {
+    kmemset(st, 0, sizeof(*st));
+    st->def_type = rdmsr(MSR_MTRR_DEF_TYPE);
+    for (int i = 0; i < mtrr_count; ++i) {
+        st->base[i] = rdmsr(MSR_MTRR_PHYSBASE(i));
+        st->mask[i] = rdmsr(MSR_MTRR_PHYSMASK(i));
+    }
+}
+
+static void mtrr_load(const mtrr_state_t *st) {
+    uint32_t flags = cpu_irq_save();
+    uint32_t cr0;
+    cache_disable(&cr0);
+    wrmsr(MSR_MTRR_DEF_TYPE, st->def_type & ~(uint64_t)MTRR_DEF_ENABLE);
+    for (int i = 0; i < mtrr_count; ++i) {
+        wrmsr(MSR_MTRR_PHYSBASE(i), st->base[i]);
+        wrmsr(MSR_MTRR_PHYSMASK(i), st->mask[i]);
+    }
+    wrmsr(MSR_MTRR_DEF_TYPE, st->def_type);
+    cache_enable(cr0);
+    cpu_irq_restore(flags);
+}
+
+static int range_of(const mtrr_state_t *st, int i, mtrr_range_t *out) {
+    if (!(st->mask[i] & MTRR_MASK_VALID)) {
+        return 0;
+    }
+    uint64_t mask = st->mask[i] & phys_mask & ~0xFFFull;
+    out->start = st->base[i] & phys_mask & ~0xFFFull;
+    out->size = (~mask & phys_mask) + 1;
+    out->type = (uint8_t)(st->base[i] & 0xFF);
+    return 1;
+}
+
+/* Split [start, end) into naturally aligned power-of-two pieces, which is
+ * the only shape a variable MTRR can describe. */
+static int decompose(uint64_t start, uint64_t end, uint8_t type, mtrr_range_t *out, int max) {
+    int count = 0;
+    while (start < end) {
+        uint64_t size = 0x1000;
+        while ((start & (size * 2 - 1)) == 0 && start + size * 2 <= end) {
+            size *= 2;
+        }
+        if (count == max) {
+            return -1;
+        }
+        out[count].start = start;
+        out[count].size = size;
+        out[count].type = type;
+        count++;
+        start += size;
+    }
+    return count;
+}
+
+/* Build an MTRR set where [base, base + size) is WC. Any firmware range that
+ * overlaps it (typically a UC PCI hole, which would win over WC) is carved
+ * into pieces that skip the framebuffer. */
+static int build_wc_state(uint64_t base, uint64_t size) {
+    mtrr_range_t pending[MTRR_MAX_VAR];
+    int pending_count = 0;
+    uint64_t end = base + size;
+
+    wc_state = firmware_state;
+    for (int i = 0; i < mtrr_count; ++i) {
+        mtrr_range_t r;
+        if (!range_of(&wc_state, i, &r) || r.start >= end || r.start + r.size <= base) {
+            continue;
+        }
+        wc_state.mask[i] = 0;
+        wc_state.base[i] = 0;
+        if (r.start < base) {
+            int n = decompose(r.start, base, r.type, pending + pending_count, MTRR_MAX_VAR - pending_count);
+            if (n < 0) return -1;
+            pending_count += n;
+        }
+        if (r.start + r.size > end) {
+            int n = decompose(end, r.start + r.size, r.type, pending + pending_count, MTRR_MAX_VAR - pending_count);
+            if (n < 0) return -1;
+            pending_count += n;
+        }
+    }
+    int n = decompose(base, end, MEMTYPE_WC, pending + pending_count, MTRR_MAX_VAR - pending_count);
+    if (n < 0) {
+        return -1;
+    }
+    pending_count += n;
+
+    int next = 0;
+    for (int i = 0; i < mtrr_count && next < pending_count; ++i) {
+        if (wc_state.mask[i] & MTRR_MASK_VALID) {
+            continue;
+        }
+        wc_state.base[i] = pending[next].start | pending[next].type;
+        wc_state.mask[i] = (~(pending[next].size - 1) & phys_mask) | MTRR_MASK_VALID;
+        next++;
+    }
+    return next == pending_count ? 0 : -1;
+}
+
+static void write_pat(void) {
+    uint32_t cr0;
+    uint32_t flags = cpu_irq_save();
+    cache_disable(&cr0);
+    wrmsr(MSR_PAT, PAT_VALUE);
+    cache_enable(cr0);
+    cpu_irq_restore(flags);
+}
+
+void memtype_init(void) {
+    mtrr_count = 0;
+    mtrr_wc = 0;
+    wc_ready = 0;
+    active_state = NULL;
+    phys_mask = ((1ull << cpu_phys_addr_bits()) - 1) & ~0xFFFull;
+
+    if (cpu_has(CPU_FEAT_PAT)) {
+        write_pat();
+    }
+
+    if (cpu_has(CPU_FEAT_MTRR)) {
+        uint64_t cap = rdmsr(MSR_MTRRCAP);
+        mtrr_count = (int)(cap & MTRRCAP_VCNT_MASK);
+        if (mtrr_count > MTRR_MAX_VAR) {
+            mtrr_count = MTRR_MAX_VAR;
+        }
+        mtrr_wc = (cap & MTRRCAP_WC) != 0;
+        mtrr_save(&firmware_state);
+        active_state = &firmware_state;
+    }
+}
+
+/* The SDM requires every CPU to agree on PAT and MTRRs, so a new CPU
+ * copies whatever set the boot CPU currently has loaded. */
+void memtype_init_ap(void) {
+    if (cpu_has(CPU_FEAT_PAT)) {
+        write_pat();
+    }
+    if (active_state) {
+        mtrr_load(active_state);
+    }
+}
+
+static void load_state_ipi(void *arg) {
+    mtrr_load((const mtrr_state_t *)arg);
+}
+
+static void use_state(const mtrr_state_t *st) {
+    active_state = st;
+    mtrr_load(st);
+    smp_call_others(load_state_ipi, (void *)st);
+}
+
+int memtype_map_wc(uint32_t base, uint32_t size) {
+    if (!mtrr_wc || !mtrr_count || !(firmware_state.def_type & MTRR_DEF_ENABLE) || !size) {
+        return -1;
+    }
+    uint64_t start = base & ~0xFFFull;
+    uint64_t end = ((uint64_t)base + size + 0xFFF) & ~0xFFFull;
+    if (build_wc_state(start, end - start) != 0) {
+        return -1;
+    }
+    wc_ready = 1;
+    memtype_use_wc();
+    return 0;
+}
+
+int memtype_wc_available(void) {
+    return wc_ready;
+}
+
+void memtype_use_firmware(void) {
+    if (mtrr_count) {
+        use_state(&firmware_state);
+    }
+}
+
+void memtype_use_wc(void) {
+    if (wc_ready) {
+        use_state(&wc_state);
+    }
+}
+
+static memtype_t mtrr_type(uint32_t addr) {
+    if (!cpu_has(CPU_FEAT_MTRR)) {
+        return MEMTYPE_WB;
+    }
+    uint64_t def = rdmsr(MSR_MTRR_DEF_TYPE);
+    if (!(def & MTRR_DEF_ENABLE)) {
+        return MEMTYPE_UC;
+    }
+    int found = 0;
+    memtype_t type = MEMTYPE_UC;
+    for (int i = 0; i < mtrr_count; ++i) {
+        uint64_t mask = rdmsr(MSR_MTRR_PHYSMASK(i));
+        if (!(mask & MTRR_MASK_VALID)) {
+            continue;
+        }
+        uint64_t base = rdmsr(MSR_MTRR_PHYSBASE(i));
+        mask &= phys_mask;
+        if ((addr & mask) != (base & mask)) {
+            continue;
+        }
+        memtype_t t = (memtype_t)(base & 0xFF);
+        if (t == MEMTYPE_UC) {
+            return MEMTYPE_UC;
+        }
+        if (found && t != type) {
+            if ((t == MEMTYPE_WT && type == MEMTYPE_WB) || (t == MEMTYPE_WB && type == MEMTYPE_WT)) {
+                t = MEMTYPE_WT;
+            } else {
+                return MEMTYPE_UC;
+            }
+        }
+        type = t;
+        found = 1;
+    }
+    return found ? type : (memtype_t)(def & 0xFF);
+}
+
+/* Reads the live MTRRs and page attributes, so this reports what the CPU
+ * applies right now; the PAT/MTRR combination follows the SDM table. */
+memtype_t memtype_effective(uint32_t addr) {
+    memtype_t mtrr = mtrr_type(addr);
+    if (!paging_enabled()) {
+        return mtrr;
+    }
+    switch (paging_memtype(addr)) {
+        case MEMTYPE_UC: return MEMTYPE_UC;
+        case MEMTYPE_WC: return MEMTYPE_WC;
+        case MEMTYPE_UC_MINUS: return mtrr == MEMTYPE_WC ? MEMTYPE_WC : MEMTYPE_UC;
+        case MEMTYPE_WT: return (mtrr == MEMTYPE_WB || mtrr == MEMTYPE_WT) ? MEMTYPE_WT : MEMTYPE_UC;
+        default: return mtrr;
+    }
+}
+
+const char *memtype_name(memtype_t type) {
+    switch (type) {
+        case MEMTYPE_UC: return "UC";
+        case MEMTYPE_WC: return "WC";
+        case MEMTYPE_WT: return "WT";
+        case MEMTYPE_WP: return "WP";
+        case MEMTYPE_WB: return "WB";
+        case MEMTYPE_UC_MINUS: return "UC-";
+        default: return "?";
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    MEMTYPE_UC = 0,
+    MEMTYPE_WC = 1,
+    MEMTYPE_WT = 4,
+    MEMTYPE_WP = 5,
+    MEMTYPE_WB = 6,
+    MEMTYPE_UC_MINUS = 7
+} memtype_t;
+
+void memtype_init(void);
+void memtype_init_ap(void);
+int memtype_map_wc(uint32_t base, uint32_t size);
+int memtype_wc_available(void);
+void memtype_use_firmware(void);
+void memtype_use_wc(void);
+memtype_t memtype_effective(uint32_t addr);
+const char *memtype_name(memtype_t type);
@@ -0,0 +1,82 @@
+#include "metrics.h"
+#include "clock.h"
+#include "common.h"
+
+typedef struct {
+    metrics_t m;
+} __attribute__((aligned(64))) metrics_cpu_t;
+
+static metrics_cpu_t per_cpu[CPU_MAX];
+
+/* Written only by the GUI task after each composed frame. */
+static uint64_t frame_ns[METRIC_FRAMES];
+static uint64_t frame_end[METRIC_FRAMES];
+static uint32_t frame_seq;
+
+int metrics_have_tsc;
+
+void metrics_init(void) {
+    kmemset(per_cpu, 0, sizeof(per_cpu));
+    frame_seq = 0;
+    metrics_have_tsc = cpu_has(CPU_FEAT_TSC);
+}
+
+void metric_span(metric_span_t span, uint64_t cycles) {
+    uint32_t flags = cpu_irq_save();
+    metrics_t *m = &per_cpu[cpu_current()].m;
+    m->cycles[span] += cycles;
+    ++m->calls[span];
+    cpu_irq_restore(flags);
+}
+
+void metric_count(metric_counter_t counter, uint32_t n) {
+    uint32_t flags = cpu_irq_save();
+    per_cpu[cpu_current()].m.counts[counter] += n;
+    cpu_irq_restore(flags);
+}
+
+void metrics_sum(metrics_t *out) {
+    kmemset(out, 0, sizeof(*out));
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        const metrics_t *m = &per_cpu[cpu].m;
+        for (uint32_t i = 0; i < METRIC_SPANS; ++i) {
+            out->cycles[i] += m->cycles[i];
+            out->calls[i] += m->calls[i];
+        }
+        for (uint32_t i = 0; i < METRIC_COUNTERS; ++i) {
+            out->counts[i] += m->counts[i];
+        }
+    }
+}
+
+void metrics_frame(uint64_t compose_ns, uint64_t now_ns) {
+    uint32_t slot = frame_seq++ % METRIC_FRAMES;
+    frame_ns[slot] = compose_ns;
+    frame_end[slot] = now_ns;
+}
+
+/* FPS counts frames that ended within the last second; percentiles use
+ * nearest rank over a sorted copy of the window. */
+void metrics_frame_stats(frame_stats_t *out, uint64_t now_ns) {
+    uint64_t sorted[METRIC_FRAMES];
+    uint32_t count = frame_seq < METRIC_FRAMES ? frame_seq : METRIC_FRAMES;
+    kmemset(out, 0, sizeof(*out));
+    out->frames = frame_seq;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (now_ns - frame_end[i] <= NSEC_PER_SEC) {
+            ++out->fps;
+        }
+        uint64_t v = frame_ns[i];
+        uint32_t j = i;
+        while (j && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = v;
+    }
+    if (count) {
+        out->p50_ns = sorted[(count - 1) * 50 / 100];
+        out->p95_ns = sorted[(count - 1) * 95 / 100];
+        out->p99_ns = sorted[(count - 1) * 99 / 100];
+    }
+}
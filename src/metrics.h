@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "cpu.h"
+
+/* Cheap always-on counters for the sysmon dashboard. Each CPU adds into
+ * its own cache line with interrupts held off, so updates never contend;
+ * readers sum the lines without locking, which is fine for a display that
+ * refreshes twice a second. */
+
+/* Spans are timed in TSC cycles. The first entries follow panel_id_t so
+ * the compositor can index them directly. */
+typedef enum {
+    METRIC_SPAN_BAR,
+    METRIC_SPAN_SYSMON,
+    METRIC_SPAN_CONSOLE,
+    METRIC_SPAN_SHELL,
+    METRIC_SPAN_INSTALLER,
+    METRIC_SPAN_INPUT,
+    METRIC_SPANS
+} metric_span_t;
+
+typedef enum {
+    METRIC_HASHES,
+    METRIC_HASH_BYTES,
+    METRIC_BLOCKS_VERIFIED,
+    METRIC_COUNTERS
+} metric_counter_t;
+
+typedef struct {
+    uint64_t cycles[METRIC_SPANS];
+    uint32_t calls[METRIC_SPANS];
+    uint64_t counts[METRIC_COUNTERS];
+} metrics_t;
+
+/* Over the last METRIC_FRAMES composed frames. */
+#define METRIC_FRAMES 128
+
+typedef struct {
+    uint32_t fps;
+    uint32_t frames;
+    uint64_t p50_ns;
+    uint64_t p95_ns;
+    uint64_t p99_ns;
+} frame_stats_t;
+
+extern int metrics_have_tsc;
+
+static inline uint64_t metric_now(void) {
+    return metrics_have_tsc ? rdtsc() : 0;
+}
+
+void metrics_init(void);
+void metric_span(metric_span_t span, uint64_t cycles);
+void metric_count(metric_counter_t counter, uint32_t n);
+void metrics_sum(metrics_t *out);
+void metrics_frame(uint64_t compose_ns, uint64_t now_ns);
+void metrics_frame_stats(frame_stats_t *out, uint64_t now_ns);
@@ -30,3 +30,70 @@ typedef struct {
     uint8_t blue_size;
 } mb2_tag_fb_t;
 
+
+#define MB2_TAG_END 0
+#define MB2_TAG_MODULE 3
+#define MB2_TAG_MMAP 6
+#define MB2_TAG_FRAMEBUFFER 8
+#define MB2_TAG_ACPI_OLD 14
+#define MB2_TAG_ACPI_NEW 15
+
+#define MB2_MMAP_AVAILABLE 1
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint8_t rsdp[];
+} mb2_tag_acpi_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+} mb2_tag_module_t;
+
+typedef struct {
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} mb2_mmap_entry_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    uint8_t entries[];
+} mb2_tag_mmap_t;
+
+/* Returns the first tag of the given type after `after` (NULL to start
+ * from the beginning), so repeated tags such as modules can be walked. */
+static inline mb2_tag_t *mb2_find_next_tag(void *mb2, mb2_tag_t *after, uint32_t type) {
+    if (!mb2) {
+        return 0;
+    }
+    mb2_header_t *hdr = (mb2_header_t *)mb2;
+    uint8_t *tag_ptr = (uint8_t *)mb2 + 8;
+    uint8_t *end = (uint8_t *)mb2 + hdr->total_size;
+    if (after) {
+        tag_ptr = (uint8_t *)after + ((after->size + 7) & ~7u);
+    }
+    while (tag_ptr < end) {
+        mb2_tag_t *tag = (mb2_tag_t *)tag_ptr;
+        if (tag->type == MB2_TAG_END || tag->size < 8) {
+            break;
+        }
+        if (tag->type == type) {
+            return tag;
+        }
+        tag_ptr += (tag->size + 7) & ~7u;
+    }
+    return 0;
+}
+
+static inline mb2_tag_t *mb2_find_tag(void *mb2, uint32_t type) {
+    return mb2_find_next_tag(mb2, 0, type);
+}
@@ -0,0 +1,310 @@
+#include "paging.h"
+#include "pmm.h"
+#include "fb.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "console.h"
+#include "common.h"
+
+/* Two-level 32-bit paging. Physical memory is identity mapped because the
+ * frame table, slabs and page tables are all addressed physically. RAM and
+ * aligned MMIO use 4 MB PSE pages so the kernel image, heap and framebuffer
+ * each cost a handful of TLB entries; a 4 MB region is only split into a
+ * page table when something needs 4 KB granularity inside it. */
+#define PD_ENTRIES 1024
+#define PT_ENTRIES 1024
+#define PDE_LARGE 0x080u
+#define PDE_LARGE_PAT 0x1000u
+#define PTE_PAT 0x080u
+#define PTE_PWT 0x008u
+#define PTE_PCD 0x010u
+#define PTE_ATTR_MASK 0x11Fu
+#define PDE_TABLE_FLAGS (PAGE_PRESENT | PAGE_WRITE)
+#define FLUSH_ALL_PAGES 64
+
+#define CR0_WP (1u << 16)
+#define CR0_PG (1u << 31)
+#define CR4_PSE (1u << 4)
+#define CR4_PGE (1u << 7)
+
+static uint32_t page_dir[PD_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t ram_pdes;
+static uint32_t split_for_bench[PD_ENTRIES / 32];
+static int use_pse;
+static int use_pge;
+static int enabled;
+static int large_enabled;
+static uint32_t table_count;
+static uint32_t shootdowns;
+static spinlock_t paging_lock = SPINLOCK_INIT;
+
+static uint32_t cache_bits(page_cache_t cache) {
+    switch (cache) {
+        /* Without PAT, PWT alone would mean WT, so leave the type to the MTRRs. */
+        case PAGE_CACHE_WC: return cpu_has(CPU_FEAT_PAT) ? PTE_PWT : 0;
+        case PAGE_CACHE_UC_MINUS: return PTE_PCD;
+        case PAGE_CACHE_UC: return PTE_PCD | PTE_PWT;
+        default: return 0;
+    }
+}
+
+static uint32_t *table_of(uint32_t pde) {
+    return (uint32_t *)(uintptr_t)(pde & ~(PAGE_SIZE - 1));
+}
+
+/* Returns the page table behind a directory slot, splitting a large page
+ * into 1024 equivalent small ones or creating an empty table. */
+static uint32_t *ensure_table(uint32_t pdi) {
+    uint32_t pde = page_dir[pdi];
+    if ((pde & PAGE_PRESENT) && !(pde & PDE_LARGE)) {
+        return table_of(pde);
+    }
+    uint32_t frame = pmm_alloc_page();
+    if (!frame) {
+        return NULL;
+    }
+    uint32_t *table = (uint32_t *)(uintptr_t)frame;
+    if (pde & PAGE_PRESENT) {
+        uint32_t base = pde & ~(PAGE_LARGE_SIZE - 1);
+        uint32_t attrs = (pde & PTE_ATTR_MASK & ~PDE_LARGE) | ((pde & PDE_LARGE_PAT) ? PTE_PAT : 0);
+        for (uint32_t i = 0; i < PT_ENTRIES; ++i) {
+            table[i] = (base + i * PAGE_SIZE) | attrs;
+        }
+    } else {
+        kmemset(table, 0, PAGE_SIZE);
+    }
+    page_dir[pdi] = frame | PDE_TABLE_FLAGS;
+    ++table_count;
+    return table;
+}
+
+static void drop_table(uint32_t pdi) {
+    uint32_t pde = page_dir[pdi];
+    if ((pde & PAGE_PRESENT) && !(pde & PDE_LARGE)) {
+        pmm_free_page(pde & ~(PAGE_SIZE - 1));
+        --table_count;
+    }
+}
+
+static int map_pages(uint32_t virt, uint32_t phys, uint32_t pages, uint32_t attrs) {
+    while (pages) {
+        uint32_t pdi = virt >> 22;
+        if (use_pse && !(virt & (PAGE_LARGE_SIZE - 1)) && !(phys & (PAGE_LARGE_SIZE - 1)) &&
+            pages >= PT_ENTRIES) {
+            drop_table(pdi);
+            page_dir[pdi] = phys | attrs | (attrs & PAGE_PRESENT ? PDE_LARGE : 0);
+            virt += PAGE_LARGE_SIZE;
+            phys += PAGE_LARGE_SIZE;
+            pages -= PT_ENTRIES;
+            continue;
+        }
+        uint32_t *table = ensure_table(pdi);
+        if (!table) {
+            return -1;
+        }
+        table[(virt >> 12) & (PT_ENTRIES - 1)] = phys | attrs;
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+        --pages;
+    }
+    return 0;
+}
+
+static uint32_t page_count(uint32_t addr, uint32_t size) {
+    uint64_t end = ((uint64_t)addr + size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    return (uint32_t)((end - (addr & ~(PAGE_SIZE - 1))) >> 12);
+}
+
+int paging_map(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags, page_cache_t cache) {
+    uint32_t pages = page_count(virt, size);
+    virt &= ~(PAGE_SIZE - 1);
+    phys &= ~(PAGE_SIZE - 1);
+    uint32_t irq = spin_lock_irqsave(&paging_lock);
+    int rc = map_pages(virt, phys, pages, (flags & (PAGE_WRITE | PAGE_USER | PAGE_GLOBAL)) |
+                                              PAGE_PRESENT | cache_bits(cache));
+    spin_unlock_irqrestore(&paging_lock, irq);
+    if (enabled) {
+        tlb_shootdown(virt, pages << 12);
+    }
+    return rc;
+}
+
+int paging_unmap(uint32_t virt, uint32_t size) {
+    uint32_t pages = page_count(virt, size);
+    virt &= ~(PAGE_SIZE - 1);
+    uint32_t irq = spin_lock_irqsave(&paging_lock);
+    int rc = map_pages(virt, 0, pages, 0);
+    spin_unlock_irqrestore(&paging_lock, irq);
+    if (enabled) {
+        tlb_shootdown(virt, pages << 12);
+    }
+    return rc;
+}
+
+/* Only meaningful for identity-mapped ranges, which is all the kernel has. */
+int paging_set_cache(uint32_t addr, uint32_t size, page_cache_t cache) {
+    return paging_map(addr, addr, size, PAGE_WRITE | PAGE_GLOBAL, cache);
+}
+
+memtype_t paging_memtype(uint32_t virt) {
+    static const memtype_t pat[4] = {MEMTYPE_WB, MEMTYPE_WC, MEMTYPE_UC_MINUS, MEMTYPE_UC};
+    uint32_t entry = page_dir[virt >> 22];
+    if ((entry & PAGE_PRESENT) && !(entry & PDE_LARGE)) {
+        entry = table_of(entry)[(virt >> 12) & (PT_ENTRIES - 1)];
+    }
+    uint32_t index = ((entry & PTE_PCD) ? 2 : 0) | ((entry & PTE_PWT) ? 1 : 0);
+    if (!cpu_has(CPU_FEAT_PAT) && index == 1) {
+        return MEMTYPE_WT;
+    }
+    return pat[index];
+}
+
+void paging_init(void) {
+    kmemset(page_dir, 0, sizeof(page_dir));
+    kmemset(split_for_bench, 0, sizeof(split_for_bench));
+    table_count = 0;
+    shootdowns = 0;
+    use_pse = cpu_has(CPU_FEAT_PSE);
+    use_pge = cpu_has(CPU_FEAT_PGE);
+    uint32_t global = use_pge ? PAGE_GLOBAL : 0;
+
+    /* Everything usable (and the holes between) is WB and defers to the
+     * MTRRs; the rest of the 4 GB space is MMIO and starts out UC-, which
+     * still lets a firmware WC MTRR through. */
+    uint64_t ram_top = ((uint64_t)pmm_highest_addr() + PAGE_LARGE_SIZE - 1) & ~(uint64_t)(PAGE_LARGE_SIZE - 1);
+    ram_pdes = (uint32_t)(ram_top >> 22);
+    uint32_t rw = PAGE_PRESENT | PAGE_WRITE | global;
+    if (map_pages(0, 0, ram_pdes * PT_ENTRIES, rw) != 0 ||
+        map_pages(ram_pdes << 22, ram_pdes << 22, (PD_ENTRIES - ram_pdes) * PT_ENTRIES,
+                  rw | cache_bits(PAGE_CACHE_UC_MINUS)) != 0) {
+        log_event(LOG_ERROR, "Paging: out of memory for page tables");
+        return;
+    }
+    if (fb_vram() && fb_vram_size()) {
+        uint32_t base = (uint32_t)(uintptr_t)fb_vram();
+        map_pages(base & ~(PAGE_SIZE - 1), base & ~(PAGE_SIZE - 1), page_count(base, fb_vram_size()),
+                  rw | cache_bits(PAGE_CACHE_WC));
+    }
+
+    uint32_t cr4 = read_cr4();
+    if (use_pse) {
+        cr4 |= CR4_PSE;
+    }
+    write_cr4(cr4);
+    write_cr3((uint32_t)(uintptr_t)page_dir);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+    if (use_pge) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+    enabled = 1;
+    large_enabled = use_pse;
+
+    char msg[80];
+    char num[16];
+    kstrncpy(msg, "Paging on: ", sizeof(msg) - 1);
+    kstrcat(msg, use_pse ? "4 MB pages, " : "4 KB pages, ", sizeof(msg));
+    kitoa((int)(ram_pdes * 4), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " MB RAM mapped, ", sizeof(msg));
+    kitoa((int)table_count, num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " page tables", sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+}
+
+int paging_enabled(void) {
+    return enabled;
+}
+
+/* Benchmark switch: re-expresses the RAM identity map with 4 KB pages (or
+ * merges those tables back) without changing any translation. */
+int paging_use_large_pages(int enable) {
+    if (!enabled || !use_pse) {
+        return -1;
+    }
+    int rc = 0;
+    uint32_t irq = spin_lock_irqsave(&paging_lock);
+    for (uint32_t pdi = 0; pdi < ram_pdes; ++pdi) {
+        uint32_t bit = 1u << (pdi & 31);
+        uint32_t pde = page_dir[pdi];
+        if (!enable && (pde & PDE_LARGE)) {
+            if (!ensure_table(pdi)) {
+                rc = -1;
+                break;
+            }
+            split_for_bench[pdi >> 5] |= bit;
+        } else if (enable && (split_for_bench[pdi >> 5] & bit)) {
+            uint32_t first = table_of(pde)[0];
+            uint32_t attrs = (first & PTE_ATTR_MASK & ~PTE_PAT) | ((first & PTE_PAT) ? PDE_LARGE_PAT : 0);
+            drop_table(pdi);
+            page_dir[pdi] = (first & ~(PAGE_LARGE_SIZE - 1)) | attrs | PDE_LARGE;
+            split_for_bench[pdi >> 5] &= ~bit;
+        }
+    }
+    large_enabled = enable && rc == 0;
+    spin_unlock_irqrestore(&paging_lock, irq);
+    tlb_shootdown(0, 0xFFFFFFFFu);
+    return rc;
+}
+
+int paging_large_pages(void) {
+    return large_enabled;
+}
+
+void paging_get_stats(paging_stats_t *out) {
+    out->large_pages = 0;
+    for (uint32_t i = 0; i < PD_ENTRIES; ++i) {
+        if ((page_dir[i] & (PAGE_PRESENT | PDE_LARGE)) == (PAGE_PRESENT | PDE_LARGE)) {
+            ++out->large_pages;
+        }
+    }
+    out->page_tables = table_count;
+    out->shootdowns = shootdowns;
+}
+
+/* Global entries survive a CR3 reload, so toggling PGE is the only way to
+ * drop them all. */
+void tlb_flush_all(void) {
+    uint32_t irq = cpu_irq_save();
+    if (use_pge) {
+        uint32_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        write_cr3(read_cr3());
+    }
+    cpu_irq_restore(irq);
+}
+
+void tlb_flush_range(uint32_t virt, uint32_t size) {
+    uint32_t pages = page_count(virt, size);
+    if (pages > FLUSH_ALL_PAGES) {
+        tlb_flush_all();
+        return;
+    }
+    virt &= ~(PAGE_SIZE - 1);
+    for (uint32_t i = 0; i < pages; ++i) {
+        invlpg(virt + i * PAGE_SIZE);
+    }
+}
+
+typedef struct {
+    uint32_t virt;
+    uint32_t size;
+} flush_request_t;
+
+static void flush_ipi(void *arg) {
+    const flush_request_t *req = (const flush_request_t *)arg;
+    tlb_flush_range(req->virt, req->size);
+}
+
+/* Every mapping change funnels through here: the range is flushed locally
+ * and on every other online CPU before the caller goes on, so nobody can
+ * still reach a page that is about to be reused. */
+void tlb_shootdown(uint32_t virt, uint32_t size) {
+    __atomic_add_fetch(&shootdowns, 1, __ATOMIC_RELAXED);
+    tlb_flush_range(virt, size);
+    flush_request_t req = {virt, size};
+    smp_call_others(flush_ipi, &req);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include "memtype.h"
+
+#define PAGE_SIZE 4096u
+#define PAGE_LARGE_SIZE (4u * 1024 * 1024)
+
+#define PAGE_PRESENT 0x001u
+#define PAGE_WRITE 0x002u
+#define PAGE_USER 0x004u
+#define PAGE_GLOBAL 0x100u
+
+/* Cache policy through PAT entries 0-3, as programmed by memtype_init. */
+typedef enum {
+    PAGE_CACHE_WB,
+    PAGE_CACHE_WC,
+    PAGE_CACHE_UC_MINUS,
+    PAGE_CACHE_UC
+} page_cache_t;
+
+typedef struct {
+    uint32_t large_pages;
+    uint32_t page_tables;
+    uint32_t shootdowns;
+} paging_stats_t;
+
+void paging_init(void);
+int paging_enabled(void);
+int paging_map(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags, page_cache_t cache);
+int paging_unmap(uint32_t virt, uint32_t size);
+int paging_set_cache(uint32_t addr, uint32_t size, page_cache_t cache);
+memtype_t paging_memtype(uint32_t virt);
+int paging_use_large_pages(int enable);
+int paging_large_pages(void);
+void paging_get_stats(paging_stats_t *out);
+
+void tlb_flush_all(void);
+void tlb_flush_range(uint32_t virt, uint32_t size);
+void tlb_shootdown(uint32_t virt, uint32_t size);
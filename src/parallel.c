@@ -0,0 +1,182 @@
+#include "parallel.h"
+#include "wsdeque.h"
+#include "sched.h"
+#include "smp.h"
+#include "slab.h"
+#include "cpu.h"
+#include "console.h"
+#include "common.h"
+
+/* Fork-join over index ranges. The caller cuts the range into chunks,
+ * pushes them onto its own CPU's deque and works through them from the
+ * bottom while one worker task per CPU steals from the top of every deque.
+ * Owner operations run with preemption disabled, which makes whatever is
+ * running on a CPU the single owner Chase-Lev requires. */
+#define PARALLEL_MAX_CHUNKS 128
+#define PARALLEL_WORKER_PRIO SCHED_PRIO_NORMAL
+
+typedef struct {
+    parallel_fn_t fn;
+    void *arg;
+    uint32_t remaining;
+    sched_event_t done;
+} parallel_job_t;
+
+typedef struct {
+    parallel_job_t *job;
+    uint32_t begin;
+    uint32_t end;
+} parallel_chunk_t;
+
+typedef struct {
+    wsdeque_t deque;
+    sched_event_t wake;
+    task_t *worker;
+} parallel_cpu_t;
+
+static parallel_cpu_t cpus[CPU_MAX];
+static uint32_t cpu_limit;
+static parallel_stats_t stats;
+
+/* Whoever finishes the last chunk signals the job; the caller waits for
+ * that signal rather than for the counter, so the job on its stack is not
+ * released while the signaller still holds the event. */
+static void run_chunk(parallel_chunk_t *chunk) {
+    parallel_job_t *job = chunk->job;
+    job->fn(job->arg, chunk->begin, chunk->end);
+    if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        sched_event_signal(&job->done);
+    }
+}
+
+static parallel_chunk_t *pop_local(void) {
+    sched_preempt_disable();
+    parallel_chunk_t *chunk = wsdeque_pop(&cpus[cpu_current()].deque);
+    sched_preempt_enable();
+    return chunk;
+}
+
+static parallel_chunk_t *steal_any(uint32_t self) {
+    for (uint32_t i = 1; i <= CPU_MAX; ++i) {
+        parallel_chunk_t *chunk = wsdeque_steal(&cpus[(self + i) % CPU_MAX].deque);
+        if (chunk) {
+            __atomic_add_fetch(&stats.steals, 1, __ATOMIC_RELAXED);
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+static void worker_task(void *arg) {
+    parallel_cpu_t *pc = (parallel_cpu_t *)arg;
+    uint32_t cpu = (uint32_t)(pc - cpus);
+    for (;;) {
+        sched_event_wait(&pc->wake);
+        if (cpu >= cpu_limit) {
+            continue;
+        }
+        parallel_chunk_t *chunk;
+        while ((chunk = pop_local()) != NULL || (chunk = steal_any(cpu)) != NULL) {
+            run_chunk(chunk);
+        }
+    }
+}
+
+/* One pinned worker per online CPU; call after smp_init. */
+void parallel_init(void) {
+    kmemset(&stats, 0, sizeof(stats));
+    uint32_t online = smp_online_mask();
+    cpu_limit = smp_cpu_count();
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        parallel_cpu_t *pc = &cpus[cpu];
+        wsdeque_init(&pc->deque);
+        sched_event_init(&pc->wake);
+        pc->worker = NULL;
+        if (!(online & (1u << cpu))) {
+            continue;
+        }
+        char name[TASK_NAME_MAX];
+        char num[8];
+        kstrncpy(name, "parallel", sizeof(name) - 1);
+        kitoa((int)cpu, num, sizeof(num));
+        kstrcat(name, num, sizeof(name));
+        pc->worker = task_spawn_on(name, worker_task, pc, PARALLEL_WORKER_PRIO, 1u << cpu);
+        if (pc->worker) {
+            pc->worker->flags |= TASK_FLAG_SYSTEM;
+        }
+    }
+}
+
+/* Runs fn over [0, count) in chunks of at least grain indices and returns
+ * when every chunk is done. Falls back to one inline call when only one
+ * CPU may take part or the range is a single chunk. */
+void parallel_for(uint32_t count, uint32_t grain, parallel_fn_t fn, void *arg) {
+    if (!count) {
+        return;
+    }
+    if (!grain) {
+        grain = 1;
+    }
+    uint32_t chunks = (count + grain - 1) / grain;
+    if (chunks > PARALLEL_MAX_CHUNKS) {
+        grain = (count + PARALLEL_MAX_CHUNKS - 1) / PARALLEL_MAX_CHUNKS;
+        chunks = (count + grain - 1) / grain;
+    }
+    parallel_chunk_t *chunk = chunks > 1 && cpu_limit > 1 ? kmalloc(chunks * sizeof(*chunk)) : NULL;
+    __atomic_add_fetch(&stats.jobs, 1, __ATOMIC_RELAXED);
+    if (!chunk) {
+        fn(arg, 0, count);
+        return;
+    }
+    __atomic_add_fetch(&stats.chunks, chunks, __ATOMIC_RELAXED);
+
+    parallel_job_t job;
+    job.fn = fn;
+    job.arg = arg;
+    job.remaining = chunks;
+    sched_event_init(&job.done);
+    for (uint32_t i = 0; i < chunks; ++i) {
+        chunk[i].job = &job;
+        chunk[i].begin = i * grain;
+        chunk[i].end = i + 1 < chunks ? (i + 1) * grain : count;
+    }
+
+    /* Pushed in reverse so the caller pops from the start of the range and
+     * thieves take from the end. */
+    uint32_t pushed = 0;
+    sched_preempt_disable();
+    wsdeque_t *deque = &cpus[cpu_current()].deque;
+    while (pushed < chunks && wsdeque_push(deque, &chunk[chunks - 1 - pushed]) == 0) {
+        ++pushed;
+    }
+    sched_preempt_enable();
+    for (uint32_t cpu = 0; cpu < cpu_limit; ++cpu) {
+        if (cpus[cpu].worker) {
+            sched_event_signal(&cpus[cpu].wake);
+        }
+    }
+
+    for (uint32_t i = chunks - pushed; i-- > 0;) {
+        run_chunk(&chunk[i]);
+    }
+    parallel_chunk_t *next;
+    while ((next = pop_local()) != NULL) {
+        run_chunk(next);
+    }
+    sched_event_wait(&job.done);
+    kfree(chunk);
+}
+
+uint32_t parallel_cpus(void) {
+    return cpu_limit;
+}
+
+/* Caps how many CPUs' workers take part, for scaling measurements. */
+void parallel_set_cpus(uint32_t count) {
+    uint32_t max = smp_cpu_count();
+    cpu_limit = count < 1 ? 1 : count > max ? max : count;
+}
+
+void parallel_get_stats(parallel_stats_t *out) {
+    *out = stats;
+}
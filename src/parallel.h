@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Body of a parallel loop: handles indices [begin, end). Runs in task
+ * context on any CPU, possibly several chunks at once. */
+typedef void (*parallel_fn_t)(void *arg, uint32_t begin, uint32_t end);
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t chunks;
+    uint32_t steals;
+} parallel_stats_t;
+
+void parallel_init(void);
+void parallel_for(uint32_t count, uint32_t grain, parallel_fn_t fn, void *arg);
+uint32_t parallel_cpus(void);
+void parallel_set_cpus(uint32_t count);
+void parallel_get_stats(parallel_stats_t *out);
@@ -0,0 +1,26 @@
+#include "pit.h"
+#include "io.h"
+
+#define PIT_CH0_DATA 0x40
+#define PIT_CMD 0x43
+#define PIT_CMD_CH0_MODE0 0x30
+
+/* Mode 0 raises OUT0 (IRQ0) once when the count reaches zero and then
+ * stays quiet until reloaded, which gives a one-shot interrupt. */
+void pit_oneshot(uint32_t count) {
+    if (count == 0) {
+        count = 1;
+    }
+    if (count > PIT_MAX_COUNT) {
+        count = PIT_MAX_COUNT;
+    }
+    outb(PIT_CMD, PIT_CMD_CH0_MODE0);
+    outb(PIT_CH0_DATA, (uint8_t)(count & 0xFF));
+    outb(PIT_CH0_DATA, (uint8_t)(count >> 8));
+}
+
+/* Writing the mode word alone parks channel 0 with OUT low until the next
+ * count is loaded. */
+void pit_stop(void) {
+    outb(PIT_CMD, PIT_CMD_CH0_MODE0);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+#define PIT_HZ 1193182u
+#define PIT_MAX_COUNT 0xFFFFu
+
+void pit_oneshot(uint32_t count);
+void pit_stop(void);
@@ -0,0 +1,342 @@
+#include "pmm.h"
+#include "multiboot2.h"
+#include "fb.h"
+#include "spinlock.h"
+#include "console.h"
+#include "common.h"
+
+/* Binary buddy allocator over 4 KiB frames. Per-frame descriptors live in
+ * a table carved out of the first usable RAM above the kernel and are
+ * sized to the highest usable address, so the BSS cost is constant. */
+#define PMM_MAX_RESERVED 16
+#define PMM_LOW_MEMORY 0x100000u
+#define PMM_NONE 0xFFFFFFFFu
+
+#define FRAME_FREE 0x01
+#define FRAME_RESERVED 0x02
+#define FRAME_ALLOCATED 0x04
+
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+    void *owner;
+    uint8_t order;
+    uint8_t flags;
+    uint16_t unused;
+} pmm_frame_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} pmm_range_t;
+
+extern uint8_t _kernel_start[];
+extern uint8_t _kernel_end[];
+
+static pmm_frame_t *frames;
+static uint32_t frame_count;
+static uint32_t free_head[PMM_MAX_ORDER + 1];
+static uint32_t free_blocks[PMM_MAX_ORDER + 1];
+static uint32_t free_pages;
+static uint32_t usable_pages;
+static pmm_range_t reserved[PMM_MAX_RESERVED];
+static int reserved_count;
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+
+static void reserve(uint64_t start, uint64_t end) {
+    if (end > 0x100000000ull) {
+        end = 0x100000000ull;
+    }
+    if (start >= end || reserved_count >= PMM_MAX_RESERVED) {
+        return;
+    }
+    reserved[reserved_count].start = (uint32_t)start & ~(PMM_PAGE_SIZE - 1);
+    reserved[reserved_count].end = (uint32_t)((end + PMM_PAGE_SIZE - 1) & ~(uint64_t)(PMM_PAGE_SIZE - 1));
+    ++reserved_count;
+}
+
+/* Lowest reserved range overlapping [start, end), or NULL. */
+static const pmm_range_t *overlap(uint32_t start, uint32_t end) {
+    const pmm_range_t *best = NULL;
+    for (int i = 0; i < reserved_count; ++i) {
+        if (start < reserved[i].end && reserved[i].start < end &&
+            (!best || reserved[i].start < best->start)) {
+            best = &reserved[i];
+        }
+    }
+    return best;
+}
+
+static void list_push(uint32_t frame, uint32_t order) {
+    pmm_frame_t *f = &frames[frame];
+    f->flags = FRAME_FREE;
+    f->order = (uint8_t)order;
+    f->prev = PMM_NONE;
+    f->next = free_head[order];
+    if (f->next != PMM_NONE) {
+        frames[f->next].prev = frame;
+    }
+    free_head[order] = frame;
+    ++free_blocks[order];
+}
+
+static void list_remove(uint32_t frame) {
+    pmm_frame_t *f = &frames[frame];
+    if (f->prev != PMM_NONE) {
+        frames[f->prev].next = f->next;
+    } else {
+        free_head[f->order] = f->next;
+    }
+    if (f->next != PMM_NONE) {
+        frames[f->next].prev = f->prev;
+    }
+    f->flags = 0;
+    --free_blocks[f->order];
+}
+
+/* Merge with the buddy for as long as it is a free block of the same
+ * order; each step is O(1), so a free is O(log n). */
+static void free_block(uint32_t frame, uint32_t order) {
+    free_pages += 1u << order;
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy >= frame_count || frames[buddy].flags != FRAME_FREE || frames[buddy].order != order) {
+            break;
+        }
+        list_remove(buddy);
+        frame &= ~(1u << order);
+        ++order;
+    }
+    list_push(frame, order);
+}
+
+static void add_free_run(uint32_t first, uint32_t end) {
+    while (first < end) {
+        uint32_t order = PMM_MAX_ORDER;
+        while (order && ((first & ((1u << order) - 1)) || first + (1u << order) > end)) {
+            --order;
+        }
+        for (uint32_t i = 0; i < (1u << order); ++i) {
+            frames[first + i].flags = 0;
+        }
+        free_block(first, order);
+        usable_pages += 1u << order;
+        first += 1u << order;
+    }
+}
+
+static mb2_mmap_entry_t *mmap_entry(mb2_tag_mmap_t *tag, uint32_t i) {
+    return (mb2_mmap_entry_t *)(tag->entries + i * tag->entry_size);
+}
+
+static uint32_t mmap_count(mb2_tag_mmap_t *tag) {
+    return (tag->size - sizeof(*tag)) / tag->entry_size;
+}
+
+/* Available regions clipped to the 32-bit physical space we can address
+ * without PAE. */
+static int usable_region(const mb2_mmap_entry_t *e, uint32_t *start, uint32_t *end) {
+    if (e->type != MB2_MMAP_AVAILABLE || e->base_addr >= 0x100000000ull) {
+        return 0;
+    }
+    uint64_t top = e->base_addr + e->length;
+    if (top > 0x100000000ull - PMM_PAGE_SIZE) {
+        top = 0x100000000ull - PMM_PAGE_SIZE;
+    }
+    uint32_t s = ((uint32_t)e->base_addr + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+    uint32_t t = (uint32_t)top & ~(PMM_PAGE_SIZE - 1);
+    if (s >= t) {
+        return 0;
+    }
+    *start = s;
+    *end = t;
+    return 1;
+}
+
+static uint32_t place_table(mb2_tag_mmap_t *tag, uint32_t bytes) {
+    for (uint32_t i = 0; i < mmap_count(tag); ++i) {
+        uint32_t start, end;
+        if (!usable_region(mmap_entry(tag, i), &start, &end)) {
+            continue;
+        }
+        const pmm_range_t *hit;
+        while (start + bytes > start && start + bytes <= end && (hit = overlap(start, start + bytes)) != NULL) {
+            start = hit->end;
+        }
+        if (start + bytes > start && start + bytes <= end) {
+            return start;
+        }
+    }
+    return 0;
+}
+
+int pmm_init(void *mb2) {
+    mb2_tag_mmap_t *tag = (mb2_tag_mmap_t *)mb2_find_tag(mb2, MB2_TAG_MMAP);
+    if (!tag || tag->entry_size < sizeof(mb2_mmap_entry_t)) {
+        log_event(LOG_ERROR, "PMM: no multiboot2 memory map");
+        return -1;
+    }
+
+    reserved_count = 0;
+    reserve(0, PMM_LOW_MEMORY);
+    reserve((uint32_t)(uintptr_t)_kernel_start, (uint32_t)(uintptr_t)_kernel_end);
+    reserve((uint32_t)(uintptr_t)mb2, (uint32_t)(uintptr_t)mb2 + ((mb2_header_t *)mb2)->total_size);
+    for (mb2_tag_t *t = mb2_find_tag(mb2, MB2_TAG_MODULE); t; t = mb2_find_next_tag(mb2, t, MB2_TAG_MODULE)) {
+        mb2_tag_module_t *mod = (mb2_tag_module_t *)t;
+        reserve(mod->mod_start, mod->mod_end);
+    }
+    if (fb_vram()) {
+        reserve((uint32_t)(uintptr_t)fb_vram(), (uint64_t)(uint32_t)(uintptr_t)fb_vram() + fb_vram_size());
+    }
+
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < mmap_count(tag); ++i) {
+        uint32_t start, end;
+        if (usable_region(mmap_entry(tag, i), &start, &end) && end > top) {
+            top = end;
+        }
+    }
+    frame_count = top >> PMM_PAGE_SHIFT;
+    uint32_t table_bytes = (frame_count * sizeof(pmm_frame_t) + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+    uint32_t table = place_table(tag, table_bytes);
+    if (!frame_count || !table) {
+        log_event(LOG_ERROR, "PMM: no room for the frame table");
+        return -1;
+    }
+    frames = (pmm_frame_t *)(uintptr_t)table;
+    reserve(table, (uint64_t)table + table_bytes);
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        frames[i].flags = FRAME_RESERVED;
+        frames[i].order = 0;
+        frames[i].owner = NULL;
+    }
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; ++o) {
+        free_head[o] = PMM_NONE;
+        free_blocks[o] = 0;
+    }
+    free_pages = 0;
+    usable_pages = 0;
+
+    for (uint32_t i = 0; i < mmap_count(tag); ++i) {
+        uint32_t start, end;
+        if (!usable_region(mmap_entry(tag, i), &start, &end)) {
+            continue;
+        }
+        while (start < end) {
+            const pmm_range_t *hit = overlap(start, end);
+            if (!hit) {
+                add_free_run(start >> PMM_PAGE_SHIFT, end >> PMM_PAGE_SHIFT);
+                break;
+            }
+            if (hit->start > start) {
+                add_free_run(start >> PMM_PAGE_SHIFT, hit->start >> PMM_PAGE_SHIFT);
+            }
+            start = hit->end;
+        }
+    }
+
+    char msg[64];
+    char num[16];
+    kstrncpy(msg, "PMM: ", sizeof(msg) - 1);
+    kitoa((int)(free_pages >> 8), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " MB free of ", sizeof(msg));
+    kitoa((int)(top >> 20), num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, " MB", sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+    return 0;
+}
+
+/* Smallest non-empty order at or above the request, split down; at most
+ * PMM_MAX_ORDER steps either way. */
+uint32_t pmm_alloc_pages(uint32_t order) {
+    if (order > PMM_MAX_ORDER || !frames) {
+        return 0;
+    }
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    uint32_t o = order;
+    while (o <= PMM_MAX_ORDER && free_head[o] == PMM_NONE) {
+        ++o;
+    }
+    if (o > PMM_MAX_ORDER) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+    uint32_t frame = free_head[o];
+    list_remove(frame);
+    while (o > order) {
+        --o;
+        list_push(frame + (1u << o), o);
+    }
+    frames[frame].order = (uint8_t)order;
+    frames[frame].flags = FRAME_ALLOCATED;
+    free_pages -= 1u << order;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return frame << PMM_PAGE_SHIFT;
+}
+
+void pmm_free_pages(uint32_t addr, uint32_t order) {
+    uint32_t frame = addr >> PMM_PAGE_SHIFT;
+    if (!addr || order > PMM_MAX_ORDER || frame >= frame_count || (frame & ((1u << order) - 1))) {
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    if (frames[frame].flags == FRAME_ALLOCATED && frames[frame].order == order) {
+        frames[frame].flags = 0;
+        for (uint32_t i = 0; i < (1u << order); ++i) {
+            frames[frame + i].owner = NULL;
+        }
+        free_block(frame, order);
+    } else {
+        log_event(LOG_ERROR, "PMM: bad free");
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/* Order of the allocated block starting at addr, or -1. */
+int pmm_block_order(uint32_t addr) {
+    uint32_t frame = addr >> PMM_PAGE_SHIFT;
+    if (frame >= frame_count || frames[frame].flags != FRAME_ALLOCATED) {
+        return -1;
+    }
+    return frames[frame].order;
+}
+
+/* Lets the allocator built on top find its metadata from any address in
+ * the block, the way the heap maps an object back to its slab. */
+void pmm_set_owner(uint32_t addr, uint32_t pages, void *owner) {
+    uint32_t frame = addr >> PMM_PAGE_SHIFT;
+    for (uint32_t i = 0; i < pages && frame + i < frame_count; ++i) {
+        frames[frame + i].owner = owner;
+    }
+}
+
+void *pmm_owner(uint32_t addr) {
+    uint32_t frame = addr >> PMM_PAGE_SHIFT;
+    return frame < frame_count ? frames[frame].owner : NULL;
+}
+
+uint32_t pmm_alloc_page(void) {
+    return pmm_alloc_pages(0);
+}
+
+void pmm_free_page(uint32_t addr) {
+    pmm_free_pages(addr, 0);
+}
+
+uint32_t pmm_highest_addr(void) {
+    return frame_count << PMM_PAGE_SHIFT;
+}
+
+void pmm_get_stats(pmm_stats_t *out) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    out->total_pages = usable_pages;
+    out->free_pages = free_pages;
+    out->reserved_pages = frame_count - usable_pages;
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; ++o) {
+        out->free_blocks[o] = free_blocks[o];
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
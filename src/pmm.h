@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#define PMM_PAGE_SIZE 4096u
+#define PMM_PAGE_SHIFT 12
+#define PMM_MAX_ORDER 10
+
+typedef struct {
+    uint32_t total_pages;
+    uint32_t free_pages;
+    uint32_t reserved_pages;
+    uint32_t free_blocks[PMM_MAX_ORDER + 1];
+} pmm_stats_t;
+
+int pmm_init(void *mb2);
+uint32_t pmm_alloc_pages(uint32_t order);
+void pmm_free_pages(uint32_t addr, uint32_t order);
+int pmm_block_order(uint32_t addr);
+void pmm_set_owner(uint32_t addr, uint32_t pages, void *owner);
+void *pmm_owner(uint32_t addr);
+uint32_t pmm_alloc_page(void);
+void pmm_free_page(uint32_t addr);
+uint32_t pmm_highest_addr(void);
+void pmm_get_stats(pmm_stats_t *out);
@@ -1,34 +1,127 @@
 #include "process.h"
+#include "sched.h"
+#include "clock.h"
 #include "common.h"
 #include "console.h"
 
-static const proc_t demo_table[] = {
-    {1, "init", 4, 512},
-    {4, "sysmon", 2, 256},
-    {7, "console", 1, 192},
-    {12, "shell", 3, 320},
-    {20, "installer", 0, 0}
-};
+/* CPU% is the share of TSC cycles each task ran over a window of at
+ * least PROC_SAMPLE_MS; callers polling faster see the last window. */
+#define PROC_MAX 32
+#define PROC_SAMPLE_MS 500
+
+typedef struct {
+    uint32_t pid;
+    uint64_t cycles;
+    int pct;
+} proc_sample_t;
+
+static proc_sample_t samples[PROC_MAX];
+static int sample_count;
+static uint64_t sample_tsc;
+static uint64_t sample_ns;
+
+static proc_sample_t *find_sample(uint32_t pid) {
+    for (int i = 0; i < sample_count; ++i) {
+        if (samples[i].pid == pid) {
+            return &samples[i];
+        }
+    }
+    return NULL;
+}
+
+static int share_pct(uint64_t part, uint64_t whole) {
+    uint32_t shift = 0;
+    while ((whole >> shift) > 0xFFFFFFFFu) {
+        ++shift;
+    }
+    if (!(whole >> shift)) {
+        return 0;
+    }
+    uint64_t pct = kdiv64((part >> shift) * 100, (uint32_t)(whole >> shift), 0);
+    return pct > 100 ? 100 : (int)pct;
+}
+
+static void resample(const task_info_t *tasks, int count, uint64_t now) {
+    uint64_t window = now - sample_tsc;
+    proc_sample_t next[PROC_MAX];
+    for (int i = 0; i < count; ++i) {
+        proc_sample_t *old = find_sample(tasks[i].pid);
+        uint64_t delta = tasks[i].cycles - (old ? old->cycles : 0);
+        next[i].pid = tasks[i].pid;
+        next[i].cycles = tasks[i].cycles;
+        next[i].pct = sample_tsc ? share_pct(delta, window) : 0;
+    }
+    kmemcpy(samples, next, sizeof(next[0]) * (size_t)count);
+    sample_count = count;
+    sample_tsc = now;
+}
+
+static char state_char(uint8_t state) {
+    switch (state) {
+        case TASK_RUNNING: return 'R';
+        case TASK_READY: return 'r';
+        case TASK_BLOCKED: return 'S';
+        default: return 'X';
+    }
+}
 
 int proc_enumerate(proc_t *out, int max) {
     if (!out || max <= 0) {
         return 0;
     }
-    int count = (int)ARRAY_SIZE(demo_table);
+    task_info_t tasks[PROC_MAX];
+    int count = sched_snapshot(tasks, PROC_MAX);
+    uint64_t now_ns = ktime_ns();
+    if (!sample_tsc || now_ns - sample_ns >= (uint64_t)PROC_SAMPLE_MS * NSEC_PER_MSEC) {
+        resample(tasks, count, rdtsc());
+        sample_ns = now_ns;
+    }
     if (count > max) {
         count = max;
     }
+    /* The task list is newest-first; show it in creation order. */
     for (int i = 0; i < count; ++i) {
-        out[i] = demo_table[i];
+        const task_info_t *t = &tasks[count - 1 - i];
+        proc_sample_t *s = find_sample(t->pid);
+        out[i].pid = (int)t->pid;
+        kstrncpy(out[i].name, t->name, sizeof(out[i].name) - 1);
+        out[i].name[sizeof(out[i].name) - 1] = '\0';
+        out[i].cpu_pct = s ? s->pct : 0;
+        out[i].mem_kb = (int)(t->stack_bytes / 1024);
+        out[i].prio = t->prio;
+        out[i].cpu = t->cpu;
+        out[i].state = state_char(t->state);
     }
     return count;
 }
 
+int proc_count(void) {
+    return (int)sched_task_count();
+}
+
+/* Children go first so no task outlives its parent mid-teardown. */
 int proc_kill_tree(int pid) {
+    task_info_t tasks[PROC_MAX];
+    int count = sched_snapshot(tasks, PROC_MAX);
+    int killed = 0;
+    for (int i = 0; i < count; ++i) {
+        if ((int)tasks[i].parent == pid && tasks[i].pid != (uint32_t)pid) {
+            killed += proc_kill_tree((int)tasks[i].pid) > 0;
+        }
+    }
+
     char msg[64];
-    kstrncpy(msg, "Kill request for PID ", sizeof(msg));
-    kitoa(pid, msg + kstrlen(msg), sizeof(msg) - kstrlen(msg));
-    log_event(LOG_WARN, msg);
-    return 0;
+    char num[16];
+    int rc = task_kill((uint32_t)pid);
+    kitoa(pid, num, sizeof(num));
+    if (rc == 0) {
+        kstrncpy(msg, "Killed PID ", sizeof(msg) - 1);
+        kstrcat(msg, num, sizeof(msg));
+        log_text(LOG_SUCCESS, msg);
+        return killed + 1;
+    }
+    kstrncpy(msg, rc == -2 ? "Refusing to kill system PID " : "No such PID ", sizeof(msg) - 1);
+    kstrcat(msg, num, sizeof(msg));
+    log_text(LOG_WARN, msg);
+    return killed ? killed : -1;
 }
-
@@ -7,8 +7,11 @@ typedef struct {
     char name[64];
     int cpu_pct;
     int mem_kb;
+    int prio;
+    int cpu;
+    char state;
 } proc_t;
 
 int proc_enumerate(proc_t *out, int max);
+int proc_count(void);
 int proc_kill_tree(int pid);
-
@@ -0,0 +1,172 @@
+#include "prof.h"
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "serial.h"
+#include "smp.h"
+#include "timer.h"
+#include "common.h"
+
+#define PROF_DUMP_VERSION 1
+#define PROF_STACK_SPAN 8192
+#define PROF_PROBES 8
+
+typedef struct {
+    uint32_t count;
+    uint32_t depth;
+    uint32_t pc[PROF_DEPTH];
+} prof_slot_t;
+
+/* Only the owning CPU writes its table, from its timer interrupt, so
+ * samples take no lock. */
+typedef struct {
+    prof_slot_t slots[PROF_SLOTS];
+    uint32_t samples;
+    uint32_t stacks;
+    uint32_t dropped;
+} __attribute__((aligned(64))) prof_cpu_t;
+
+static prof_cpu_t tables[CPU_MAX];
+static uint32_t prof_hz;
+static int running;
+
+/* Follows saved EBPs upward from the interrupted frame. A link that does
+ * not climb, is misaligned or leaves the span above the interrupted stack
+ * pointer ends the walk, so code built without frame pointers only costs
+ * depth. */
+static uint32_t walk_stack(const isr_frame_t *frame, uint32_t *pc) {
+    uint32_t depth = 0;
+    pc[depth++] = frame->eip;
+    uint32_t low = (uint32_t)(uintptr_t)(&frame->eflags + 1);
+    uint32_t high = low + PROF_STACK_SPAN;
+    uint32_t ebp = frame->ebp;
+    while (depth < PROF_DEPTH && ebp >= low && ebp + 8 <= high && !(ebp & 3)) {
+        const uint32_t *link = (const uint32_t *)(uintptr_t)ebp;
+        if (!link[1]) {
+            break;
+        }
+        pc[depth++] = link[1];
+        if (link[0] <= ebp) {
+            break;
+        }
+        ebp = link[0];
+    }
+    return depth;
+}
+
+static uint32_t hash_stack(const uint32_t *pc, uint32_t depth) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < depth; ++i) {
+        hash = (hash ^ pc[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void sample(isr_frame_t *frame) {
+    prof_cpu_t *table = &tables[cpu_current()];
+    uint32_t pc[PROF_DEPTH];
+    uint32_t depth = walk_stack(frame, pc);
+    uint32_t hash = hash_stack(pc, depth);
+    ++table->samples;
+    for (uint32_t probe = 0; probe < PROF_PROBES; ++probe) {
+        prof_slot_t *slot = &table->slots[(hash + probe) & (PROF_SLOTS - 1)];
+        if (!slot->count) {
+            slot->depth = depth;
+            for (uint32_t i = 0; i < depth; ++i) {
+                slot->pc[i] = pc[i];
+            }
+            slot->count = 1;
+            ++table->stacks;
+            return;
+        }
+        if (slot->depth == depth && !kmemcmp(slot->pc, pc, depth * sizeof(uint32_t))) {
+            ++slot->count;
+            return;
+        }
+    }
+    ++table->dropped;
+}
+
+/* Clears the tables and starts sampling every CPU at hz. */
+int prof_start(uint32_t hz) {
+    if (!clock_source_khz()) {
+        log_event(LOG_WARN, "Profiler: no timer to sample from");
+        return -1;
+    }
+    if (hz < PROF_MIN_HZ || hz > PROF_MAX_HZ) {
+        log_event(LOG_WARN, "Profiler: rate must be %u..%u Hz", PROF_MIN_HZ, PROF_MAX_HZ);
+        return -1;
+    }
+    prof_stop();
+    kmemset(tables, 0, sizeof(tables));
+    prof_hz = hz;
+    running = 1;
+    timer_set_sampler(sample, NSEC_PER_SEC / hz);
+    return 0;
+}
+
+/* Returns once no CPU can still be inside sample(): timer_set_sampler
+ * reaches every CPU through an interrupt-context call. */
+void prof_stop(void) {
+    if (running) {
+        timer_set_sampler(NULL, 0);
+        running = 0;
+    }
+}
+
+static void emit_u32(uint32_t value) {
+    serial_write_raw(&value, sizeof(value));
+}
+
+/* Stops sampling and writes the tables to COM1 in raw mode as
+ *   "KPRF" version hz cpus {cpu stacks dropped {count depth pc...}...}... "KEND"
+ * with little-endian words. Returns the number of samples written. */
+uint32_t prof_dump(void) {
+    if (!serial_present()) {
+        log_event(LOG_WARN, "Profiler: no serial port");
+        return 0;
+    }
+    prof_stop();
+    uint32_t cpus = smp_cpu_count();
+    if (cpus > CPU_MAX) {
+        cpus = CPU_MAX;
+    }
+    serial_mode_t saved = serial_mode();
+    serial_set_mode(SERIAL_MODE_RAW);
+    serial_write_raw("KPRF", 4);
+    emit_u32(PROF_DUMP_VERSION);
+    emit_u32(prof_hz);
+    emit_u32(cpus);
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        prof_cpu_t *table = &tables[cpu];
+        emit_u32(cpu);
+        emit_u32(table->stacks);
+        emit_u32(table->dropped);
+        for (uint32_t i = 0; i < PROF_SLOTS; ++i) {
+            prof_slot_t *slot = &table->slots[i];
+            if (!slot->count) {
+                continue;
+            }
+            emit_u32(slot->count);
+            emit_u32(slot->depth);
+            serial_write_raw(slot->pc, slot->depth * sizeof(uint32_t));
+            total += slot->count;
+        }
+    }
+    serial_write_raw("KEND", 4);
+    serial_set_mode(saved);
+    log_event(LOG_SUCCESS, "Profiler: dumped %u samples", total);
+    return total;
+}
+
+void prof_get_stats(prof_stats_t *out) {
+    kmemset(out, 0, sizeof(*out));
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        out->samples += tables[cpu].samples;
+        out->stacks += tables[cpu].stacks;
+        out->dropped += tables[cpu].dropped;
+    }
+    out->hz = prof_hz;
+    out->running = running;
+}
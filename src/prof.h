@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Sampling profiler driven by the timer interrupt. Each CPU counts samples
+ * per distinct call stack (interrupted EIP plus up to PROF_DEPTH - 1 return
+ * addresses from the frame-pointer chain) in its own table. */
+#define PROF_DEPTH 8
+#define PROF_SLOTS 1024
+#define PROF_DEFAULT_HZ 1000
+#define PROF_MIN_HZ 10
+#define PROF_MAX_HZ 10000
+
+typedef struct {
+    uint32_t samples;
+    uint32_t stacks;
+    uint32_t dropped;
+    uint32_t hz;
+    int running;
+} prof_stats_t;
+
+int prof_start(uint32_t hz);
+void prof_stop(void);
+uint32_t prof_dump(void);
+void prof_get_stats(prof_stats_t *out);
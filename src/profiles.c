@@ -47,7 +47,7 @@ void profile_select(const profile_desc_t *profile) {
     char msg[96];
     kstrncpy(msg, "Profile: ", sizeof(msg));
     kstrcat(msg, profile->name, sizeof(msg));
-    log_event(LOG_SUCCESS, msg);
+    log_text(LOG_SUCCESS, msg);
 }
 
 void profile_restore_last_state(const profile_desc_t *profile) {
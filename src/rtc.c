@@ -0,0 +1,93 @@
+#include "rtc.h"
+#include "io.h"
+
+#define CMOS_INDEX 0x70
+#define CMOS_DATA 0x71
+#define RTC_SECONDS 0x00
+#define RTC_MINUTES 0x02
+#define RTC_HOURS 0x04
+#define RTC_DAY 0x07
+#define RTC_MONTH 0x08
+#define RTC_YEAR 0x09
+#define RTC_STATUS_A 0x0A
+#define RTC_STATUS_B 0x0B
+#define RTC_UPDATING 0x80
+#define RTC_BINARY 0x04
+#define RTC_24H 0x02
+#define RTC_PM 0x80
+
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_INDEX, reg);
+    return inb(CMOS_DATA);
+}
+
+static int wait_update_done(void) {
+    for (int i = 0; i < 100000; ++i) {
+        if (!(cmos_read(RTC_STATUS_A) & RTC_UPDATING)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void read_raw(rtc_time_t *t) {
+    t->second = cmos_read(RTC_SECONDS);
+    t->minute = cmos_read(RTC_MINUTES);
+    t->hour = cmos_read(RTC_HOURS);
+    t->day = cmos_read(RTC_DAY);
+    t->month = cmos_read(RTC_MONTH);
+    t->year = cmos_read(RTC_YEAR);
+}
+
+static uint8_t from_bcd(uint8_t v) {
+    return (uint8_t)((v >> 4) * 10 + (v & 0x0F));
+}
+
+/* The RTC may tick between register reads, so read until two consecutive
+ * snapshots agree. */
+int rtc_read(rtc_time_t *out) {
+    rtc_time_t a, b;
+    int tries = 0;
+    do {
+        if (!wait_update_done()) {
+            return -1;
+        }
+        read_raw(&a);
+        wait_update_done();
+        read_raw(&b);
+    } while ((a.second != b.second || a.minute != b.minute || a.hour != b.hour ||
+              a.day != b.day || a.month != b.month || a.year != b.year) && ++tries < 5);
+
+    uint8_t status_b = cmos_read(RTC_STATUS_B);
+    uint8_t pm = b.hour & RTC_PM;
+    b.hour &= (uint8_t)~RTC_PM;
+    if (!(status_b & RTC_BINARY)) {
+        b.second = from_bcd(b.second);
+        b.minute = from_bcd(b.minute);
+        b.hour = from_bcd(b.hour);
+        b.day = from_bcd(b.day);
+        b.month = from_bcd(b.month);
+        b.year = from_bcd((uint8_t)b.year);
+    }
+    if (!(status_b & RTC_24H)) {
+        b.hour = (uint8_t)(b.hour % 12 + (pm ? 12 : 0));
+    }
+    b.year = (uint16_t)(b.year + 2000);
+    if (b.month < 1 || b.month > 12 || b.day < 1 || b.day > 31 || b.hour > 23 || b.minute > 59) {
+        return -1;
+    }
+    *out = b;
+    return 0;
+}
+
+/* Days since 1970-01-01 via the proleptic Gregorian era formula. */
+uint32_t rtc_to_unix(const rtc_time_t *t) {
+    int y = t->year - (t->month <= 2);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int m = t->month;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + t->day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int days = era * 146097 + doe - 719468;
+    return (uint32_t)days * 86400u + t->hour * 3600u + t->minute * 60u + t->second;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+} rtc_time_t;
+
+int rtc_read(rtc_time_t *out);
+uint32_t rtc_to_unix(const rtc_time_t *t);
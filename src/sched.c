@@ -0,0 +1,654 @@
+#include "sched.h"
+#include "timer.h"
+#include "clock.h"
+#include "pmm.h"
+#include "paging.h"
+#include "gdt.h"
+#include "smp.h"
+#include "lapic.h"
+#include "spinlock.h"
+#include "console.h"
+#include "common.h"
+
+/* Strict-priority preemptive scheduler with one run queue per CPU. Each
+ * priority level is a FIFO and a bitmap names the non-empty levels, so
+ * picking the next task is one ctz. Tasks at the same level share the CPU
+ * in SCHED_SLICE_NS slices; the slice timer is only armed while an
+ * equal-or-higher task is waiting, so a lone runnable task runs untimed.
+ * Switches happen on the way out of an interrupt by handing isr_common a
+ * different saved frame.
+ *
+ * Tasks inherit their parent's CPU affinity, and the boot context is
+ * pinned to CPU 0, so everything that predates SMP keeps running there.
+ * Tasks allowed on several CPUs are placed on an idle one when they wake,
+ * and idle CPUs steal them from busy queues. */
+#define TASK_BLOCK_ORDER 3
+#define TASK_BLOCK_SIZE (PMM_PAGE_SIZE << TASK_BLOCK_ORDER)
+#define TASK_GUARD_OFFSET PMM_PAGE_SIZE
+#define TASK_STACK_OFFSET (2 * PMM_PAGE_SIZE)
+#define BOOT_STACK_SIZE 32768u /* boot.s */
+#define EFLAGS_IF 0x200u
+#define EFLAGS_RESERVED 0x002u
+
+typedef struct {
+    spinlock_t lock;
+    uint32_t cpu;
+    uint32_t online;
+    uint32_t bitmap;
+    task_t *head[SCHED_PRIOS];
+    task_t *tail[SCHED_PRIOS];
+    task_t *current;
+    task_t *idle;
+    task_t *dead;
+    uint64_t switch_tsc;
+    uint32_t switches;
+    volatile uint32_t need_resched;
+} runqueue_t;
+
+static runqueue_t runqueues[CPU_MAX];
+static task_t boot_task __attribute__((aligned(64)));
+static task_t *all_tasks;
+static uint32_t next_pid;
+static uint32_t task_count;
+static int sched_running;
+static spinlock_t tasks_lock = SPINLOCK_INIT;
+
+static runqueue_t *this_rq(void) {
+    return &runqueues[cpu_current()];
+}
+
+static void set_current(runqueue_t *rq, task_t *task) {
+    rq->current = task;
+    cpu_local_of(rq->cpu)->current = task;
+}
+
+static void rq_push(runqueue_t *rq, task_t *task) {
+    uint32_t prio = task->prio;
+    task->next = NULL;
+    task->state = TASK_READY;
+    task->cpu = (uint8_t)rq->cpu;
+    if (rq->tail[prio]) {
+        rq->tail[prio]->next = task;
+    } else {
+        rq->head[prio] = task;
+    }
+    rq->tail[prio] = task;
+    rq->bitmap |= 1u << prio;
+}
+
+static task_t *rq_pop(runqueue_t *rq) {
+    if (!rq->bitmap) {
+        return NULL;
+    }
+    uint32_t prio = (uint32_t)__builtin_ctz(rq->bitmap);
+    task_t *task = rq->head[prio];
+    rq->head[prio] = task->next;
+    if (!rq->head[prio]) {
+        rq->tail[prio] = NULL;
+        rq->bitmap &= ~(1u << prio);
+    }
+    task->next = NULL;
+    return task;
+}
+
+/* Takes the highest-priority queued task that may run on the given CPU.
+ * A task whose stack its old CPU is still leaving (on_cpu) is skipped. */
+static task_t *rq_take(runqueue_t *rq, uint32_t cpu_bit) {
+    for (uint32_t bits = rq->bitmap; bits; bits &= bits - 1) {
+        uint32_t prio = (uint32_t)__builtin_ctz(bits);
+        task_t *prev = NULL;
+        for (task_t *task = rq->head[prio]; task; prev = task, task = task->next) {
+            if (task->on_cpu || !(task->affinity & cpu_bit)) {
+                continue;
+            }
+            if (prev) {
+                prev->next = task->next;
+            } else {
+                rq->head[prio] = task->next;
+            }
+            if (rq->tail[prio] == task) {
+                rq->tail[prio] = prev;
+            }
+            if (!rq->head[prio]) {
+                rq->bitmap &= ~(1u << prio);
+            }
+            task->next = NULL;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/* Slices only matter while someone of equal or higher priority waits. */
+static void update_slice(runqueue_t *rq) {
+    uint32_t prio = rq->current->prio;
+    uint32_t mask = prio >= 31 ? 0xFFFFFFFFu : (2u << prio) - 1;
+    timer_set_preempt((rq->bitmap & mask) ? ktime_ns() + SCHED_SLICE_NS : TIMER_NONE);
+}
+
+static int preemptible(task_t *task) {
+    return sched_running && !task->preempt_count && !in_interrupt();
+}
+
+/* The queue a waking task goes to: its last CPU, unless that one is busy
+ * and the task may run on one that is idle. */
+static runqueue_t *select_rq(task_t *task) {
+    runqueue_t *home = &runqueues[task->cpu];
+    uint32_t others = task->affinity & ~(1u << task->cpu);
+    if (!others || task->on_cpu || home->current == home->idle) {
+        return home;
+    }
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        runqueue_t *rq = &runqueues[cpu];
+        if ((others & (1u << cpu)) && rq->online && rq->current == rq->idle && !rq->bitmap) {
+            return rq;
+        }
+    }
+    return home;
+}
+
+static void yield_handler(isr_frame_t *frame) {
+    (void)frame;
+    this_rq()->need_resched = 1;
+}
+
+/* Another CPU queued work here: the waker already set need_resched if the
+ * newcomer should preempt, and a same-priority arrival starts a slice. */
+static void resched_ipi(isr_frame_t *frame) {
+    (void)frame;
+    lapic_eoi();
+    runqueue_t *rq = this_rq();
+    spin_lock(&rq->lock);
+    if (rq->current) {
+        update_slice(rq);
+    }
+    spin_unlock(&rq->lock);
+}
+
+isr_frame_t *sched_irq_exit(isr_frame_t *frame) {
+    runqueue_t *rq = this_rq();
+    task_t *prev = rq->current;
+    /* A task that blocked must be switched away from even with preemption
+     * disabled, or it would spin on its own wait loop. */
+    if (!rq->online || !rq->need_resched || (prev->preempt_count && prev->state == TASK_RUNNING)) {
+        return frame;
+    }
+    rq->need_resched = 0;
+    spin_lock(&rq->lock);
+    if (prev->state == TASK_RUNNING && prev != rq->idle) {
+        rq_push(rq, prev);
+    }
+    task_t *next = rq_pop(rq);
+    if (!next) {
+        next = prev->state == TASK_RUNNING ? prev : rq->idle;
+    }
+    if (next != prev) {
+        uint64_t now = rdtsc();
+        prev->cycles += now - rq->switch_tsc;
+        rq->switch_tsc = now;
+        prev->frame = frame;
+        ++next->switches;
+        ++rq->switches;
+        if (prev->affinity & ~(1u << rq->cpu)) {
+            fpu_release(&prev->fpu);
+        }
+        /* prev stays unstealable until isr_common is off its stack. */
+        next->on_cpu = 1;
+        cpu_local_of(rq->cpu)->release = &prev->on_cpu;
+        set_current(rq, next);
+        fpu_switch(&next->fpu);
+        /* A killed task that was preempted outside any blocking primitive
+         * resumes straight into task_exit; its stack is discarded anyway. */
+        if (next->kill_pending && !next->in_block) {
+            next->frame->eip = (uint32_t)(uintptr_t)task_exit;
+        }
+    }
+    next->state = TASK_RUNNING;
+    update_slice(rq);
+    spin_unlock(&rq->lock);
+    return next == prev ? frame : next->frame;
+}
+
+void sched_yield(void) {
+    __asm__ volatile("int %0" : : "i"(SCHED_YIELD_VECTOR) : "memory");
+}
+
+void sched_preempt_tick(void) {
+    this_rq()->need_resched = 1;
+}
+
+/* The count lives in the task, so a task with preemption disabled is also
+ * pinned to its CPU. Before sched_init there is no task and no preemption. */
+void sched_preempt_disable(void) {
+    task_t *self = task_current();
+    if (self) {
+        ++self->preempt_count;
+    }
+}
+
+void sched_preempt_enable(void) {
+    task_t *self = task_current();
+    if (self && self->preempt_count && --self->preempt_count == 0 &&
+        this_rq()->need_resched && preemptible(self)) {
+        sched_yield();
+    }
+}
+
+/* Wakes a blocked task. A higher-priority wakee on this CPU runs as soon
+ * as the caller is preemptible; on another CPU it is kicked with an IPI. */
+void sched_wake(task_t *task) {
+    uint32_t flags = cpu_irq_save();
+    runqueue_t *rq = select_rq(task);
+    spin_lock(&rq->lock);
+    /* Concurrent wakers may have picked different queues; only the one
+     * that moves the task out of BLOCKED queues it. */
+    uint8_t blocked = TASK_BLOCKED;
+    if (!__atomic_compare_exchange_n(&task->state, &blocked, TASK_READY, 0, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED)) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+    rq_push(rq, task);
+    int kick = 0;
+    if (!rq->current) {
+        /* Before sched_init has adopted the boot context. */
+    } else if (task->prio < rq->current->prio) {
+        rq->need_resched = 1;
+        kick = 1;
+    } else if (task->prio == rq->current->prio) {
+        if (rq == this_rq()) {
+            update_slice(rq);
+        } else {
+            kick = 1;
+        }
+    }
+    spin_unlock(&rq->lock);
+    if (rq != this_rq()) {
+        if (kick && rq->online) {
+            smp_send_ipi(rq->cpu, IPI_RESCHED_VECTOR);
+        }
+        cpu_irq_restore(flags);
+        return;
+    }
+    int switch_now = rq->need_resched && preemptible(rq->current) && (flags & EFLAGS_IF);
+    cpu_irq_restore(flags);
+    if (switch_now) {
+        sched_yield();
+    }
+}
+
+static void sleep_timeout(void *arg) {
+    sched_wake((task_t *)arg);
+}
+
+void sched_sleep_ns(uint64_t ns) {
+    task_t *self = task_current();
+    ktimer_t timer;
+    timer_setup(&timer, sleep_timeout, self);
+    uint32_t flags = cpu_irq_save();
+    self->in_block = 1;
+    if (!self->kill_pending) {
+        /* Blocked before arming, so a timer that fires on another CPU
+         * before we yield still finds a task to wake. */
+        self->state = TASK_BLOCKED;
+        timer_arm_in(&timer, ns);
+        sched_yield();
+    }
+    self->in_block = 0;
+    cpu_irq_restore(flags);
+    timer_cancel(&timer);
+    if (self->kill_pending) {
+        task_exit();
+    }
+}
+
+void sched_event_init(sched_event_t *ev) {
+    ev->lock = (spinlock_t)SPINLOCK_INIT;
+    ev->signalled = 0;
+    ev->waiter = NULL;
+}
+
+void sched_event_signal(sched_event_t *ev) {
+    uint32_t flags = spin_lock_irqsave(&ev->lock);
+    ev->signalled = 1;
+    task_t *waiter = ev->waiter;
+    ev->waiter = NULL;
+    spin_unlock_irqrestore(&ev->lock, flags);
+    if (waiter) {
+        sched_wake(waiter);
+    }
+}
+
+/* The waiter is marked blocked while the event lock is held, so a signal
+ * from another CPU either sees it blocked or is seen by the loop. */
+void sched_event_wait(sched_event_t *ev) {
+    task_t *self = task_current();
+    uint32_t flags = spin_lock_irqsave(&ev->lock);
+    self->in_block = 1;
+    while (!ev->signalled && !self->kill_pending && sched_running) {
+        ev->waiter = self;
+        self->state = TASK_BLOCKED;
+        spin_unlock(&ev->lock);
+        sched_yield();
+        spin_lock(&ev->lock);
+    }
+    if (ev->waiter == self) {
+        ev->waiter = NULL;
+    }
+    if (!self->kill_pending) {
+        ev->signalled = 0;
+    }
+    self->in_block = 0;
+    spin_unlock_irqrestore(&ev->lock, flags);
+    if (self->kill_pending) {
+        task_exit();
+    }
+}
+
+static void task_entry(void) {
+    task_t *self = task_current();
+    self->fn(self->arg);
+    task_exit();
+}
+
+static void task_init_common(task_t *task, const char *name, uint32_t prio) {
+    kstrncpy(task->name, name, TASK_NAME_MAX - 1);
+    task->name[TASK_NAME_MAX - 1] = '\0';
+    task->prio = (uint8_t)(prio > SCHED_PRIO_IDLE ? SCHED_PRIO_IDLE : prio);
+    fpu_state_init(&task->fpu);
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    task->pid = next_pid++;
+    task->all_next = all_tasks;
+    all_tasks = task;
+    ++task_count;
+    spin_unlock_irqrestore(&tasks_lock, flags);
+}
+
+/* The task, a guard page and the stack share one page block, so a stack
+ * overflow faults on the guard instead of corrupting the task. */
+static task_t *task_create(const char *name, task_fn_t fn, void *arg, uint32_t prio, uint32_t affinity) {
+    uint32_t block = pmm_alloc_pages(TASK_BLOCK_ORDER);
+    if (!block) {
+        log_event(LOG_ERROR, "sched: no memory for task");
+        return NULL;
+    }
+    task_t *task = (task_t *)(uintptr_t)block;
+    kmemset(task, 0, sizeof(*task));
+    task->fn = fn;
+    task->arg = arg;
+    task->block = block;
+    task->stack_bytes = TASK_BLOCK_SIZE - TASK_STACK_OFFSET;
+    task->affinity = affinity;
+    task->cpu = (uint8_t)__builtin_ctz(affinity);
+    paging_unmap(block + TASK_GUARD_OFFSET, PMM_PAGE_SIZE);
+
+    /* Shape the stack as if the task had been interrupted at task_entry,
+     * with a null return address so entry sees the usual call alignment. */
+    uint32_t *ret = (uint32_t *)(uintptr_t)(block + TASK_BLOCK_SIZE - 4);
+    *ret = 0;
+    isr_frame_t *frame = (isr_frame_t *)ret - 1;
+    kmemset(frame, 0, sizeof(*frame));
+    frame->gs = frame->fs = frame->es = frame->ds = GDT_KERNEL_DATA;
+    frame->cs = GDT_KERNEL_CODE;
+    frame->eip = (uint32_t)(uintptr_t)task_entry;
+    frame->eflags = EFLAGS_IF | EFLAGS_RESERVED;
+    task->frame = frame;
+    task_init_common(task, name, prio);
+    return task;
+}
+
+/* affinity is a CPU bit mask; zero inherits the caller's. The task starts
+ * on the caller's CPU when allowed there. */
+task_t *task_spawn_on(const char *name, task_fn_t fn, void *arg, uint32_t prio, uint32_t affinity) {
+    task_t *self = task_current();
+    if (!affinity) {
+        affinity = self ? self->affinity : 1u;
+    }
+    if (prio >= SCHED_PRIO_IDLE) {
+        prio = SCHED_PRIO_IDLE - 1;
+    }
+    task_t *task = task_create(name, fn, arg, prio, affinity);
+    if (!task) {
+        return NULL;
+    }
+    task->parent = self ? self->pid : 0;
+    if (self && (affinity & (1u << self->cpu))) {
+        task->cpu = self->cpu;
+    }
+    task->state = TASK_BLOCKED;
+    sched_wake(task);
+    return task;
+}
+
+task_t *task_spawn(const char *name, task_fn_t fn, void *arg, uint32_t prio) {
+    return task_spawn_on(name, fn, arg, prio, 0);
+}
+
+static void task_free(task_t *task) {
+    paging_map(task->block + TASK_GUARD_OFFSET, task->block + TASK_GUARD_OFFSET, PMM_PAGE_SIZE,
+               PAGE_WRITE | PAGE_GLOBAL, PAGE_CACHE_WB);
+    pmm_free_pages(task->block, TASK_BLOCK_ORDER);
+}
+
+/* Pulls a task this CPU may run from another queue, scanning from the
+ * next CPU up. Each victim lock is taken on its own, never with ours. */
+static task_t *steal_task(runqueue_t *rq) {
+    uint32_t bit = 1u << rq->cpu;
+    for (uint32_t i = 1; i < CPU_MAX; ++i) {
+        runqueue_t *victim = &runqueues[(rq->cpu + i) % CPU_MAX];
+        if (!victim->online || !victim->bitmap) {
+            continue;
+        }
+        spin_lock(&victim->lock);
+        task_t *task = rq_take(victim, bit);
+        spin_unlock(&victim->lock);
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void idle_task(void *arg) {
+    (void)arg;
+    runqueue_t *rq = this_rq();
+    for (;;) {
+        cpu_irq_disable();
+        task_t *dead = rq->dead;
+        rq->dead = NULL;
+        if (dead) {
+            cpu_irq_enable();
+            while (dead) {
+                task_t *next = dead->next;
+                task_free(dead);
+                dead = next;
+            }
+            continue;
+        }
+        if (!rq->bitmap) {
+            task_t *stolen = steal_task(rq);
+            if (stolen) {
+                spin_lock(&rq->lock);
+                rq_push(rq, stolen);
+                spin_unlock(&rq->lock);
+            }
+        }
+        if (rq->bitmap) {
+            cpu_irq_enable();
+            sched_yield();
+        } else {
+            cpu_idle();
+        }
+    }
+}
+
+void task_exit(void) {
+    runqueue_t *rq = this_rq();
+    cpu_irq_disable();
+    task_t *self = rq->current;
+    if ((self->flags & TASK_FLAG_SYSTEM) || !self->block) {
+        log_event(LOG_ERROR, "sched: system task exited");
+        for (;;) {
+            cpu_idle();
+        }
+    }
+    spin_lock(&tasks_lock);
+    for (task_t **link = &all_tasks; *link; link = &(*link)->all_next) {
+        if (*link == self) {
+            *link = self->all_next;
+            --task_count;
+            break;
+        }
+    }
+    spin_unlock(&tasks_lock);
+    self->state = TASK_DEAD;
+    self->next = rq->dead;
+    rq->dead = self;
+    sched_yield();
+    for (;;) {
+        cpu_idle();
+    }
+}
+
+/* Blocked and preempted tasks are only flagged: they leave through
+ * task_exit at their next safe point so no wait queue or armed timer keeps
+ * pointing into a freed stack. */
+int task_kill(uint32_t pid) {
+    task_t *self = task_current();
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    task_t *task = all_tasks;
+    while (task && task->pid != pid) {
+        task = task->all_next;
+    }
+    if (!task || (task->flags & TASK_FLAG_SYSTEM)) {
+        spin_unlock_irqrestore(&tasks_lock, flags);
+        return task ? -2 : -1;
+    }
+    task->kill_pending = 1;
+    /* Still listed, so not yet reaped: waking under tasks_lock keeps the
+     * target's page block alive until sched_wake is done with it. */
+    if (task != self && task->state == TASK_BLOCKED) {
+        sched_wake(task);
+    }
+    spin_unlock_irqrestore(&tasks_lock, flags);
+    if (task == self) {
+        task_exit();
+    }
+    return 0;
+}
+
+task_t *task_current(void) {
+    return cpu_current_task();
+}
+
+void task_set_name(const char *name) {
+    task_t *self = task_current();
+    kstrncpy(self->name, name, TASK_NAME_MAX - 1);
+}
+
+int sched_snapshot(task_info_t *out, int max) {
+    int count = 0;
+    uint64_t now = rdtsc();
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    for (task_t *t = all_tasks; t && count < max; t = t->all_next) {
+        runqueue_t *rq = &runqueues[t->cpu];
+        task_info_t *info = &out[count++];
+        info->pid = t->pid;
+        info->parent = t->parent;
+        kstrncpy(info->name, t->name, TASK_NAME_MAX);
+        info->prio = t->prio;
+        info->state = t->state;
+        info->cpu = t->cpu;
+        info->cycles = t->cycles + (t == rq->current ? now - rq->switch_tsc : 0);
+        info->stack_bytes = t->stack_bytes;
+        info->switches = t->switches;
+    }
+    spin_unlock_irqrestore(&tasks_lock, flags);
+    return count;
+}
+
+uint32_t sched_task_count(void) {
+    return task_count;
+}
+
+uint32_t sched_switch_count(void) {
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        total += runqueues[cpu].switches;
+    }
+    return total;
+}
+
+static task_t *spawn_idle(uint32_t cpu) {
+    char name[TASK_NAME_MAX];
+    char num[8];
+    kstrncpy(name, "idle", sizeof(name) - 1);
+    kitoa((int)cpu, num, sizeof(num));
+    kstrcat(name, num, sizeof(name));
+    task_t *idle = task_create(name, idle_task, NULL, SCHED_PRIO_IDLE, 1u << cpu);
+    if (idle) {
+        idle->flags = TASK_FLAG_SYSTEM;
+        idle->state = TASK_READY;
+        runqueues[cpu].idle = idle;
+    }
+    return idle;
+}
+
+/* Creates an application processor's idle task before the CPU is started
+ * and returns the stack the CPU should boot on, which is the idle task's
+ * own: the CPU becomes that task in sched_start_cpu. */
+uint32_t sched_prepare_cpu(uint32_t cpu) {
+    runqueue_t *rq = &runqueues[cpu];
+    rq->cpu = cpu;
+    task_t *idle = rq->idle ? rq->idle : spawn_idle(cpu);
+    return idle ? idle->block + TASK_BLOCK_SIZE - 16 : 0;
+}
+
+/* Runs on the new CPU with interrupts off and never returns. */
+void sched_start_cpu(uint32_t cpu) {
+    runqueue_t *rq = &runqueues[cpu];
+    task_t *idle = rq->idle;
+    idle->state = TASK_RUNNING;
+    idle->on_cpu = 1;
+    set_current(rq, idle);
+    rq->switch_tsc = rdtsc();
+    fpu_switch(&idle->fpu);
+    rq->online = 1;
+    idle_task(NULL);
+    for (;;) {
+        cpu_idle();
+    }
+}
+
+/* Adopts the boot context as the first task and creates the idle task;
+ * nothing is preempted until interrupts are enabled. */
+void sched_init(void) {
+    kmemset(runqueues, 0, sizeof(runqueues));
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        runqueues[cpu].cpu = cpu;
+    }
+    all_tasks = NULL;
+    next_pid = 0;
+    task_count = 0;
+    runqueue_t *rq = this_rq();
+
+    kmemset(&boot_task, 0, sizeof(boot_task));
+    boot_task.stack_bytes = BOOT_STACK_SIZE;
+    boot_task.flags = TASK_FLAG_SYSTEM;
+    boot_task.affinity = 1u << rq->cpu;
+    boot_task.cpu = (uint8_t)rq->cpu;
+    if (!spawn_idle(rq->cpu)) {
+        return;
+    }
+    task_init_common(&boot_task, "kernel", SCHED_PRIO_GUI);
+    boot_task.state = TASK_RUNNING;
+    boot_task.on_cpu = 1;
+    set_current(rq, &boot_task);
+    rq->switch_tsc = rdtsc();
+    fpu_switch(&boot_task.fpu);
+    idt_set_handler(SCHED_YIELD_VECTOR, yield_handler);
+    idt_set_handler(IPI_RESCHED_VECTOR, resched_ipi);
+    rq->online = 1;
+    sched_running = 1;
+    log_event(LOG_SUCCESS, "Scheduler running");
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include "fpu.h"
+#include "idt.h"
+#include "spinlock.h"
+
+#define SCHED_PRIOS 8
+#define SCHED_PRIO_TIMER 0
+#define SCHED_PRIO_IO 1
+#define SCHED_PRIO_GUI 2
+#define SCHED_PRIO_NORMAL 4
+#define SCHED_PRIO_BACKGROUND 6
+#define SCHED_PRIO_IDLE SCHED_PRIOS
+
+#define SCHED_YIELD_VECTOR 0x81
+#define SCHED_SLICE_NS 4000000u
+
+#define TASK_NAME_MAX 24
+#define TASK_FLAG_SYSTEM 0x01
+#define TASK_AFFINITY_ANY 0xFFFFFFFFu
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,
+    TASK_DEAD
+} task_state_t;
+
+typedef void (*task_fn_t)(void *arg);
+
+/* Lives at the base of the task's own page block, below a guard page and
+ * its stack; the FPU image comes first for its 64-byte alignment. */
+typedef struct task {
+    fpu_state_t fpu;
+    struct task *next;
+    struct task *all_next;
+    isr_frame_t *frame;
+    uint32_t pid;
+    uint32_t parent;
+    char name[TASK_NAME_MAX];
+    uint8_t prio;
+    uint8_t state;
+    uint8_t flags;
+    uint8_t in_block;
+    volatile uint8_t kill_pending;
+    volatile uint8_t on_cpu;
+    uint8_t cpu;
+    uint32_t affinity;
+    uint32_t preempt_count;
+    task_fn_t fn;
+    void *arg;
+    uint32_t block;
+    uint32_t stack_bytes;
+    uint64_t cycles;
+    uint32_t switches;
+} task_t;
+
+/* Single-waiter wakeup flag; a signal with nobody waiting is remembered
+ * until the next wait. Safe to signal from interrupt handlers and from
+ * other CPUs. */
+typedef struct {
+    spinlock_t lock;
+    volatile uint32_t signalled;
+    task_t *waiter;
+} sched_event_t;
+
+typedef struct {
+    uint32_t pid;
+    uint32_t parent;
+    char name[TASK_NAME_MAX];
+    uint8_t prio;
+    uint8_t state;
+    uint8_t cpu;
+    uint64_t cycles;
+    uint32_t stack_bytes;
+    uint32_t switches;
+} task_info_t;
+
+void sched_init(void);
+uint32_t sched_prepare_cpu(uint32_t cpu);
+void sched_start_cpu(uint32_t cpu) __attribute__((noreturn));
+task_t *task_spawn(const char *name, task_fn_t fn, void *arg, uint32_t prio);
+task_t *task_spawn_on(const char *name, task_fn_t fn, void *arg, uint32_t prio, uint32_t affinity);
+task_t *task_current(void);
+void task_set_name(const char *name);
+void task_exit(void) __attribute__((noreturn));
+int task_kill(uint32_t pid);
+
+void sched_yield(void);
+void sched_sleep_ns(uint64_t ns);
+void sched_wake(task_t *task);
+void sched_preempt_disable(void);
+void sched_preempt_enable(void);
+void sched_preempt_tick(void);
+isr_frame_t *sched_irq_exit(isr_frame_t *frame);
+
+void sched_event_init(sched_event_t *ev);
+void sched_event_signal(sched_event_t *ev);
+void sched_event_wait(sched_event_t *ev);
+
+int sched_snapshot(task_info_t *out, int max);
+uint32_t sched_task_count(void);
+uint32_t sched_switch_count(void);
@@ -0,0 +1,258 @@
+#include "serial.h"
+#include "clock.h"
+#include "cpu.h"
+#include "console.h"
+#include "io.h"
+#include "irq.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "common.h"
+
+#define COM1_BASE 0x3F8
+#define UART_DATA 0
+#define UART_IER 1
+#define UART_IIR 2
+#define UART_FCR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_DLL 0
+#define UART_DLM 1
+
+#define UART_IER_THRE 0x02
+#define UART_IIR_NONE 0x01
+#define UART_IIR_FIFO 0xC0
+#define UART_FCR_ENABLE 0xC7
+#define UART_LCR_8N1 0x03
+#define UART_LCR_DLAB 0x80
+#define UART_MCR_LOOPBACK 0x1E
+#define UART_MCR_RUN 0x0B
+#define UART_LSR_THRE 0x20
+#define UART_DIVISOR_115200 1
+#define UART_FIFO_16550A 16
+
+/* Bytes wait in the ring until the transmitter has room; a writer only
+ * ever looks at the line status once, and refills after that come from
+ * the THR-empty interrupt. A full ring drops text rather than stall. */
+#define SERIAL_RING_SIZE 8192
+#define SERIAL_RING_MASK (SERIAL_RING_SIZE - 1)
+#define SERIAL_LINE_MAX 112
+#define SERIAL_RETRY_NS 10000000ull
+
+static uint8_t tx_ring[SERIAL_RING_SIZE];
+static uint32_t tx_head;
+static uint32_t tx_tail;
+static spinlock_t tx_lock = SPINLOCK_INIT;
+static int present;
+static int irq_driven;
+static serial_mode_t mode = SERIAL_MODE_TEXT;
+static serial_stats_t stats;
+
+/* Log drain state: the cursor into the console log and the timer that
+ * moves records from there into the ring. */
+static uint32_t log_cursor;
+static ktimer_t drain_timer;
+static volatile uint32_t drain_idle = 1;
+static int drain_deferred;
+
+static uint32_t ring_free_locked(void) {
+    return SERIAL_RING_SIZE - (tx_head - tx_tail);
+}
+
+/* Loads the hardware FIFO if the transmitter is idle. */
+static void tx_fill_locked(void) {
+    if (tx_head == tx_tail || !(inb(COM1_BASE + UART_LSR) & UART_LSR_THRE)) {
+        return;
+    }
+    for (uint32_t n = 0; n < stats.fifo_size && tx_tail != tx_head; ++n) {
+        outb(COM1_BASE + UART_DATA, tx_ring[tx_tail++ & SERIAL_RING_MASK]);
+        ++stats.tx_bytes;
+    }
+}
+
+static void serial_irq(isr_frame_t *frame) {
+    (void)frame;
+    ++stats.irqs;
+    if (inb(COM1_BASE + UART_IIR) & UART_IIR_NONE) {
+        return;
+    }
+    spin_lock(&tx_lock);
+    tx_fill_locked();
+    spin_unlock(&tx_lock);
+}
+
+/* Copies as much as fits, then starts the transmitter; returns the number
+ * of bytes queued. */
+size_t serial_write(const void *data, size_t len) {
+    if (!present) {
+        return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    uint32_t room = ring_free_locked();
+    size_t n = len < room ? len : room;
+    for (size_t i = 0; i < n; ++i) {
+        tx_ring[tx_head++ & SERIAL_RING_MASK] = bytes[i];
+    }
+    stats.dropped += (uint32_t)(len - n);
+    tx_fill_locked();
+    spin_unlock_irqrestore(&tx_lock, flags);
+    return n;
+}
+
+/* Unlike serial_write this never drops: a dump larger than the ring waits
+ * for the interrupt handler to make room, or polls the UART before
+ * interrupts are wired up. */
+void serial_write_raw(const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (present && len) {
+        uint32_t flags = spin_lock_irqsave(&tx_lock);
+        uint32_t room = ring_free_locked();
+        size_t n = len < room ? len : room;
+        for (size_t i = 0; i < n; ++i) {
+            tx_ring[tx_head++ & SERIAL_RING_MASK] = bytes[i];
+        }
+        tx_fill_locked();
+        spin_unlock_irqrestore(&tx_lock, flags);
+        bytes += n;
+        len -= n;
+        if (len) {
+            if (irq_driven) {
+                sched_yield();
+            } else {
+                cpu_relax();
+            }
+        }
+    }
+}
+
+static const char *level_tag(log_level_t level) {
+    switch (level) {
+        case LOG_SUCCESS: return "[OK] ";
+        case LOG_WARN: return "[WARN] ";
+        case LOG_ERROR: return "[ERR] ";
+        default: return "[LOG] ";
+    }
+}
+
+/* Moves log records into the ring while a whole line fits; returns 1 if
+ * records are still waiting for room. */
+static int drain_log(void) {
+    char text[SERIAL_LINE_MAX - 16];
+    char line[SERIAL_LINE_MAX];
+    for (;;) {
+        if (mode != SERIAL_MODE_TEXT) {
+            return 0;
+        }
+        uint32_t flags = spin_lock_irqsave(&tx_lock);
+        uint32_t room = ring_free_locked();
+        spin_unlock_irqrestore(&tx_lock, flags);
+        if (room < SERIAL_LINE_MAX) {
+            return 1;
+        }
+        log_level_t level;
+        if (!log_read(&log_cursor, text, sizeof(text), &level)) {
+            return 0;
+        }
+        kstrcpy(line, level_tag(level));
+        kstrcat(line, text, sizeof(line) - 2);
+        kstrcat(line, "\r\n", sizeof(line));
+        serial_write(line, kstrlen(line));
+    }
+}
+
+static void drain_timer_fn(void *arg) {
+    (void)arg;
+    if (drain_log()) {
+        timer_arm_in(&drain_timer, SERIAL_RETRY_NS);
+        return;
+    }
+    __atomic_store_n(&drain_idle, 1, __ATOMIC_RELEASE);
+    uint32_t cursor = log_cursor;
+    char probe[1];
+    log_level_t level;
+    /* A record posted between the last read and going idle found the
+     * drain busy; pick it up now. */
+    if (mode == SERIAL_MODE_TEXT && log_read(&cursor, probe, sizeof(probe), &level)) {
+        uint32_t idle = 1;
+        if (__atomic_compare_exchange_n(&drain_idle, &idle, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            timer_arm_in(&drain_timer, 0);
+        }
+    }
+}
+
+/* Log sink hook. Before serial_start the boot CPU runs alone and drains
+ * inline; afterwards the formatting happens on the timer thread. */
+static void log_kick(void) {
+    if (!drain_deferred) {
+        drain_log();
+        return;
+    }
+    uint32_t idle = 1;
+    if (__atomic_compare_exchange_n(&drain_idle, &idle, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        timer_arm_in(&drain_timer, 0);
+    }
+}
+
+/* Loopback self-test first, so a machine without COM1 costs nothing. */
+void serial_init(void) {
+    uint16_t base = COM1_BASE;
+    outb(base + UART_IER, 0);
+    outb(base + UART_LCR, UART_LCR_DLAB);
+    outb(base + UART_DLL, UART_DIVISOR_115200);
+    outb(base + UART_DLM, 0);
+    outb(base + UART_LCR, UART_LCR_8N1);
+    outb(base + UART_FCR, UART_FCR_ENABLE);
+    outb(base + UART_MCR, UART_MCR_LOOPBACK);
+    outb(base + UART_DATA, 0xAE);
+    if (inb(base + UART_DATA) != 0xAE) {
+        return;
+    }
+    outb(base + UART_MCR, UART_MCR_RUN);
+    stats.fifo_size = (inb(base + UART_IIR) & UART_IIR_FIFO) == UART_IIR_FIFO ? UART_FIFO_16550A : 1;
+    present = 1;
+    log_cursor = 0;
+    log_set_sink(log_kick);
+    log_kick();
+}
+
+/* Needs irq_init and the timer wheel. */
+void serial_start(void) {
+    if (!present) {
+        return;
+    }
+    irq_register(IRQ_COM1, serial_irq);
+    irq_unmask(IRQ_COM1);
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    irq_driven = 1;
+    outb(COM1_BASE + UART_IER, UART_IER_THRE);
+    tx_fill_locked();
+    spin_unlock_irqrestore(&tx_lock, flags);
+    if (clock_source_khz()) {
+        timer_setup(&drain_timer, drain_timer_fn, NULL);
+        drain_deferred = 1;
+    }
+    log_event(LOG_SUCCESS, "Serial console on COM1, %u byte FIFO", stats.fifo_size);
+}
+
+int serial_present(void) {
+    return present;
+}
+
+/* Leaving raw mode resumes the log where it stopped; records that the
+ * console ring overwrote meanwhile are reported as lost. */
+void serial_set_mode(serial_mode_t new_mode) {
+    mode = new_mode;
+    if (present && mode == SERIAL_MODE_TEXT) {
+        log_kick();
+    }
+}
+
+serial_mode_t serial_mode(void) {
+    return mode;
+}
+
+void serial_get_stats(serial_stats_t *out) {
+    *out = stats;
+}
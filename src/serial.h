@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* COM1 output for headless runs. Text mode mirrors the console log as
+ * "[LEVEL] message" lines; raw mode silences the log so a bulk dump can
+ * own the line byte for byte. */
+typedef enum {
+    SERIAL_MODE_TEXT,
+    SERIAL_MODE_RAW
+} serial_mode_t;
+
+typedef struct {
+    uint32_t tx_bytes;
+    uint32_t dropped;
+    uint32_t irqs;
+    uint32_t fifo_size;
+} serial_stats_t;
+
+void serial_init(void);
+void serial_start(void);
+int serial_present(void);
+size_t serial_write(const void *data, size_t len);
+void serial_write_raw(const void *data, size_t len);
+void serial_set_mode(serial_mode_t mode);
+serial_mode_t serial_mode(void);
+void serial_get_stats(serial_stats_t *out);
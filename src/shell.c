@@ -8,15 +8,34 @@
 #include "profiles.h"
 #include "blockchain.h"
 #include "fs.h"
+#include "bench.h"
+#include "compositor.h"
+#include "process.h"
+#include "workqueue.h"
+#include "slab.h"
+#include "trace.h"
+#include "prof.h"
 #include <stdint.h>
 
 #define SHELL_LINES 8
 #define SHELL_WIDTH 64
+#define SHELL_JOBS 4
+
+/* A command handed to the system workqueue. The job is owned by the shell
+ * until its completion callback runs on the GUI task and frees it. */
+typedef struct {
+    work_t work;
+    const char *name;
+    char path[FILE_PATH_MAX];
+    uint32_t args[4];
+    uint32_t shown;
+} shell_job_t;
 
 static char history[SHELL_LINES][SHELL_WIDTH];
 static int history_count;
 static char input_buffer[SHELL_WIDTH];
 static int shell_visible;
+static shell_job_t *jobs[SHELL_JOBS];
 
 void shell_init(void) {
     shell_visible = 1;
@@ -26,15 +45,18 @@ void shell_init(void) {
 
 void shell_open(void) {
     shell_visible = 1;
+    comp_invalidate(PANEL_SHELL);
     log_event(LOG_SUCCESS, "Shell ready");
 }
 
 void shell_close(void) {
     shell_visible = 0;
+    comp_invalidate(PANEL_SHELL);
 }
 
 void shell_toggle(void) {
     shell_visible = !shell_visible;
+    comp_invalidate(PANEL_SHELL);
 }
 
 int shell_is_open(void) {
@@ -51,12 +73,81 @@ static void push_history(const char *line) {
     kstrncpy(history[history_count++], line, SHELL_WIDTH - 1);
 }
 
+static void job_done(work_t *work);
+
+static shell_job_t *job_new(const char *name, const char *path, work_fn_t fn) {
+    int slot = -1;
+    for (int i = 0; i < SHELL_JOBS; ++i) {
+        if (!jobs[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        log_event(LOG_WARN, "Shell: too many jobs running");
+        return NULL;
+    }
+    shell_job_t *job = kmalloc(sizeof(*job));
+    if (!job) {
+        log_event(LOG_ERROR, "Shell: out of memory for job");
+        return NULL;
+    }
+    kmemset(job, 0, sizeof(*job));
+    work_init(&job->work, fn, job_done, job);
+    job->name = name;
+    kstrncpy(job->path, path, sizeof(job->path) - 1);
+    jobs[slot] = job;
+    return job;
+}
+
+static void job_submit(shell_job_t *job, uint32_t prio) {
+    if (workqueue_submit(&system_wq, &job->work, prio) != 0) {
+        log_event(LOG_WARN, "Shell: work queue busy, try again");
+        job_done(&job->work);
+        return;
+    }
+    comp_invalidate(PANEL_SHELL);
+}
+
+/* Runs on the GUI task once the worker is finished (or the submit failed). */
+static void job_done(work_t *work) {
+    shell_job_t *job = (shell_job_t *)work->arg;
+    for (int i = 0; i < SHELL_JOBS; ++i) {
+        if (jobs[i] == job) {
+            jobs[i] = NULL;
+        }
+    }
+    if (work->state == WORK_DONE) {
+        if (!kstrcmp(job->name, "VERIFY")) {
+            log_event(work->result == 0 ? LOG_SUCCESS : LOG_ERROR,
+                      work->result == 0 ? "File blockchain verified" : "File blockchain verification failed");
+        } else if (!kstrcmp(job->name, "RECOVER")) {
+            log_event(work->result == 0 ? LOG_SUCCESS : LOG_ERROR,
+                      work->result == 0 ? "Block recovered successfully" : "Block recovery failed");
+        }
+    }
+    kfree(job);
+    comp_invalidate(PANEL_SHELL);
+}
+
+/* Redraws the job line only when a running job's percentage moved. */
+void shell_poll(void) {
+    for (int i = 0; i < SHELL_JOBS; ++i) {
+        if (jobs[i] && jobs[i]->shown != jobs[i]->work.progress) {
+            jobs[i]->shown = jobs[i]->work.progress;
+            if (shell_visible) {
+                comp_invalidate(PANEL_SHELL);
+            }
+        }
+    }
+}
+
 static void cmd_echo(const char *args) {
-    log_event(LOG_SUCCESS, args && *args ? args : "(empty)");
+    log_text(LOG_SUCCESS, args && *args ? args : "(empty)");
 }
 
 static void cmd_help(void) {
-    log_event(LOG_SUCCESS, "Commands: HELP ECHO SYSMON CONSOLE INSTALL JOURNAL CHECKPOINT VERIFY CHAIN BCSTATUS RECOVER");
+    log_event(LOG_SUCCESS, "Commands: HELP ECHO SYSMON CONSOLE INSTALL JOURNAL CHECKPOINT VERIFY CHAIN BCSTATUS RECOVER BENCH MODE KILL TRACE PROF");
 }
 
 static void cmd_sysmon(void) {
@@ -75,7 +166,7 @@ static void cmd_journal(void) {
     ledger_entry_t entries[8];
     int count = ledger_entries(entries, ARRAY_SIZE(entries));
     for (int i = 0; i < count; ++i) {
-        log_event(LOG_SUCCESS, entries[i].note);
+        log_text(LOG_SUCCESS, entries[i].note);
     }
 }
 
@@ -86,16 +177,23 @@ static void cmd_checkpoint(const char *note) {
     jnl_checkpoint(note);
 }
 
+static void verify_progress(void *ctx, uint32_t done, uint32_t total) {
+    work_set_progress((work_t *)ctx, total ? done * 100 / total : 100);
+}
+
+static void verify_work(work_t *work) {
+    shell_job_t *job = (shell_job_t *)work->arg;
+    work->result = fs_verify_file_progress(job->path, verify_progress, work);
+}
+
 static void cmd_verify(const char *path) {
     if (!path || !*path) {
         log_event(LOG_WARN, "Usage: VERIFY <filepath>");
         return;
     }
-    int result = fs_verify_file(path);
-    if (result == 0) {
-        log_event(LOG_SUCCESS, "File blockchain verified");
-    } else {
-        log_event(LOG_ERROR, "File blockchain verification failed");
+    shell_job_t *job = job_new("VERIFY", path, verify_work);
+    if (job) {
+        job_submit(job, WQ_PRIO_NORMAL);
     }
 }
 
@@ -112,12 +210,7 @@ static void cmd_chain(const char *path) {
     }
     file_block_t* latest = blockchain_get_latest(chain);
     if (latest) {
-        char msg[128];
-        kstrncpy(msg, "Blocks: ", sizeof(msg) - 1);
-        char num[32];
-        kitoa((int)chain->block_count, num, sizeof(num));
-        kstrcat(msg, num, sizeof(msg));
-        log_event(LOG_SUCCESS, msg);
+        log_event(LOG_SUCCESS, "Blocks: %u", blockchain_block_count(chain));
     } else {
         log_event(LOG_WARN, "No blocks in chain");
     }
@@ -129,6 +222,12 @@ static void cmd_bcstatus(void) {
     log_event(LOG_SUCCESS, "User files: Individual blockchains");
 }
 
+static void recover_work(work_t *work) {
+    shell_job_t *job = (shell_job_t *)work->arg;
+    work->result = fs_recover_block(job->path, job->args[0], job->args[1], job->args[2], job->args[3]);
+    work_set_progress(work, 100);
+}
+
 static void cmd_recover(const char *args) {
     if (!args || !*args) {
         log_event(LOG_WARN, "Usage: RECOVER <path> <block> <complete_block> <partial_block> <shard>");
@@ -174,14 +273,136 @@ static void cmd_recover(const char *args) {
         else if (i == 3) shard_idx = val;
     }
     
-    int result = fs_recover_block(path, block_idx, complete_idx, partial_idx, shard_idx);
-    if (result == 0) {
-        log_event(LOG_SUCCESS, "Block recovered successfully");
+    shell_job_t *job = job_new("RECOVER", path, recover_work);
+    if (job) {
+        job->args[0] = block_idx;
+        job->args[1] = complete_idx;
+        job->args[2] = partial_idx;
+        job->args[3] = shard_idx;
+        job_submit(job, WQ_PRIO_HIGH);
+    }
+}
+
+static void cmd_bench(const char *name) {
+    while (*name == ' ') name++;
+    if (!*name) {
+        bench_list();
+        return;
+    }
+    bench_run(name);
+}
+
+static uint32_t parse_uint(const char **cursor) {
+    const char *p = *cursor;
+    uint32_t val = 0;
+    while (kisdigit(*p)) {
+        val = val * 10 + (uint32_t)(*p - '0');
+        p++;
+    }
+    *cursor = p;
+    return val;
+}
+
+static void cmd_mode(const char *args) {
+    while (*args == ' ') args++;
+    uint32_t w = parse_uint(&args);
+    uint32_t h = 0;
+    if (*args == 'X') {
+        args++;
+        h = parse_uint(&args);
+    }
+    if (!w || !h) {
+        log_event(LOG_WARN, "Usage: MODE <width>X<height>");
+        return;
+    }
+    if (fb_set_mode((int)w, (int)h) != 0) {
+        log_event(LOG_ERROR, "Mode switch needs the Bochs/QEMU display adapter");
+        return;
+    }
+    comp_invalidate_all();
+    log_event(LOG_SUCCESS, "Display mode set, present: %s", fb_present_name());
+}
+
+/* A serial dump waits on the UART for as long as the rings take to drain,
+ * so it runs on the workqueue and logs its own summary when done. */
+static void trace_dump_work(work_t *work) {
+    shell_job_t *job = (shell_job_t *)work->arg;
+    work->result = (int)trace_dump((trace_out_t)job->args[0]);
+    work_set_progress(work, 100);
+}
+
+static void submit_trace_dump(trace_out_t out) {
+    shell_job_t *job = job_new("TRACE", "", trace_dump_work);
+    if (job) {
+        job->args[0] = out;
+        job_submit(job, WQ_PRIO_NORMAL);
+    }
+}
+
+/* TRACE ON|OFF|DUMP [E9]: DUMP writes to COM1 unless E9 selects the QEMU
+ * debug console port. */
+static void cmd_trace(const char *args) {
+    while (*args == ' ') args++;
+    if (!kstrcmp(args, "ON")) {
+        trace_start();
+        if (trace_enabled) {
+            log_event(LOG_SUCCESS, "Trace: recording");
+        }
+    } else if (!kstrcmp(args, "OFF")) {
+        trace_stop();
+        log_event(LOG_SUCCESS, "Trace: stopped");
+    } else if (!kstrcmp(args, "DUMP")) {
+        submit_trace_dump(TRACE_OUT_SERIAL);
+    } else if (!kstrcmp(args, "DUMP E9")) {
+        submit_trace_dump(TRACE_OUT_DEBUGCON);
     } else {
-        log_event(LOG_ERROR, "Block recovery failed");
+        log_event(LOG_WARN, "Usage: TRACE ON|OFF|DUMP [E9]");
     }
 }
 
+static void prof_dump_work(work_t *work) {
+    work->result = (int)prof_dump();
+    work_set_progress(work, 100);
+}
+
+/* PROF [START [hz]|STOP|DUMP]; without arguments it reports progress. */
+static void cmd_prof(const char *args) {
+    while (*args == ' ') args++;
+    if (!kstrncmp(args, "START", 5)) {
+        const char *p = args + 5;
+        while (*p == ' ') p++;
+        uint32_t hz = *p ? parse_uint(&p) : PROF_DEFAULT_HZ;
+        if (prof_start(hz) == 0) {
+            log_event(LOG_SUCCESS, "Profiler: sampling at %u Hz", hz);
+        }
+    } else if (!kstrcmp(args, "STOP")) {
+        prof_stop();
+        log_event(LOG_SUCCESS, "Profiler: stopped");
+    } else if (!kstrcmp(args, "DUMP")) {
+        shell_job_t *job = job_new("PROF", "", prof_dump_work);
+        if (job) {
+            job_submit(job, WQ_PRIO_NORMAL);
+        }
+    } else if (!*args) {
+        prof_stats_t stats;
+        prof_get_stats(&stats);
+        log_event(LOG_SUCCESS, "Profiler: %u samples, %u stacks, %u dropped%s", stats.samples, stats.stacks,
+                  stats.dropped, stats.running ? ", running" : "");
+    } else {
+        log_event(LOG_WARN, "Usage: PROF [START [hz]|STOP|DUMP]");
+    }
+}
+
+static void cmd_kill(const char *args) {
+    while (*args == ' ') args++;
+    if (!kisdigit(*args)) {
+        log_event(LOG_WARN, "Usage: KILL <pid>");
+        return;
+    }
+    proc_kill_tree((int)parse_uint(&args));
+    comp_invalidate(PANEL_SYSMON);
+}
+
 static void execute_command(const char *line) {
     if (!kstrlen(line)) {
         return;
@@ -211,6 +432,16 @@ static void execute_command(const char *line) {
         cmd_bcstatus();
     } else if (!kstrncmp(line, "RECOVER ", 8)) {
         cmd_recover(line + 8);
+    } else if (!kstrncmp(line, "BENCH", 5)) {
+        cmd_bench(line + 5);
+    } else if (!kstrncmp(line, "MODE ", 5)) {
+        cmd_mode(line + 5);
+    } else if (!kstrncmp(line, "KILL ", 5)) {
+        cmd_kill(line + 5);
+    } else if (!kstrncmp(line, "TRACE", 5)) {
+        cmd_trace(line + 5);
+    } else if (!kstrncmp(line, "PROF", 4)) {
+        cmd_prof(line + 4);
     } else {
         log_event(LOG_WARN, "Unknown command");
     }
@@ -220,6 +451,7 @@ void shell_handle_char(char c) {
     if (!shell_visible) {
         return;
     }
+    comp_invalidate(PANEL_SHELL);
     if (c == '\b') {
         size_t len = kstrlen(input_buffer);
         if (len) {
@@ -244,19 +476,49 @@ void shell_handle_char(char c) {
     }
 }
 
+void shell_bounds(fb_rect_t *out) {
+    out->x = 8;
+    out->y = fb_height() - 150;
+    out->w = fb_width() - 16;
+    out->h = 142;
+}
+
 void shell_run(void) {
     if (!shell_visible) {
         return;
     }
-    fb_fillrect(8, fb_height() - 150, fb_width() - 16, 142, 0x00202020);
-    fb_draw_text(16, fb_height() - 142, "SHELL >", 0x00FFFFFF, 0);
-    int y = fb_height() - 124;
+    fb_rect_t r;
+    shell_bounds(&r);
+    fb_shadow(r.x, r.y, r.w, r.h, 8, 0x60);
+    fb_fillrect_alpha(r.x, r.y, r.w, r.h, 0x00202020, 0xE0);
+    fb_draw_text(r.x + 8, r.y + 8, "SHELL >", 0x00FFFFFF, 0);
+    int jx = r.x + 80;
+    for (int i = 0; i < SHELL_JOBS; ++i) {
+        shell_job_t *job = jobs[i];
+        if (!job) {
+            continue;
+        }
+        char status[32];
+        kstrncpy(status, job->name, sizeof(status) - 1);
+        if (job->work.state == WORK_QUEUED) {
+            kstrcat(status, " queued", sizeof(status));
+        } else {
+            char num[8];
+            kitoa((int)job->work.progress, num, sizeof(num));
+            kstrcat(status, " ", sizeof(status));
+            kstrcat(status, num, sizeof(status));
+            kstrcat(status, "%", sizeof(status));
+        }
+        fb_draw_text(jx, r.y + 8, status, 0x00FFD060, 0);
+        jx += ((int)kstrlen(status) + 2) * 8;
+    }
+    int y = r.y + 26;
     for (int i = 0; i < history_count; ++i) {
-        fb_draw_text(16, y + i * 16, history[i], 0x00A0FF70, 0);
+        fb_draw_text(r.x + 8, y + i * 16, history[i], 0x00A0FF70, 0);
     }
     char prompt[96];
     kstrncpy(prompt, "> ", sizeof(prompt));
     kstrcat(prompt, input_buffer, sizeof(prompt));
-    fb_draw_text(16, fb_height() - 32, prompt, 0x00FFFFFF, 0);
+    fb_draw_text(r.x + 8, r.y + r.h - 24, prompt, 0x00FFFFFF, 0);
 }
 
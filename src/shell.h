@@ -1,8 +1,12 @@
 #pragma once
 
+#include "fb.h"
+
 void shell_init(void);
+void shell_bounds(fb_rect_t *out);
 void shell_run(void);
 void shell_handle_char(char c);
+void shell_poll(void);
 void shell_open(void);
 void shell_close(void);
 void shell_toggle(void);
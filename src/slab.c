@@ -0,0 +1,386 @@
+#include "slab.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "console.h"
+#include "common.h"
+
+/* Two layers in the style of Bonwick's allocator: slabs carve page blocks
+ * into equal objects under a per-cache lock, and each CPU keeps a loaded
+ * and a previous magazine of objects so the common alloc/free pair only
+ * touches CPU-local state with interrupts briefly off. Full and empty
+ * magazines are exchanged with a per-cache depot. */
+#define SLAB_MAX_CACHES 16
+#define SLAB_MIN_OBJECTS 8
+#define SLAB_MAX_ORDER 3
+#define SLAB_ALIGN 16
+#define MAG_ROUNDS 14
+
+static const uint32_t kmalloc_sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048};
+#define KMALLOC_MAX_SIZE 2048
+
+typedef struct magazine {
+    struct magazine *next;
+    uint32_t rounds;
+    void *objs[MAG_ROUNDS];
+} magazine_t;
+
+typedef struct slab {
+    struct slab *next;
+    struct slab *prev;
+    kmem_cache_t *cache;
+    void *free;
+    uint32_t inuse;
+} slab_t;
+
+typedef struct {
+    magazine_t *loaded;
+    magazine_t *previous;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t hits;
+} slab_cpu_t;
+
+struct kmem_cache {
+    char name[SLAB_NAME_MAX];
+    uint32_t obj_size;
+    uint32_t order;
+    uint32_t per_slab;
+    uint32_t first_offset;
+    int use_magazines;
+    spinlock_t lock;
+    slab_t *partial;
+    slab_t *full;
+    slab_t *empty;
+    uint32_t slabs;
+    magazine_t *depot_full;
+    magazine_t *depot_empty;
+    slab_cpu_t cpu[CPU_MAX];
+};
+
+static kmem_cache_t caches[SLAB_MAX_CACHES];
+static int cache_count;
+static kmem_cache_t *magazine_cache;
+static kmem_cache_t *kmalloc_caches[ARRAY_SIZE(kmalloc_sizes)];
+static uint32_t large_pages;
+static spinlock_t caches_lock = SPINLOCK_INIT;
+
+/* Marks page blocks handed straight to kmalloc callers. */
+static kmem_cache_t large_owner;
+
+static void list_add(slab_t **head, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void list_del(slab_t **head, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = NULL;
+}
+
+static slab_t *slab_grow(kmem_cache_t *cache) {
+    uint32_t base = pmm_alloc_pages(cache->order);
+    if (!base) {
+        return NULL;
+    }
+    slab_t *slab = (slab_t *)(uintptr_t)base;
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+    uint8_t *obj = (uint8_t *)slab + cache->first_offset;
+    for (uint32_t i = 0; i < cache->per_slab; ++i) {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+        obj += cache->obj_size;
+    }
+    pmm_set_owner(base, 1u << cache->order, slab);
+    ++cache->slabs;
+    return slab;
+}
+
+static void *slab_alloc_locked(kmem_cache_t *cache) {
+    slab_t *slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        if (slab) {
+            list_del(&cache->empty, slab);
+        } else if ((slab = slab_grow(cache)) == NULL) {
+            return NULL;
+        }
+        list_add(&cache->partial, slab);
+    }
+    void *obj = slab->free;
+    slab->free = *(void **)obj;
+    if (++slab->inuse == cache->per_slab) {
+        list_del(&cache->partial, slab);
+        list_add(&cache->full, slab);
+    }
+    return obj;
+}
+
+/* One empty slab is kept per cache to absorb alloc/free churn at the
+ * boundary; further empty slabs go back to the page allocator. */
+static void slab_free_locked(kmem_cache_t *cache, slab_t *slab, void *obj) {
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    if (slab->inuse-- == cache->per_slab) {
+        list_del(&cache->full, slab);
+        list_add(&cache->partial, slab);
+    }
+    if (slab->inuse == 0) {
+        list_del(&cache->partial, slab);
+        if (cache->empty) {
+            uint32_t base = (uint32_t)(uintptr_t)slab;
+            pmm_set_owner(base, 1u << cache->order, NULL);
+            pmm_free_pages(base, cache->order);
+            --cache->slabs;
+        } else {
+            list_add(&cache->empty, slab);
+        }
+    }
+}
+
+static kmem_cache_t *cache_setup(const char *name, uint32_t obj_size, int use_magazines) {
+    uint32_t flags = spin_lock_irqsave(&caches_lock);
+    if (cache_count >= SLAB_MAX_CACHES) {
+        spin_unlock_irqrestore(&caches_lock, flags);
+        return NULL;
+    }
+    kmem_cache_t *cache = &caches[cache_count++];
+    spin_unlock_irqrestore(&caches_lock, flags);
+
+    kmemset(cache, 0, sizeof(*cache));
+    kstrncpy(cache->name, name, SLAB_NAME_MAX - 1);
+    uint32_t align = obj_size < SLAB_ALIGN ? sizeof(void *) : SLAB_ALIGN;
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    cache->obj_size = (obj_size + align - 1) & ~(align - 1);
+    cache->first_offset = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    cache->order = 0;
+    while (cache->order < SLAB_MAX_ORDER &&
+           ((PMM_PAGE_SIZE << cache->order) - cache->first_offset) / cache->obj_size < SLAB_MIN_OBJECTS) {
+        ++cache->order;
+    }
+    cache->per_slab = ((PMM_PAGE_SIZE << cache->order) - cache->first_offset) / cache->obj_size;
+    cache->use_magazines = use_magazines;
+    return cache;
+}
+
+void slab_init(void) {
+    cache_count = 0;
+    large_pages = 0;
+    magazine_cache = cache_setup("magazine", sizeof(magazine_t), 0);
+    for (size_t i = 0; i < ARRAY_SIZE(kmalloc_sizes); ++i) {
+        char name[SLAB_NAME_MAX];
+        char num[8];
+        kstrncpy(name, "kmalloc-", sizeof(name) - 1);
+        kitoa((int)kmalloc_sizes[i], num, sizeof(num));
+        kstrcat(name, num, sizeof(name));
+        kmalloc_caches[i] = cache_setup(name, kmalloc_sizes[i], 1);
+    }
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t obj_size) {
+    if (!obj_size || obj_size > (PMM_PAGE_SIZE << SLAB_MAX_ORDER) / SLAB_MIN_OBJECTS) {
+        return NULL;
+    }
+    return cache_setup(name, obj_size, 1);
+}
+
+static magazine_t *magazine_new(void) {
+    uint32_t flags = spin_lock_irqsave(&magazine_cache->lock);
+    magazine_t *mag = (magazine_t *)slab_alloc_locked(magazine_cache);
+    spin_unlock_irqrestore(&magazine_cache->lock, flags);
+    if (mag) {
+        mag->next = NULL;
+        mag->rounds = 0;
+    }
+    return mag;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    if (!cache) {
+        return NULL;
+    }
+    uint32_t flags = cpu_irq_save();
+    slab_cpu_t *cpu = &cache->cpu[cpu_current()];
+    ++cpu->allocs;
+    if (cache->use_magazines) {
+        if (!(cpu->loaded && cpu->loaded->rounds) && cpu->previous && cpu->previous->rounds) {
+            magazine_t *tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        }
+        if (cpu->loaded && cpu->loaded->rounds) {
+            ++cpu->hits;
+            void *obj = cpu->loaded->objs[--cpu->loaded->rounds];
+            cpu_irq_restore(flags);
+            return obj;
+        }
+    }
+
+    spin_lock(&cache->lock);
+    void *obj = NULL;
+    if (cache->use_magazines && cache->depot_full) {
+        magazine_t *full = cache->depot_full;
+        cache->depot_full = full->next;
+        if (cpu->loaded) {
+            cpu->loaded->next = cache->depot_empty;
+            cache->depot_empty = cpu->loaded;
+        }
+        cpu->loaded = full;
+        obj = full->objs[--full->rounds];
+    } else {
+        obj = slab_alloc_locked(cache);
+    }
+    if (!obj) {
+        --cpu->allocs;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (!cache || !obj) {
+        return;
+    }
+    uint32_t flags = cpu_irq_save();
+    slab_cpu_t *cpu = &cache->cpu[cpu_current()];
+    ++cpu->frees;
+    if (cache->use_magazines) {
+        if (!(cpu->loaded && cpu->loaded->rounds < MAG_ROUNDS) && cpu->previous &&
+            cpu->previous->rounds < MAG_ROUNDS) {
+            magazine_t *tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        }
+        if (cpu->loaded && cpu->loaded->rounds < MAG_ROUNDS) {
+            cpu->loaded->objs[cpu->loaded->rounds++] = obj;
+            cpu_irq_restore(flags);
+            return;
+        }
+    }
+
+    /* Both magazines are full (or missing): park the previous one in the
+     * depot and start an empty one, falling back to the slab layer when
+     * no magazine can be had. */
+    spin_lock(&cache->lock);
+    magazine_t *empty = NULL;
+    if (cache->use_magazines) {
+        empty = cache->depot_empty;
+        if (empty) {
+            cache->depot_empty = empty->next;
+        } else {
+            empty = magazine_new();
+        }
+    }
+    if (empty) {
+        if (cpu->previous) {
+            cpu->previous->next = cache->depot_full;
+            cache->depot_full = cpu->previous;
+        }
+        cpu->previous = cpu->loaded;
+        cpu->loaded = empty;
+        empty->rounds = 0;
+        empty->objs[empty->rounds++] = obj;
+    } else {
+        slab_free_locked(cache, (slab_t *)pmm_owner((uint32_t)(uintptr_t)obj), obj);
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+static kmem_cache_t *kmalloc_cache_for(size_t size) {
+    for (size_t i = 0; i < ARRAY_SIZE(kmalloc_sizes); ++i) {
+        if (size <= kmalloc_sizes[i]) {
+            return kmalloc_caches[i];
+        }
+    }
+    return NULL;
+}
+
+/* Anything above the largest size class takes whole page blocks. */
+void *kmalloc(size_t size) {
+    if (!size) {
+        return NULL;
+    }
+    if (size <= KMALLOC_MAX_SIZE) {
+        return kmem_cache_alloc(kmalloc_cache_for(size));
+    }
+    uint32_t pages = (uint32_t)((size + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE);
+    uint32_t order = 0;
+    while ((1u << order) < pages) {
+        ++order;
+    }
+    uint32_t base = pmm_alloc_pages(order);
+    if (!base) {
+        return NULL;
+    }
+    pmm_set_owner(base, 1u << order, &large_owner);
+    __atomic_add_fetch(&large_pages, 1u << order, __ATOMIC_RELAXED);
+    return (void *)(uintptr_t)base;
+}
+
+void *kzalloc(size_t size) {
+    void *ptr = kmalloc(size);
+    if (ptr) {
+        kmemset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void kfree(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    uint32_t addr = (uint32_t)(uintptr_t)ptr;
+    void *owner = pmm_owner(addr);
+    if (owner == &large_owner) {
+        int order = pmm_block_order(addr);
+        if (order >= 0) {
+            __atomic_sub_fetch(&large_pages, 1u << order, __ATOMIC_RELAXED);
+            pmm_free_pages(addr, (uint32_t)order);
+            return;
+        }
+    } else if (owner) {
+        kmem_cache_free(((slab_t *)owner)->cache, ptr);
+        return;
+    }
+    log_event(LOG_ERROR, "kfree: pointer not from the heap");
+}
+
+int slab_cache_count(void) {
+    return cache_count;
+}
+
+int slab_cache_stats(int index, kmem_cache_stats_t *out) {
+    if (index < 0 || index >= cache_count) {
+        return -1;
+    }
+    kmem_cache_t *cache = &caches[index];
+    kmemset(out, 0, sizeof(*out));
+    kstrncpy(out->name, cache->name, SLAB_NAME_MAX - 1);
+    out->obj_size = cache->obj_size;
+    out->slabs = cache->slabs;
+    for (int c = 0; c < CPU_MAX; ++c) {
+        out->allocs += cache->cpu[c].allocs;
+        out->frees += cache->cpu[c].frees;
+        out->magazine_hits += cache->cpu[c].hits;
+    }
+    out->active = out->allocs - out->frees;
+    return 0;
+}
+
+uint32_t slab_large_pages(void) {
+    return large_pages;
+}
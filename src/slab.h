@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_NAME_MAX 16
+
+typedef struct kmem_cache kmem_cache_t;
+
+typedef struct {
+    char name[SLAB_NAME_MAX];
+    uint32_t obj_size;
+    uint32_t active;
+    uint32_t slabs;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t magazine_hits;
+} kmem_cache_stats_t;
+
+void slab_init(void);
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t obj_size);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void kfree(void *ptr);
+
+int slab_cache_count(void);
+int slab_cache_stats(int index, kmem_cache_stats_t *out);
+uint32_t slab_large_pages(void);
@@ -0,0 +1,176 @@
+#include "smp.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "memtype.h"
+#include "paging.h"
+#include "timer.h"
+#include "sched.h"
+#include "clock.h"
+#include "spinlock.h"
+#include "console.h"
+#include "common.h"
+
+/* Application processors are started one at a time with the INIT, STARTUP,
+ * STARTUP sequence from the MP spec. Each lands in trampoline.s, which
+ * switches to protected mode with paging on and calls ap_entry on the
+ * stack of that CPU's idle task. */
+#define SMP_INIT_DELAY_NS (10 * NSEC_PER_MSEC)
+#define SMP_SIPI_DELAY_NS (200 * NSEC_PER_USEC)
+#define SMP_BOOT_TIMEOUT_NS (100 * NSEC_PER_MSEC)
+
+typedef struct {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+} trampoline_params_t;
+
+extern const uint8_t smp_trampoline_start[];
+extern const uint8_t smp_trampoline_params[];
+extern const uint8_t smp_trampoline_end[];
+
+static uint32_t cpu_count;
+static volatile uint32_t online_mask;
+static volatile uint32_t booting_cpu;
+static spinlock_t call_lock = SPINLOCK_INIT;
+static volatile uint32_t call_pending;
+static smp_call_fn_t call_fn;
+static void *call_arg;
+
+/* Runs any cross-CPU call addressed to this CPU. Also polled while waiting
+ * for call_lock, so two CPUs calling each other with interrupts off cannot
+ * deadlock. */
+static void poll_calls(void) {
+    uint32_t bit = 1u << cpu_current();
+    if (__atomic_load_n(&call_pending, __ATOMIC_ACQUIRE) & bit) {
+        call_fn(call_arg);
+        __atomic_and_fetch(&call_pending, ~bit, __ATOMIC_RELEASE);
+    }
+}
+
+static void call_ipi(isr_frame_t *frame) {
+    (void)frame;
+    lapic_eoi();
+    poll_calls();
+}
+
+static void ap_entry(void) {
+    uint32_t cpu = booting_cpu;
+    gdt_load();
+    idt_load();
+    lapic_init_ap();
+    cpu_local_init(cpu, lapic_id());
+    cpu_init_ap();
+    memtype_init_ap();
+    timer_init_ap();
+    __atomic_or_fetch(&online_mask, 1u << cpu, __ATOMIC_RELEASE);
+    sched_start_cpu(cpu);
+}
+
+static int online(uint32_t cpu) {
+    return (__atomic_load_n(&online_mask, __ATOMIC_ACQUIRE) >> cpu) & 1u;
+}
+
+static int start_cpu(uint32_t apic_id, uint32_t cpu) {
+    lapic_send_init(apic_id);
+    ktime_spin_until(ktime_ns() + SMP_INIT_DELAY_NS);
+    for (int attempt = 0; attempt < 2 && !online(cpu); ++attempt) {
+        lapic_send_startup(apic_id, (uint8_t)(SMP_TRAMPOLINE_ADDR >> 12));
+        uint64_t deadline = ktime_ns() + (attempt ? SMP_BOOT_TIMEOUT_NS : SMP_SIPI_DELAY_NS);
+        while (!online(cpu) && ktime_ns() < deadline) {
+            cpu_relax();
+        }
+    }
+    return online(cpu) ? 0 : -1;
+}
+
+/* Needs ACPI, the local APIC, paging, the timer and the scheduler; runs
+ * on the boot CPU with interrupts still off. */
+void smp_init(void) {
+    cpu_count = 1;
+    online_mask = 1;
+    idt_set_handler(IPI_CALL_VECTOR, call_ipi);
+    const acpi_madt_info_t *madt = acpi_madt();
+    if (!madt || madt->cpu_count < 2 || !lapic_present() || !paging_enabled()) {
+        log_event(LOG_SUCCESS, "SMP: single CPU");
+        return;
+    }
+    uint32_t bsp_id = lapic_id();
+    cpu_local_of(0)->apic_id = bsp_id;
+
+    /* Low memory is outside the frame allocator and the multiboot data
+     * that may have lived there has been consumed by now. */
+    uint8_t *tramp = (uint8_t *)(uintptr_t)SMP_TRAMPOLINE_ADDR;
+    kmemcpy(tramp, smp_trampoline_start, (size_t)(smp_trampoline_end - smp_trampoline_start));
+    trampoline_params_t *params =
+        (trampoline_params_t *)(tramp + (smp_trampoline_params - smp_trampoline_start));
+    params->cr3 = read_cr3();
+    params->cr4 = read_cr4();
+    params->entry = (uint32_t)(uintptr_t)ap_entry;
+
+    for (int i = 0; i < madt->cpu_count && cpu_count < CPU_MAX; ++i) {
+        uint32_t apic_id = madt->cpu_apic_ids[i];
+        if (apic_id == bsp_id) {
+            continue;
+        }
+        uint32_t cpu = cpu_count;
+        params->stack = sched_prepare_cpu(cpu);
+        if (!params->stack) {
+            break;
+        }
+        booting_cpu = cpu;
+        if (start_cpu(apic_id, cpu) != 0) {
+            /* It may still wake up late on these parameters, so stop here
+             * rather than reuse them for the next CPU. */
+            log_event(LOG_WARN, "SMP: application processor did not start");
+            break;
+        }
+        ++cpu_count;
+    }
+
+    char msg[48];
+    char num[8];
+    kstrncpy(msg, "SMP: ", sizeof(msg) - 1);
+    kitoa((int)cpu_count, num, sizeof(num));
+    kstrcat(msg, num, sizeof(msg));
+    kstrcat(msg, cpu_count == 1 ? " CPU online" : " CPUs online", sizeof(msg));
+    log_text(LOG_SUCCESS, msg);
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+uint32_t smp_online_mask(void) {
+    return __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE);
+}
+
+void smp_send_ipi(uint32_t cpu, uint8_t vector) {
+    lapic_send_ipi(cpu_local_of(cpu)->apic_id, vector);
+}
+
+/* Runs fn(arg) in interrupt context on every other online CPU and returns
+ * once all of them have finished. One call is in flight at a time. */
+void smp_call_others(smp_call_fn_t fn, void *arg) {
+    if (!(smp_online_mask() & ~(1u << cpu_current()))) {
+        return;
+    }
+    uint32_t flags = cpu_irq_save();
+    while (!spin_trylock(&call_lock)) {
+        poll_calls();
+        cpu_relax();
+    }
+    uint32_t targets = smp_online_mask() & ~(1u << cpu_current());
+    call_fn = fn;
+    call_arg = arg;
+    __atomic_store_n(&call_pending, targets, __ATOMIC_RELEASE);
+    for (uint32_t bits = targets; bits; bits &= bits - 1) {
+        smp_send_ipi((uint32_t)__builtin_ctz(bits), IPI_CALL_VECTOR);
+    }
+    while (__atomic_load_n(&call_pending, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+    spin_unlock_irqrestore(&call_lock, flags);
+}
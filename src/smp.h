@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include "cpu.h"
+
+/* Page below 1 MB that application processors start executing at. */
+#define SMP_TRAMPOLINE_ADDR 0x8000u
+
+typedef void (*smp_call_fn_t)(void *arg);
+
+void smp_init(void);
+uint32_t smp_cpu_count(void);
+uint32_t smp_online_mask(void);
+void smp_send_ipi(uint32_t cpu, uint8_t vector);
+void smp_call_others(smp_call_fn_t fn, void *arg);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "cpu.h"
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0}
+
+static inline void spin_lock(spinlock_t *lock) {
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+static inline int spin_trylock(spinlock_t *lock) {
+    return !__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+/* FIFO-fair lock for longer critical sections: waiters take a ticket and
+ * spin until the owner count reaches it, so nobody starves under
+ * contention. */
+typedef struct {
+    volatile uint32_t next;
+    volatile uint32_t owner;
+} ticketlock_t;
+
+#define TICKETLOCK_INIT {0, 0}
+
+static inline void ticket_lock(ticketlock_t *lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ volatile("pause");
+    }
+}
+
+static inline void ticket_unlock(ticketlock_t *lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
@@ -2,18 +2,52 @@
 #include "fb.h"
 #include "process.h"
 #include "console.h"
+#include "compositor.h"
+#include "memtype.h"
+#include "pmm.h"
+#include "slab.h"
+#include "timer.h"
+#include "clock.h"
+#include "smp.h"
+#include "metrics.h"
+#include "blockchain.h"
 #include "common.h"
 
+#define SYSMON_REFRESH_NS (NSEC_PER_SEC / 2)
+#define SYSMON_MAX_ROWS 16
+#define SYSMON_METRIC_ROWS 5
+#define SYSMON_RATE_MIN_NS (NSEC_PER_SEC / 4)
+
 static int sysmon_open_flag;
 static int focus_index;
+static ktimer_t refresh_timer;
+static uint64_t rate_hashes;
+static uint64_t rate_ns;
+static uint32_t hash_rate;
+
+/* CPU figures only change over time, so redraw on a timer while open. */
+static void sysmon_refresh(void *arg) {
+    (void)arg;
+    if (sysmon_open_flag) {
+        comp_invalidate(PANEL_SYSMON);
+        timer_arm_in(&refresh_timer, SYSMON_REFRESH_NS);
+    }
+}
 
 void sysmon_open(void) {
     sysmon_open_flag = 1;
+    comp_invalidate(PANEL_SYSMON);
+    if (!timer_armed(&refresh_timer)) {
+        timer_setup(&refresh_timer, sysmon_refresh, NULL);
+        timer_arm_in(&refresh_timer, SYSMON_REFRESH_NS);
+    }
     log_event(LOG_SUCCESS, "SysMon opened");
 }
 
 void sysmon_close(void) {
     sysmon_open_flag = 0;
+    timer_cancel(&refresh_timer);
+    comp_invalidate(PANEL_SYSMON);
 }
 
 int sysmon_is_open(void) {
@@ -29,10 +63,15 @@ void sysmon_handle_input(char c) {
     }
 }
 
+static int table_rows(void) {
+    int count = proc_count();
+    return count < SYSMON_MAX_ROWS ? count : SYSMON_MAX_ROWS;
+}
+
 static void render_table(int x, int y) {
-    proc_t rows[16];
+    proc_t rows[SYSMON_MAX_ROWS];
     int count = proc_enumerate(rows, ARRAY_SIZE(rows));
-    fb_draw_text(x, y, "PID   CPU  MEM  TASK", 0x00FFAA00, 0x00101010);
+    fb_draw_text(x, y, "PID  PRI S C  CPU  MEM  TASK", 0x00FFAA00, 0x00101010);
     for (int i = 0; i < count; ++i) {
         char line[96];
         kmemset(line, 0, sizeof(line));
@@ -40,7 +79,16 @@ static void render_table(int x, int y) {
         char num[16];
         kitoa(rows[i].pid, num, sizeof(num));
         kstrcat(line, num, sizeof(line));
+        kstrcat(line, "    ", sizeof(line));
+        kitoa(rows[i].prio, num, sizeof(num));
+        kstrcat(line, num, sizeof(line));
         kstrcat(line, "   ", sizeof(line));
+        num[0] = rows[i].state;
+        num[1] = ' ';
+        num[2] = (char)('0' + rows[i].cpu);
+        num[3] = '\0';
+        kstrcat(line, num, sizeof(line));
+        kstrcat(line, "  ", sizeof(line));
         kitoa(rows[i].cpu_pct, num, sizeof(num));
         kstrcat(line, num, sizeof(line));
         kstrcat(line, "%  ", sizeof(line));
@@ -52,13 +100,190 @@ static void render_table(int x, int y) {
     }
 }
 
+static void render_display(int x, int y) {
+    char line[96];
+    char num[16];
+    kstrncpy(line, "FB ", sizeof(line) - 1);
+    kitoa(fb_width(), num, sizeof(num));
+    kstrcat(line, num, sizeof(line));
+    kstrcat(line, "x", sizeof(line));
+    kitoa(fb_height(), num, sizeof(num));
+    kstrcat(line, num, sizeof(line));
+    kstrcat(line, " ", sizeof(line));
+    kstrcat(line, fb_present_name(), sizeof(line));
+    kstrcat(line, "  mem ", sizeof(line));
+    if (fb_vram()) {
+        kstrcat(line, memtype_name(memtype_effective((uint32_t)(uintptr_t)fb_vram())), sizeof(line));
+    } else {
+        kstrcat(line, "RAM", sizeof(line));
+    }
+    fb_draw_text(x, y, line, 0x00A0A0FF, 0x00202040);
+}
+
+static void render_memory(int x, int y) {
+    pmm_stats_t st;
+    pmm_get_stats(&st);
+    char line[96];
+    char num[16];
+    kstrncpy(line, "RAM ", sizeof(line) - 1);
+    kitoa((int)((st.total_pages - st.free_pages) >> 8), num, sizeof(num));
+    kstrcat(line, num, sizeof(line));
+    kstrcat(line, " MB used  ", sizeof(line));
+    kitoa((int)(st.free_pages >> 8), num, sizeof(num));
+    kstrcat(line, num, sizeof(line));
+    kstrcat(line, " MB free  of ", sizeof(line));
+    kitoa((int)(st.total_pages >> 8), num, sizeof(num));
+    kstrcat(line, num, sizeof(line));
+    kstrcat(line, " MB", sizeof(line));
+    fb_draw_text(x, y, line, 0x00A0FFA0, 0x00202040);
+}
+
+static void render_heap(int x, int y) {
+    fb_draw_text(x, y, "CACHE          SIZE  ACTIVE  SLABS", 0x00FFAA00, 0x00202040);
+    int count = slab_cache_count();
+    for (int i = 0; i < count; ++i) {
+        kmem_cache_stats_t st;
+        if (slab_cache_stats(i, &st) != 0) {
+            continue;
+        }
+        char line[96];
+        char num[16];
+        kmemset(line, ' ', 40);
+        line[40] = '\0';
+        kmemcpy(line, st.name, kstrlen(st.name));
+        kitoa((int)st.obj_size, num, sizeof(num));
+        kmemcpy(line + 15, num, kstrlen(num));
+        kitoa((int)st.active, num, sizeof(num));
+        kmemcpy(line + 21, num, kstrlen(num));
+        kitoa((int)st.slabs, num, sizeof(num));
+        kmemcpy(line + 29, num, kstrlen(num));
+        fb_draw_text(x, y + 16 * (i + 1), line, 0x00FFFFFF, 0x00202040);
+    }
+}
+
+static void append_uint(char *line, size_t len, const char *label, uint32_t value, const char *suffix) {
+    char num[16];
+    kstrcat(line, label, len);
+    kitoa((int)value, num, sizeof(num));
+    kstrcat(line, num, len);
+    kstrcat(line, suffix, len);
+}
+
+/* Milliseconds with two decimals. */
+static void append_ms(char *line, size_t len, const char *label, uint64_t ns) {
+    uint32_t us = (uint32_t)kdiv64(ns, NSEC_PER_USEC, 0);
+    char num[16];
+    kstrcat(line, label, len);
+    kitoa((int)(us / 1000), num, sizeof(num));
+    kstrcat(line, num, len);
+    kstrcat(line, ".", len);
+    num[0] = (char)('0' + us / 100 % 10);
+    num[1] = (char)('0' + us / 10 % 10);
+    num[2] = '\0';
+    kstrcat(line, num, len);
+    kstrcat(line, "ms", len);
+}
+
+/* Average kilocycles per call of a render or input span. */
+static void append_span(char *line, size_t len, const char *label, const metrics_t *m, metric_span_t span) {
+    uint32_t calls = m->calls[span];
+    uint32_t kcycles = calls ? (uint32_t)kdiv64(kdiv64(m->cycles[span], calls, 0), 1000, 0) : 0;
+    append_uint(line, len, label, kcycles, "k ");
+}
+
+/* Hash throughput is a rate between refreshes, so short gaps from other
+ * invalidations keep the previous figure. The gap is taken in milliseconds
+ * so panels left idle for seconds still divide by their real interval. */
+static void update_hash_rate(const metrics_t *m, uint64_t now) {
+    uint64_t elapsed = now - rate_ns;
+    if (rate_ns && elapsed < SYSMON_RATE_MIN_NS) {
+        return;
+    }
+    uint64_t hashes = m->counts[METRIC_HASHES];
+    uint64_t elapsed_ms = kdiv64(elapsed, NSEC_PER_MSEC, 0);
+    if (rate_ns && elapsed_ms <= 0xFFFFFFFFull) {
+        hash_rate = (uint32_t)kdiv64((hashes - rate_hashes) * 1000, (uint32_t)elapsed_ms, 0);
+    }
+    rate_hashes = hashes;
+    rate_ns = now;
+}
+
+static void render_metrics(int x, int y) {
+    metrics_t m;
+    frame_stats_t frames;
+    uint64_t now = ktime_ns();
+    metrics_sum(&m);
+    metrics_frame_stats(&frames, now);
+    update_hash_rate(&m, now);
+
+    char line[96];
+    line[0] = '\0';
+    append_uint(line, sizeof(line), "FRAME ", frames.fps, " FPS ");
+    append_ms(line, sizeof(line), " p50 ", frames.p50_ns);
+    append_ms(line, sizeof(line), " p95 ", frames.p95_ns);
+    append_ms(line, sizeof(line), " p99 ", frames.p99_ns);
+    fb_draw_text(x, y, line, 0x00FFD060, 0x00202040);
+
+    line[0] = '\0';
+    append_span(line, sizeof(line), "CYC SYSMON ", &m, METRIC_SPAN_SYSMON);
+    append_span(line, sizeof(line), "CONSOLE ", &m, METRIC_SPAN_CONSOLE);
+    append_span(line, sizeof(line), "SHELL ", &m, METRIC_SPAN_SHELL);
+    fb_draw_text(x, y + 16, line, 0x00FFD060, 0x00202040);
+
+    line[0] = '\0';
+    append_span(line, sizeof(line), "    INSTALL ", &m, METRIC_SPAN_INSTALLER);
+    append_span(line, sizeof(line), "INPUT ", &m, METRIC_SPAN_INPUT);
+    append_span(line, sizeof(line), "BAR ", &m, METRIC_SPAN_BAR);
+    fb_draw_text(x, y + 32, line, 0x00FFD060, 0x00202040);
+
+    line[0] = '\0';
+    append_uint(line, sizeof(line), "HASH ", hash_rate, "/s  ");
+    append_uint(line, sizeof(line), "", (uint32_t)kdiv64(m.counts[METRIC_HASH_BYTES], 1024, 0), " KB  ");
+    append_uint(line, sizeof(line), "VERIFIED ", (uint32_t)m.counts[METRIC_BLOCKS_VERIFIED], " blocks");
+    fb_draw_text(x, y + 48, line, 0x00A0FFA0, 0x00202040);
+
+    uint32_t slab_bytes = 0;
+    int caches = slab_cache_count();
+    for (int i = 0; i < caches; ++i) {
+        kmem_cache_stats_t st;
+        if (slab_cache_stats(i, &st) == 0) {
+            slab_bytes += st.active * st.obj_size;
+        }
+    }
+    line[0] = '\0';
+    append_uint(line, sizeof(line), "CHAINS ", blockchain_chain_count(), " ");
+    append_uint(line, sizeof(line), "", blockchain_memory_kb(), " KB  ");
+    append_uint(line, sizeof(line), "SLAB ", slab_bytes >> 10, " KB  ");
+    append_uint(line, sizeof(line), "LARGE ", slab_large_pages() * 4, " KB");
+    fb_draw_text(x, y + 64, line, 0x00A0FFA0, 0x00202040);
+}
+
+void sysmon_bounds(fb_rect_t *out) {
+    out->x = 8;
+    out->y = 48;
+    out->w = fb_width() / 2 - 16;
+    out->h = 100 + 16 * (table_rows() + 1) + 16 * (slab_cache_count() + 1) + 16 * SYSMON_METRIC_ROWS + 8;
+}
+
 void sysmon_render(void) {
     if (!sysmon_open_flag) {
         return;
     }
-    int w = fb_width();
-    fb_fillrect(8, 48, w / 2 - 16, 180, 0x00202040);
-    fb_draw_text(16, 56, "SYSTEM MONITOR", 0x00FFFFFF, 0x00000000);
-    render_table(16, 72);
+    fb_rect_t r;
+    sysmon_bounds(&r);
+    fb_shadow(r.x, r.y, r.w, r.h, 8, 0x60);
+    fb_fillrect(r.x, r.y, r.w, r.h, 0x00202040);
+    char title[48];
+    char num[8];
+    kstrncpy(title, "SYSTEM MONITOR  ", sizeof(title) - 1);
+    kitoa((int)smp_cpu_count(), num, sizeof(num));
+    kstrcat(title, num, sizeof(title));
+    kstrcat(title, smp_cpu_count() == 1 ? " CPU" : " CPUs", sizeof(title));
+    fb_draw_text(r.x + 8, r.y + 8, title, 0x00FFFFFF, 0x00000000);
+    render_table(r.x + 8, r.y + 24);
+    render_metrics(r.x + 8, r.y + r.h - 64 - 16 * (slab_cache_count() + 1) - 16 * SYSMON_METRIC_ROWS);
+    render_heap(r.x + 8, r.y + r.h - 56 - 16 * (slab_cache_count() + 1));
+    render_memory(r.x + 8, r.y + r.h - 40);
+    render_display(r.x + 8, r.y + r.h - 24);
 }
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "fb.h"
+
 void sysmon_open(void);
 void sysmon_close(void);
 int sysmon_is_open(void);
+void sysmon_bounds(fb_rect_t *out);
 void sysmon_render(void);
 void sysmon_handle_input(char c);
 
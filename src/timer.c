@@ -0,0 +1,483 @@
+#include "timer.h"
+#include "clock.h"
+#include "cpu.h"
+#include "idt.h"
+#include "irq.h"
+#include "lapic.h"
+#include "pit.h"
+#include "sched.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "console.h"
+#include "common.h"
+
+/* Hierarchical wheel in the classic cascading style: level 0 resolves one
+ * tick (2^20 ns, ~1.05 ms) across 64 slots, each further level covers 64x
+ * the span of the one below. Timers beyond the top level are parked in its
+ * furthest slot and re-placed from their deadline when it cascades.
+ *
+ * The wheel is shared and driven from the boot CPU's timer; application
+ * processors only use their local APIC timer to end scheduler slices. */
+#define TIMER_TICK_SHIFT 20
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1u << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_DELTA ((1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+#define TIMER_MAX_PROGRAM_NS 0xFFFFFFFFull
+#define TIMER_MIN_PROGRAM_NS 20000u
+
+typedef enum {
+    TIMER_HW_NONE,
+    TIMER_HW_LAPIC,
+    TIMER_HW_PIT
+} timer_hw_t;
+
+static ktimer_t *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t occupied[WHEEL_LEVELS];
+static uint64_t wheel_base;
+static uint32_t active;
+static timer_hw_t hw;
+static uint32_t lapic_khz;
+static uint64_t hw_deadline = TIMER_NONE;
+static uint64_t preempt_deadline[CPU_MAX];
+static uint64_t sample_deadline[CPU_MAX];
+static uint64_t sample_period;
+static timer_sample_fn_t sample_fn;
+static volatile int expiry_pending;
+static sched_event_t expiry_event;
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+static uint64_t tick_ceil(uint64_t ns) {
+    return (ns + (1u << TIMER_TICK_SHIFT) - 1) >> TIMER_TICK_SHIFT;
+}
+
+/* Distance from start to the next set bit in a 64-slot ring, or 64 when
+ * the ring is empty. */
+static uint32_t ring_distance(uint64_t bits, uint32_t start) {
+    if (!bits) {
+        return WHEEL_SIZE;
+    }
+    uint64_t rotated = start ? (bits >> start) | (bits << (WHEEL_SIZE - start)) : bits;
+    uint32_t lo = (uint32_t)rotated;
+    return lo ? (uint32_t)__builtin_ctz(lo) : 32u + (uint32_t)__builtin_ctz((uint32_t)(rotated >> 32));
+}
+
+static void enqueue(ktimer_t *timer) {
+    uint64_t expires = tick_ceil(timer->deadline);
+    if (expires < wheel_base) {
+        expires = wheel_base;
+    }
+    uint64_t delta = expires - wheel_base;
+    uint32_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    if (delta > WHEEL_MAX_DELTA) {
+        expires = wheel_base + WHEEL_MAX_DELTA;
+    }
+    uint32_t slot = (uint32_t)(expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    timer->prev = NULL;
+    timer->next = wheel[level][slot];
+    if (timer->next) {
+        timer->next->prev = timer;
+    }
+    wheel[level][slot] = timer;
+    occupied[level] |= 1ull << slot;
+}
+
+static void unlink(ktimer_t *timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    if (!wheel[timer->level][timer->slot]) {
+        occupied[timer->level] &= ~(1ull << timer->slot);
+    }
+    timer->next = timer->prev = NULL;
+}
+
+/* Re-place every timer of the level's current slot one level down;
+ * returns the slot index so callers can stop at the first non-wrap. */
+static uint32_t cascade(uint32_t level) {
+    uint32_t idx = (uint32_t)(wheel_base >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    ktimer_t *list = wheel[level][idx];
+    wheel[level][idx] = NULL;
+    occupied[level] &= ~(1ull << idx);
+    while (list) {
+        ktimer_t *next = list->next;
+        enqueue(list);
+        list = next;
+    }
+    return idx;
+}
+
+static uint64_t next_deadline(void) {
+    uint64_t best = TIMER_NONE;
+    if (occupied[0]) {
+        best = wheel_base + ring_distance(occupied[0], (uint32_t)wheel_base & WHEEL_MASK);
+    }
+    for (uint32_t level = 1; level < WHEEL_LEVELS; ++level) {
+        if (!occupied[level]) {
+            continue;
+        }
+        /* The current slot still counts when base sits exactly on its
+         * boundary: that cascade is due but has not run yet. */
+        uint32_t shift = WHEEL_BITS * level;
+        uint64_t first = wheel_base >> shift;
+        if (wheel_base & ((1ull << shift) - 1)) {
+            ++first;
+        }
+        uint32_t start = (uint32_t)first & WHEEL_MASK;
+        uint64_t tick = (first + ring_distance(occupied[level], start)) << shift;
+        if (tick < best) {
+            best = tick;
+        }
+    }
+    return best == TIMER_NONE ? TIMER_NONE : best << TIMER_TICK_SHIFT;
+}
+
+static void program_hw(uint64_t delay_ns) {
+    if (delay_ns > TIMER_MAX_PROGRAM_NS) {
+        delay_ns = TIMER_MAX_PROGRAM_NS;
+    }
+    if (hw == TIMER_HW_LAPIC) {
+        uint64_t count = kdiv64(delay_ns * lapic_khz, NSEC_PER_MSEC, 0);
+        lapic_timer_oneshot(count > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)count);
+    } else if (hw == TIMER_HW_PIT) {
+        uint64_t count = kdiv64(delay_ns * PIT_HZ, NSEC_PER_SEC, 0);
+        pit_oneshot(count > PIT_MAX_COUNT ? PIT_MAX_COUNT : (uint32_t)count);
+    }
+}
+
+static void stop_hw(void) {
+    if (hw == TIMER_HW_LAPIC) {
+        lapic_timer_stop();
+    } else if (hw == TIMER_HW_PIT) {
+        pit_stop();
+    }
+}
+
+/* A CPU's own deadlines: its slice end and its next profiling sample. */
+static uint64_t local_deadline(uint32_t cpu) {
+    return sample_deadline[cpu] < preempt_deadline[cpu] ? sample_deadline[cpu] : preempt_deadline[cpu];
+}
+
+/* Boot CPU, timer_lock held. The one-shot always targets the earlier of
+ * the next wheel deadline and the CPU's local deadlines; while an expiry is
+ * pending the wheel is ignored so an overdue slot cannot re-fire the IRQ in
+ * a loop. */
+static void reprogram_hw(void) {
+    uint64_t deadline = expiry_pending ? TIMER_NONE : next_deadline();
+    if (local_deadline(0) < deadline) {
+        deadline = local_deadline(0);
+    }
+    if (deadline == TIMER_NONE) {
+        stop_hw();
+        hw_deadline = TIMER_NONE;
+        return;
+    }
+    uint64_t now = ktime_ns();
+    uint64_t delay = deadline > now + TIMER_MIN_PROGRAM_NS ? deadline - now : TIMER_MIN_PROGRAM_NS;
+    if (delay > TIMER_MAX_PROGRAM_NS) {
+        delay = TIMER_MAX_PROGRAM_NS;
+    }
+    program_hw(delay);
+    hw_deadline = now + delay;
+}
+
+/* Expiry itself is deferred to the timer thread so callbacks run in task
+ * context; the interrupt only hands over due work and ends slices. */
+static void timer_hw_irq(void) {
+    uint64_t now = ktime_ns();
+    int expired = 0;
+    spin_lock(&timer_lock);
+    hw_deadline = TIMER_NONE;
+    if (!expiry_pending && next_deadline() <= now) {
+        expiry_pending = 1;
+        expired = 1;
+    }
+    if (preempt_deadline[0] <= now) {
+        preempt_deadline[0] = TIMER_NONE;
+        sched_preempt_tick();
+    }
+    reprogram_hw();
+    spin_unlock(&timer_lock);
+    if (expired) {
+        sched_event_signal(&expiry_event);
+    }
+}
+
+/* An application processor's own one-shot, which only ever carries its
+ * local deadlines. Interrupts off. */
+static void program_local(uint64_t deadline) {
+    if (!lapic_khz) {
+        return;
+    }
+    if (deadline == TIMER_NONE) {
+        lapic_timer_stop();
+        return;
+    }
+    uint64_t now = ktime_ns();
+    program_hw(deadline > now + TIMER_MIN_PROGRAM_NS ? deadline - now : TIMER_MIN_PROGRAM_NS);
+}
+
+static void ap_timer_irq(void) {
+    uint32_t cpu = cpu_current();
+    if (preempt_deadline[cpu] <= ktime_ns()) {
+        preempt_deadline[cpu] = TIMER_NONE;
+        sched_preempt_tick();
+    }
+    program_local(local_deadline(cpu));
+}
+
+/* Hands the interrupted frame to the sampler when this CPU's sample is
+ * due; the hardware is reprogrammed for the next one by the caller. */
+static void sample_tick(isr_frame_t *frame, uint32_t cpu) {
+    timer_sample_fn_t fn = sample_fn;
+    uint64_t now = ktime_ns();
+    if (!fn || sample_deadline[cpu] > now) {
+        return;
+    }
+    sample_deadline[cpu] = now + sample_period;
+    fn(frame);
+}
+
+static void lapic_timer_irq(isr_frame_t *frame) {
+    lapic_eoi();
+    sample_tick(frame, cpu_current());
+    if (cpu_current()) {
+        ap_timer_irq();
+    } else {
+        timer_hw_irq();
+    }
+}
+
+/* Sent by an application processor that armed a timer earlier than the
+ * one the boot CPU has programmed. */
+static void kick_irq(isr_frame_t *frame) {
+    (void)frame;
+    lapic_eoi();
+    spin_lock(&timer_lock);
+    reprogram_hw();
+    spin_unlock(&timer_lock);
+}
+
+static void pit_irq(isr_frame_t *frame) {
+    sample_tick(frame, 0);
+    timer_hw_irq();
+}
+
+static void timer_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        sched_event_wait(&expiry_event);
+        timer_run_expired();
+        uint32_t flags = spin_lock_irqsave(&timer_lock);
+        expiry_pending = 0;
+        reprogram_hw();
+        spin_unlock_irqrestore(&timer_lock, flags);
+    }
+}
+
+void timer_init(void) {
+    kmemset(wheel, 0, sizeof(wheel));
+    kmemset(occupied, 0, sizeof(occupied));
+    wheel_base = ktime_ns() >> TIMER_TICK_SHIFT;
+    active = 0;
+    hw_deadline = TIMER_NONE;
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        preempt_deadline[cpu] = TIMER_NONE;
+        sample_deadline[cpu] = TIMER_NONE;
+    }
+    sample_fn = NULL;
+    expiry_pending = 0;
+    sched_event_init(&expiry_event);
+
+    hw = TIMER_HW_NONE;
+    lapic_khz = lapic_present() ? lapic_timer_init(LAPIC_TIMER_VECTOR) : 0;
+    if (lapic_khz) {
+        idt_set_handler(LAPIC_TIMER_VECTOR, lapic_timer_irq);
+        idt_set_handler(IPI_TIMER_VECTOR, kick_irq);
+        hw = TIMER_HW_LAPIC;
+    } else if (clock_source_khz()) {
+        pit_stop();
+        irq_register(IRQ_TIMER, pit_irq);
+        irq_unmask(IRQ_TIMER);
+        hw = TIMER_HW_PIT;
+    }
+
+    char msg[64];
+    kstrncpy(msg, "Timer wheel on ", sizeof(msg) - 1);
+    kstrcat(msg, timer_hw_name(), sizeof(msg));
+    log_text(hw == TIMER_HW_NONE ? LOG_WARN : LOG_SUCCESS, msg);
+}
+
+void timer_init_ap(void) {
+    if (lapic_khz) {
+        lapic_timer_init_ap(LAPIC_TIMER_VECTOR);
+    }
+}
+
+void timer_start_thread(void) {
+    task_spawn("ktimerd", timer_thread, NULL, SCHED_PRIO_TIMER);
+}
+
+const char *timer_hw_name(void) {
+    switch (hw) {
+        case TIMER_HW_LAPIC: return "LAPIC one-shot";
+        case TIMER_HW_PIT: return "PIT one-shot";
+        default: return "no timer hardware";
+    }
+}
+
+void timer_setup(ktimer_t *timer, ktimer_fn_t fn, void *arg) {
+    kmemset(timer, 0, sizeof(*timer));
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void timer_arm(ktimer_t *timer, uint64_t deadline_ns) {
+    int kick = 0;
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    if (timer->armed) {
+        unlink(timer);
+    } else {
+        timer->armed = 1;
+        ++active;
+    }
+    timer->deadline = deadline_ns;
+    enqueue(timer);
+    if (deadline_ns < hw_deadline && !expiry_pending) {
+        if (cpu_current() == 0) {
+            reprogram_hw();
+        } else {
+            kick = 1;
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    if (kick) {
+        smp_send_ipi(0, IPI_TIMER_VECTOR);
+    }
+}
+
+void timer_arm_in(ktimer_t *timer, uint64_t delay_ns) {
+    timer_arm(timer, ktime_ns() + delay_ns);
+}
+
+int timer_cancel(ktimer_t *timer) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    int was_armed = timer->armed;
+    if (was_armed) {
+        unlink(timer);
+        timer->armed = 0;
+        --active;
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return was_armed;
+}
+
+int timer_armed(const ktimer_t *timer) {
+    return timer->armed;
+}
+
+uint32_t timer_active_count(void) {
+    return active;
+}
+
+/* Advances the wheel to the current tick and runs what expired. Empty
+ * stretches of level 0 are skipped up to the next cascade boundary, so a
+ * long idle period costs a few steps rather than one per tick. */
+int timer_run_expired(void) {
+    int fired = 0;
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    uint64_t target = ktime_ns() >> TIMER_TICK_SHIFT;
+    while (wheel_base <= target) {
+        uint32_t idx = (uint32_t)wheel_base & WHEEL_MASK;
+        if (!idx && !cascade(1) && !cascade(2)) {
+            cascade(3);
+        }
+        uint32_t skip = ring_distance(occupied[0], idx);
+        if (skip) {
+            if (skip > WHEEL_SIZE - idx) {
+                skip = WHEEL_SIZE - idx;
+            }
+            /* Never run ahead of real time, or timers armed next would be
+             * clamped forward to the skipped-to tick. */
+            if (wheel_base + skip > target + 1) {
+                skip = (uint32_t)(target + 1 - wheel_base);
+            }
+            wheel_base += skip;
+            continue;
+        }
+
+        ++wheel_base;
+        ktimer_t *timer;
+        while ((timer = wheel[0][idx]) != NULL) {
+            unlink(timer);
+            timer->armed = 0;
+            --active;
+            spin_unlock_irqrestore(&timer_lock, flags);
+            timer->fn(timer->arg);
+            ++fired;
+            flags = spin_lock_irqsave(&timer_lock);
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return fired;
+}
+
+/* Ends the calling CPU's time slice at deadline_ns (TIMER_NONE to run
+ * untimed); called by the scheduler with interrupts off. A cleared slice
+ * may still cost one early interrupt, which just reprograms. */
+void timer_set_preempt(uint64_t deadline_ns) {
+    uint32_t cpu = cpu_current();
+    preempt_deadline[cpu] = deadline_ns;
+    if (cpu) {
+        program_local(local_deadline(cpu));
+        return;
+    }
+    spin_lock(&timer_lock);
+    if (deadline_ns < hw_deadline) {
+        reprogram_hw();
+    }
+    spin_unlock(&timer_lock);
+}
+
+static void resync_local(void *arg) {
+    (void)arg;
+    uint32_t cpu = cpu_current();
+    if (cpu) {
+        uint32_t flags = cpu_irq_save();
+        program_local(local_deadline(cpu));
+        cpu_irq_restore(flags);
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    reprogram_hw();
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/* Calls fn with the interrupted frame every period_ns on each online CPU,
+ * from its timer interrupt; fn NULL stops sampling. Application processors
+ * only sample with a local APIC timer. */
+void timer_set_sampler(timer_sample_fn_t fn, uint64_t period_ns) {
+    uint64_t first = fn ? ktime_ns() + period_ns : TIMER_NONE;
+    sample_period = period_ns;
+    sample_fn = fn;
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        sample_deadline[cpu] = first;
+    }
+    if (hw == TIMER_HW_NONE) {
+        return;
+    }
+    resync_local(NULL);
+    smp_call_others(resync_local, NULL);
+}
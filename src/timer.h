@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include "idt.h"
+
+#define TIMER_NONE ~0ull
+
+typedef void (*ktimer_fn_t)(void *arg);
+typedef void (*timer_sample_fn_t)(isr_frame_t *frame);
+
+/* Caller-owned timer; arming links it into the wheel, so it must stay
+ * alive until it fires or is cancelled. */
+typedef struct ktimer {
+    struct ktimer *next;
+    struct ktimer *prev;
+    uint64_t deadline;
+    uint8_t level;
+    uint8_t slot;
+    uint8_t armed;
+    ktimer_fn_t fn;
+    void *arg;
+} ktimer_t;
+
+void timer_init(void);
+void timer_init_ap(void);
+void timer_start_thread(void);
+const char *timer_hw_name(void);
+void timer_setup(ktimer_t *timer, ktimer_fn_t fn, void *arg);
+void timer_arm(ktimer_t *timer, uint64_t deadline_ns);
+void timer_arm_in(ktimer_t *timer, uint64_t delay_ns);
+int timer_cancel(ktimer_t *timer);
+int timer_armed(const ktimer_t *timer);
+uint32_t timer_active_count(void);
+int timer_run_expired(void);
+void timer_set_preempt(uint64_t deadline_ns);
+void timer_set_sampler(timer_sample_fn_t fn, uint64_t period_ns);
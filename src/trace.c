@@ -0,0 +1,149 @@
+#include "trace.h"
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "io.h"
+#include "serial.h"
+#include "sched.h"
+#include "smp.h"
+#include "common.h"
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_DUMP_VERSION 2
+#define DEBUGCON_PORT 0xE9
+
+typedef struct {
+    uint32_t head;
+    trace_record_t records[TRACE_RING_SIZE];
+} __attribute__((aligned(64))) trace_ring_t;
+
+_Static_assert(sizeof(trace_record_t) == 20, "trace2chrome.py RECORD layout");
+
+/* Indexed by trace_event_t; the dump carries this table so the host tool
+ * needs no copy of it. */
+static const char *const event_names[TRACE_EVENTS] = {
+    [TRACE_GUI_INPUT] = "gui.input",
+    [TRACE_GUI_COMPLETIONS] = "gui.completions",
+    [TRACE_GUI_COMPOSE] = "gui.compose",
+    [TRACE_BLOCK_ADD] = "blockchain.add_block",
+    [TRACE_CHAIN_VERIFY] = "blockchain.verify",
+    [TRACE_SCRUB] = "blockchain.scrub",
+    [TRACE_SHA256] = "crypto.sha256",
+    [TRACE_FS_CREATE] = "fs.create",
+    [TRACE_FS_MODIFY] = "fs.modify",
+    [TRACE_WORK] = "workqueue.item",
+};
+
+static trace_ring_t rings[CPU_MAX];
+static int use_tsc;
+
+volatile uint32_t trace_enabled;
+
+/* The TSC when it is the clocksource, so records cost one rdtsc; the dump
+ * header carries the matching frequency either way. */
+static inline uint64_t trace_clock(void) {
+    return use_tsc ? rdtsc() : ktime_cycles();
+}
+
+void trace_init(void) {
+    use_tsc = !kstrcmp(clock_source_name(), "TSC");
+    trace_enabled = 0;
+}
+
+/* Starting clears every ring, so a dump covers one capture window. */
+void trace_start(void) {
+    if (!clock_source_khz()) {
+        log_event(LOG_WARN, "Trace: no clocksource to timestamp with");
+        return;
+    }
+    for (uint32_t cpu = 0; cpu < CPU_MAX; ++cpu) {
+        rings[cpu].head = 0;
+    }
+    __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+}
+
+void trace_stop(void) {
+    __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+/* Interrupts are held off so a tracepoint in an IRQ handler cannot land
+ * in the slot this CPU is filling. */
+void trace_emit(uint32_t event, uint32_t phase, uint32_t arg) {
+    uint32_t flags = cpu_irq_save();
+    uint32_t cpu = cpu_current();
+    task_t *task = cpu_current_task();
+    trace_ring_t *ring = &rings[cpu];
+    trace_record_t *rec = &ring->records[ring->head & TRACE_RING_MASK];
+    rec->tsc = trace_clock();
+    rec->event = (uint16_t)event;
+    rec->phase = (uint8_t)phase;
+    rec->cpu = (uint8_t)cpu;
+    rec->arg = arg;
+    rec->pid = task ? task->pid : 0;
+    ++ring->head;
+    cpu_irq_restore(flags);
+}
+
+static void emit_bytes(trace_out_t out, const void *data, uint32_t len) {
+    if (out == TRACE_OUT_SERIAL) {
+        serial_write_raw(data, len);
+        return;
+    }
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (uint32_t i = 0; i < len; ++i) {
+        outb(DEBUGCON_PORT, bytes[i]);
+    }
+}
+
+static void emit_u32(trace_out_t out, uint32_t value) {
+    emit_bytes(out, &value, sizeof(value));
+}
+
+/* Stops tracing and writes every ring, oldest record first, as
+ *   "KTRC" version khz cpus events {len name}... {cpu count records}... "KEND"
+ * with little-endian words. Serial output switches the line to raw mode
+ * for the duration so log text cannot interleave. Returns the number of
+ * records written. */
+uint32_t trace_dump(trace_out_t out) {
+    if (out == TRACE_OUT_SERIAL && !serial_present()) {
+        log_event(LOG_WARN, "Trace: no serial port");
+        return 0;
+    }
+    trace_stop();
+    uint32_t cpus = smp_cpu_count();
+    if (cpus > CPU_MAX) {
+        cpus = CPU_MAX;
+    }
+    serial_mode_t saved = serial_mode();
+    if (out == TRACE_OUT_SERIAL) {
+        serial_set_mode(SERIAL_MODE_RAW);
+    }
+    emit_bytes(out, "KTRC", 4);
+    emit_u32(out, TRACE_DUMP_VERSION);
+    emit_u32(out, clock_source_khz());
+    emit_u32(out, cpus);
+    emit_u32(out, TRACE_EVENTS);
+    for (uint32_t i = 0; i < TRACE_EVENTS; ++i) {
+        uint8_t len = (uint8_t)kstrlen(event_names[i]);
+        emit_bytes(out, &len, 1);
+        emit_bytes(out, event_names[i], len);
+    }
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        trace_ring_t *ring = &rings[cpu];
+        uint32_t head = ring->head;
+        uint32_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        emit_u32(out, cpu);
+        emit_u32(out, count);
+        for (uint32_t i = head - count; i != head; ++i) {
+            emit_bytes(out, &ring->records[i & TRACE_RING_MASK], sizeof(trace_record_t));
+        }
+        total += count;
+    }
+    emit_bytes(out, "KEND", 4);
+    if (out == TRACE_OUT_SERIAL) {
+        serial_set_mode(saved);
+    }
+    log_event(LOG_SUCCESS, "Trace: dumped %u records", total);
+    return total;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Static tracepoints. Building with TRACE_ENABLED=0 removes every site;
+ * otherwise a site costs one load and branch until tracing is switched on. */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+/* Each CPU records into its own ring, so emitting takes no lock; once a
+ * ring wraps the oldest records are overwritten. */
+#define TRACE_RING_SIZE 2048
+
+typedef enum {
+    TRACE_GUI_INPUT,
+    TRACE_GUI_COMPLETIONS,
+    TRACE_GUI_COMPOSE,
+    TRACE_BLOCK_ADD,
+    TRACE_CHAIN_VERIFY,
+    TRACE_SCRUB,
+    TRACE_SHA256,
+    TRACE_FS_CREATE,
+    TRACE_FS_MODIFY,
+    TRACE_WORK,
+    TRACE_EVENTS
+} trace_event_t;
+
+typedef enum {
+    TRACE_PH_BEGIN,
+    TRACE_PH_END,
+    TRACE_PH_MARK
+} trace_phase_t;
+
+/* pid is the task that emitted the record (0 before the scheduler runs),
+ * so spans pair up per task even when it migrates between CPUs. */
+typedef struct {
+    uint64_t tsc;
+    uint16_t event;
+    uint8_t phase;
+    uint8_t cpu;
+    uint32_t arg;
+    uint32_t pid;
+} trace_record_t;
+
+typedef enum {
+    TRACE_OUT_SERIAL,
+    TRACE_OUT_DEBUGCON
+} trace_out_t;
+
+extern volatile uint32_t trace_enabled;
+
+void trace_init(void);
+void trace_start(void);
+void trace_stop(void);
+void trace_emit(uint32_t event, uint32_t phase, uint32_t arg);
+uint32_t trace_dump(trace_out_t out);
+
+#if TRACE_ENABLED
+#define TRACE_POINT(event, phase, arg) \
+    do { \
+        if (trace_enabled) { \
+            trace_emit((event), (phase), (uint32_t)(arg)); \
+        } \
+    } while (0)
+#else
+#define TRACE_POINT(event, phase, arg) do { (void)sizeof(arg); } while (0)
+#endif
+
+#define TRACE_BEGIN(event, arg) TRACE_POINT(event, TRACE_PH_BEGIN, arg)
+#define TRACE_END(event, arg) TRACE_POINT(event, TRACE_PH_END, arg)
+#define TRACE_MARK(event, arg) TRACE_POINT(event, TRACE_PH_MARK, arg)
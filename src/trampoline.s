@@ -0,0 +1,67 @@
+/* Real-mode entry for application processors. smp.c copies this blob to
+ * TRAMP_BASE, a page below 1 MB that a STARTUP IPI can point at, and fills
+ * in the parameter block at its end before starting each CPU. Every
+ * address inside is computed relative to that load address. */
+    .set TRAMP_BASE, 0x8000
+    .set CR0_PE, 0x00000001
+    .set CR0_PG_WP, 0x80010000
+
+    .section .rodata
+    .global smp_trampoline_start
+    .global smp_trampoline_params
+    .global smp_trampoline_end
+    .code16
+smp_trampoline_start:
+    cli
+    cld
+    xorw %ax, %ax
+    movw %ax, %ds
+    lgdtl TRAMP_BASE + (tramp_gdtr - smp_trampoline_start)
+    movl %cr0, %eax
+    orl $CR0_PE, %eax
+    movl %eax, %cr0
+    ljmpl $0x08, $(TRAMP_BASE + (tramp_protected - smp_trampoline_start))
+
+    .code32
+tramp_protected:
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    movw %ax, %ss
+    /* CR4 first: the boot CPU's page directory uses 4 MB pages. */
+    movl TRAMP_BASE + (tramp_cr4 - smp_trampoline_start), %eax
+    movl %eax, %cr4
+    movl TRAMP_BASE + (tramp_cr3 - smp_trampoline_start), %eax
+    movl %eax, %cr3
+    movl %cr0, %eax
+    orl $CR0_PG_WP, %eax
+    movl %eax, %cr0
+    movl TRAMP_BASE + (tramp_stack - smp_trampoline_start), %esp
+    movl TRAMP_BASE + (tramp_entry - smp_trampoline_start), %eax
+    pushl $0
+    jmp *%eax
+
+    .align 8
+tramp_gdt:
+    .quad 0
+    .quad 0x00CF9A000000FFFF
+    .quad 0x00CF92000000FFFF
+tramp_gdtr:
+    .word tramp_gdtr - tramp_gdt - 1
+    .long TRAMP_BASE + (tramp_gdt - smp_trampoline_start)
+
+    .align 4
+smp_trampoline_params:
+tramp_cr3:
+    .long 0
+tramp_cr4:
+    .long 0
+tramp_stack:
+    .long 0
+tramp_entry:
+    .long 0
+smp_trampoline_end:
+
+    .section .note.GNU-stack, "", @progbits
@@ -0,0 +1,180 @@
+#include "workqueue.h"
+#include "console.h"
+#include "trace.h"
+#include "common.h"
+
+/* Finished items wait here, oldest first, until the UI task drains them. */
+static spinlock_t done_lock = SPINLOCK_INIT;
+static work_t *done_head;
+static work_t *done_tail;
+static sched_event_t *notify_event;
+
+workqueue_t system_wq;
+
+static void notify(void) {
+    if (notify_event) {
+        sched_event_signal(notify_event);
+    }
+}
+
+void work_init(work_t *work, work_fn_t fn, work_fn_t done, void *arg) {
+    kmemset(work, 0, sizeof(*work));
+    work->fn = fn;
+    work->done = done;
+    work->arg = arg;
+    work->state = WORK_IDLE;
+}
+
+/* Called by fn as it goes; the UI is nudged only when the value changes. */
+/* Callers may be parallel_for workers reporting out of order, so progress
+ * only ever moves forward and a stale smaller value is dropped. */
+void work_set_progress(work_t *work, uint32_t percent) {
+    if (percent > 100) {
+        percent = 100;
+    }
+    uint32_t cur = __atomic_load_n(&work->progress, __ATOMIC_RELAXED);
+    while (cur < percent) {
+        if (__atomic_compare_exchange_n(&work->progress, &cur, percent, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            notify();
+            return;
+        }
+    }
+}
+
+static work_t *take_next(workqueue_t *wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    work_t *work = NULL;
+    for (uint32_t prio = 0; prio < WQ_PRIOS && !work; ++prio) {
+        if (wq->count[prio]) {
+            work = wq->ring[prio][wq->head[prio]];
+            wq->head[prio] = (wq->head[prio] + 1) % WQ_DEPTH;
+            --wq->count[prio];
+        }
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return work;
+}
+
+static void complete(work_t *work) {
+    work->state = WORK_DONE;
+    work->next = NULL;
+    uint32_t flags = spin_lock_irqsave(&done_lock);
+    if (done_tail) {
+        done_tail->next = work;
+    } else {
+        done_head = work;
+    }
+    done_tail = work;
+    spin_unlock_irqrestore(&done_lock, flags);
+    notify();
+}
+
+static void worker_task(void *arg) {
+    wq_worker_t *worker = (wq_worker_t *)arg;
+    for (;;) {
+        work_t *work;
+        while ((work = take_next(worker->wq)) != NULL) {
+            work->state = WORK_RUNNING;
+            TRACE_BEGIN(TRACE_WORK, work->prio);
+            work->fn(work);
+            TRACE_END(TRACE_WORK, work->result);
+            complete(work);
+        }
+        sched_event_wait(&worker->wake);
+    }
+}
+
+/* Workers inherit the caller's affinity, so a queue created during boot
+ * runs its items on CPU0 alongside the code that used to call them
+ * directly; anything they fan out with parallel_for still uses every CPU. */
+int workqueue_create(workqueue_t *wq, const char *name, uint32_t workers, uint32_t task_prio) {
+    if (!workers || workers > WQ_MAX_WORKERS) {
+        return -1;
+    }
+    kmemset(wq, 0, sizeof(*wq));
+    wq->name = name;
+    for (uint32_t i = 0; i < workers; ++i) {
+        wq_worker_t *worker = &wq->worker[i];
+        worker->wq = wq;
+        sched_event_init(&worker->wake);
+        task_t *task = task_spawn(name, worker_task, worker, task_prio);
+        if (!task) {
+            break;
+        }
+        task->flags |= TASK_FLAG_SYSTEM;
+        ++wq->workers;
+    }
+    if (!wq->workers) {
+        log_event(LOG_ERROR, "Workqueue: no worker could be started");
+        return -1;
+    }
+    return 0;
+}
+
+void workqueue_init(void) {
+    if (workqueue_create(&system_wq, "kworker", WQ_SYSTEM_WORKERS, SCHED_PRIO_NORMAL) == 0) {
+        log_event(LOG_SUCCESS, "Workqueue ready");
+    }
+}
+
+/* Fails without blocking when the priority's queue is full, so a caller on
+ * the UI path can report "busy" instead of stalling a frame. */
+int workqueue_submit(workqueue_t *wq, work_t *work, uint32_t prio) {
+    if (prio >= WQ_PRIOS || !work->fn) {
+        return -1;
+    }
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (wq->count[prio] >= WQ_DEPTH) {
+        ++wq->rejected;
+        spin_unlock_irqrestore(&wq->lock, flags);
+        return -1;
+    }
+    work->prio = (uint8_t)prio;
+    work->progress = 0;
+    work->result = 0;
+    work->state = WORK_QUEUED;
+    wq->ring[prio][(wq->head[prio] + wq->count[prio]) % WQ_DEPTH] = work;
+    ++wq->count[prio];
+    ++wq->submitted;
+    spin_unlock_irqrestore(&wq->lock, flags);
+    for (uint32_t i = 0; i < wq->workers; ++i) {
+        sched_event_signal(&wq->worker[i].wake);
+    }
+    return 0;
+}
+
+uint32_t workqueue_pending(workqueue_t *wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    uint32_t pending = 0;
+    for (uint32_t prio = 0; prio < WQ_PRIOS; ++prio) {
+        pending += wq->count[prio];
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return pending;
+}
+
+/* Event signalled whenever an item completes or reports progress. */
+void workqueue_set_notify(sched_event_t *ev) {
+    notify_event = ev;
+}
+
+/* Runs pending completion callbacks on the calling (UI) task; returns how
+ * many ran. */
+int workqueue_run_completions(void) {
+    uint32_t flags = spin_lock_irqsave(&done_lock);
+    work_t *work = done_head;
+    done_head = NULL;
+    done_tail = NULL;
+    spin_unlock_irqrestore(&done_lock, flags);
+    int ran = 0;
+    while (work) {
+        work_t *next = work->next;
+        if (work->done) {
+            work->done(work);
+        }
+        work = next;
+        ++ran;
+    }
+    return ran;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include "sched.h"
+#include "spinlock.h"
+
+#define WQ_PRIO_HIGH 0
+#define WQ_PRIO_NORMAL 1
+#define WQ_PRIO_LOW 2
+#define WQ_PRIOS 3
+
+#define WQ_DEPTH 16
+#define WQ_MAX_WORKERS 4
+#define WQ_SYSTEM_WORKERS 1
+
+typedef enum {
+    WORK_IDLE,
+    WORK_QUEUED,
+    WORK_RUNNING,
+    WORK_DONE
+} work_state_t;
+
+struct work;
+typedef void (*work_fn_t)(struct work *work);
+
+/* Caller-owned work item. fn runs on a worker task and leaves its outcome
+ * in result; done then runs on the UI task from workqueue_run_completions,
+ * where it may touch UI state and free the item. */
+typedef struct work {
+    struct work *next;
+    work_fn_t fn;
+    work_fn_t done;
+    void *arg;
+    int result;
+    volatile uint32_t progress;
+    uint8_t prio;
+    volatile uint8_t state;
+} work_t;
+
+struct workqueue;
+
+typedef struct {
+    struct workqueue *wq;
+    sched_event_t wake;
+} wq_worker_t;
+
+/* One bounded FIFO per priority, served highest priority first by a small
+ * pool of worker tasks. */
+typedef struct workqueue {
+    const char *name;
+    spinlock_t lock;
+    work_t *ring[WQ_PRIOS][WQ_DEPTH];
+    uint32_t head[WQ_PRIOS];
+    uint32_t count[WQ_PRIOS];
+    uint32_t workers;
+    wq_worker_t worker[WQ_MAX_WORKERS];
+    uint32_t submitted;
+    uint32_t rejected;
+} workqueue_t;
+
+/* Shared queue for deferred kernel work. Its single worker keeps items in
+ * submission order within a priority, so a RECOVER queued before a VERIFY
+ * of the same file is applied first. */
+extern workqueue_t system_wq;
+
+void workqueue_init(void);
+void work_init(work_t *work, work_fn_t fn, work_fn_t done, void *arg);
+void work_set_progress(work_t *work, uint32_t percent);
+
+int workqueue_create(workqueue_t *wq, const char *name, uint32_t workers, uint32_t task_prio);
+int workqueue_submit(workqueue_t *wq, work_t *work, uint32_t prio);
+uint32_t workqueue_pending(workqueue_t *wq);
+void workqueue_set_notify(sched_event_t *ev);
+int workqueue_run_completions(void);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Chase-Lev work-stealing deque over a fixed ring, with the C11 orderings
+ * from Le et al., "Correct and Efficient Work-Stealing for Weak Memory
+ * Models". One owner pushes and pops at the bottom; any CPU may steal from
+ * the top. The ends live on separate cache lines so thieves polling top do
+ * not bounce the owner's bottom. */
+#define WSDEQUE_SIZE 256
+#define WSDEQUE_MASK (WSDEQUE_SIZE - 1)
+
+typedef struct {
+    int32_t top __attribute__((aligned(64)));
+    int32_t bottom __attribute__((aligned(64)));
+    void *slots[WSDEQUE_SIZE];
+} wsdeque_t;
+
+static inline void wsdeque_init(wsdeque_t *q) {
+    q->top = 0;
+    q->bottom = 0;
+}
+
+/* Owner only. Returns -1 when the ring is full. */
+static inline int wsdeque_push(wsdeque_t *q, void *item) {
+    int32_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+    int32_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - t >= WSDEQUE_SIZE) {
+        return -1;
+    }
+    __atomic_store_n(&q->slots[b & WSDEQUE_MASK], item, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Owner only; newest item first. */
+static inline void *wsdeque_pop(wsdeque_t *q) {
+    int32_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&q->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int32_t t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    void *item = __atomic_load_n(&q->slots[b & WSDEQUE_MASK], __ATOMIC_RELAXED);
+    if (t == b) {
+        /* Last item: race the thieves for it through top. */
+        if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            item = NULL;
+        }
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return item;
+}
+
+/* Any CPU; oldest item first. A lost race with another thief or the owner
+ * is retried, so NULL means the deque was seen empty. */
+static inline void *wsdeque_steal(wsdeque_t *q) {
+    for (;;) {
+        int32_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int32_t b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+        if (t >= b) {
+            return NULL;
+        }
+        void *item = __atomic_load_n(&q->slots[t & WSDEQUE_MASK], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return item;
+        }
+    }
+}
+
+static inline int32_t wsdeque_size(const wsdeque_t *q) {
+    int32_t size = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+    return size > 0 ? size : 0;
+}
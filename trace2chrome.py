@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""
+Convert a kernel trace dump (TRACE DUMP) into Chrome trace JSON.
+
+The dump may be a raw COM1 capture with log lines around it; everything
+outside the "KTRC" ... "KEND" frame is ignored. Open the result in
+chrome://tracing or https://ui.perfetto.dev.
+"""
+import argparse
+import json
+import struct
+import sys
+from pathlib import Path
+
+MAGIC = b"KTRC"
+TRAILER = b"KEND"
+VERSION = 2
+RECORD = struct.Struct("<QHBBII")
+PHASES = {0: "B", 1: "E", 2: "i"}
+
+
+class Reader:
+    def __init__(self, data: bytes, offset: int) -> None:
+        self.data = data
+        self.offset = offset
+
+    def take(self, n: int) -> bytes:
+        if self.offset + n > len(self.data):
+            raise SystemExit("[!] Trace dump is truncated.")
+        chunk = self.data[self.offset:self.offset + n]
+        self.offset += n
+        return chunk
+
+    def u32(self) -> int:
+        return struct.unpack("<I", self.take(4))[0]
+
+
+def parse(data: bytes) -> dict:
+    start = data.find(MAGIC)
+    if start < 0:
+        raise SystemExit("[!] No KTRC trace frame found in input.")
+    r = Reader(data, start + len(MAGIC))
+    version = r.u32()
+    if version != VERSION:
+        raise SystemExit(f"[!] Unsupported trace version {version}.")
+    khz = r.u32()
+    cpus = r.u32()
+    names = []
+    for _ in range(r.u32()):
+        length = r.take(1)[0]
+        names.append(r.take(length).decode("ascii", "replace"))
+
+    records = []
+    for _ in range(cpus):
+        cpu = r.u32()
+        count = r.u32()
+        for _ in range(count):
+            tsc, event, phase, rec_cpu, arg, pid = RECORD.unpack(r.take(RECORD.size))
+            records.append((tsc, pid, cpu, event, phase, arg))
+    if r.take(len(TRAILER)) != TRAILER:
+        raise SystemExit("[!] Trace frame has no KEND trailer.")
+    return {"khz": khz, "names": names, "records": records}
+
+
+def to_chrome(trace: dict) -> dict:
+    khz = trace["khz"] or 1
+    records = sorted(trace["records"])
+    base = records[0][0] if records else 0
+    events = []
+    for tsc, pid, cpu, event, phase, arg in records:
+        name = trace["names"][event] if event < len(trace["names"]) else f"event{event}"
+        entry = {
+            "name": name,
+            "cat": name.split(".")[0],
+            "ph": PHASES.get(phase, "i"),
+            "ts": (tsc - base) * 1000.0 / khz,
+            "pid": 0,
+            "tid": pid,
+            "args": {"arg": arg, "cpu": cpu},
+        }
+        if entry["ph"] == "i":
+            entry["s"] = "t"
+        events.append(entry)
+    for pid in sorted({rec[1] for rec in records}):
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": pid,
+                       "args": {"name": f"PID {pid}"}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", type=Path, help="serial capture or debugcon file")
+    parser.add_argument("-o", "--output", type=Path, help="JSON file (default: stdout)")
+    args = parser.parse_args()
+
+    trace = parse(args.dump.read_bytes())
+    text = json.dumps(to_chrome(trace))
+    if args.output:
+        args.output.write_text(text)
+        print(f"[✓] {len(trace['records'])} records written to {args.output}", file=sys.stderr)
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()